@@ -7,8 +7,10 @@ usage() {
     echo "  start             start profiling and return immediately"
     echo "  resume            resume profiling without resetting collected data"
     echo "  stop              stop profiling"
+    echo "  dump              dump collected data without stopping profiling session"
     echo "  check             check if the specified profiling event is available"
     echo "  status            print profiling status"
+    echo "  metrics           print profiler overhead metrics"
     echo "  list              list profiling events supported by the target JVM"
     echo "  collect           collect profile for the specified period of time"
     echo "                    and then stop (default action)"
@@ -30,12 +32,30 @@ usage() {
     echo "  --title string    FlameGraph title"
     echo "  --minwidth pct    skip frames smaller than pct%"
     echo "  --reverse         generate stack-reversed FlameGraph / Call tree"
+    echo "  --compress        gzip the output file, implied by .gz file extension"
     echo ""
     echo "  --alloc bytes     allocation profiling interval in bytes"
     echo "  --lock duration   lock profiling threshold in nanoseconds"
+    echo "  --offcpu duration off-CPU profiling threshold in nanoseconds"
     echo "  --total           accumulate the total value (time, bytes, etc.)"
     echo "  --all-user        only include user-mode events"
-    echo "  --cstack mode     how to traverse C stack: fp|lbr|no"
+    echo "  --cstack mode     how to traverse C stack: fp|lbr|dwarf|no"
+    echo "  --percpu          use per-CPU sample buffers"
+    echo "  --percpu-stats    use per-CPU sample buffers and count recovered samples"
+    echo "  --timing          measure sampling stage latencies for the metrics action"
+    echo "  --batch size      drain perf_events samples in batches"
+    echo "  --cpu-events      open perf_events per CPU rather than per thread"
+    echo "  --group list      count more perf events with each sample, e.g. instructions+cache-misses"
+    echo "  --ratio expr      color flame graph by counter ratio, e.g. instructions/cycles"
+    echo "  --tracestore mode how to store call traces: flat|trie|compact"
+    echo "  --memlimit bytes  limit memory used for call traces"
+    echo "  --normalize list  simplify call traces: bci+recursion+lambda"
+    echo "  --chunktime time  start a new JFR chunk periodically, e.g. 60s"
+    echo "  --chunksize bytes start a new JFR chunk when it exceeds the size"
+    echo "  --blackbox size   keep the last JFR events in memory until dumped"
+    echo "  --maxage time     discard in-memory JFR events older than time, e.g. 600s"
+    echo "  --aggregate time  write JFR samples as counts per time slice, e.g. 1s"
+    echo "  --safepoints time record JFR safepoint events polled every time, e.g. 100us"
     echo "  --begin function  begin profiling when function is executed"
     echo "  --end function    end profiling when function is executed"
     echo "  --ttsp            time-to-safepoint profiling"
@@ -114,7 +134,7 @@ while [ $# -gt 0 ]; do
         -h|"-?")
             usage
             ;;
-        start|resume|stop|check|status|list|collect)
+        start|resume|stop|dump|check|status|metrics|list|collect)
             ACTION="$1"
             ;;
         -v|--version)
@@ -183,10 +203,13 @@ while [ $# -gt 0 ]; do
         --reverse)
             FORMAT="$FORMAT,reverse"
             ;;
+        --compress)
+            FORMAT="$FORMAT,compress"
+            ;;
         --samples|--total)
             FORMAT="$FORMAT,${1#--}"
             ;;
-        --alloc|--lock)
+        --alloc|--lock|--offcpu)
             PARAMS="$PARAMS,${1#--}=$2"
             shift
             ;;
@@ -197,6 +220,46 @@ while [ $# -gt 0 ]; do
             PARAMS="$PARAMS,cstack=$2"
             shift
             ;;
+        --percpu)
+            PARAMS="$PARAMS,percpu"
+            ;;
+        --percpu-stats)
+            PARAMS="$PARAMS,percpu=stats"
+            ;;
+        --timing)
+            PARAMS="$PARAMS,timing"
+            ;;
+        --batch)
+            PARAMS="$PARAMS,batch=$2"
+            shift
+            ;;
+        --cpu-events)
+            PARAMS="$PARAMS,cpuevents"
+            ;;
+        --group)
+            PARAMS="$PARAMS,group=$2"
+            shift
+            ;;
+        --ratio)
+            PARAMS="$PARAMS,ratio=$2"
+            shift
+            ;;
+        --tracestore)
+            PARAMS="$PARAMS,tracestore=$2"
+            shift
+            ;;
+        --memlimit)
+            PARAMS="$PARAMS,memlimit=$2"
+            shift
+            ;;
+        --normalize)
+            PARAMS="$PARAMS,normalize=$2"
+            shift
+            ;;
+        --chunktime|--chunksize|--blackbox|--maxage|--aggregate|--safepoints)
+            PARAMS="$PARAMS,${1#--}=$2"
+            shift
+            ;;
         --begin|--end)
             PARAMS="$PARAMS,${1#--}=$2"
             shift
@@ -264,12 +327,15 @@ case $ACTION in
     start|resume|check)
         jattach "$ACTION,file=$FILE,$OUTPUT$FORMAT$PARAMS"
         ;;
-    stop)
-        jattach "stop,file=$FILE,$OUTPUT$FORMAT"
+    stop|dump)
+        jattach "$ACTION,file=$FILE,$OUTPUT$FORMAT"
         ;;
     status)
         jattach "status,file=$FILE"
         ;;
+    metrics)
+        jattach "metrics,file=$FILE"
+        ;;
     list)
         jattach "list,file=$FILE"
         ;;
@@ -112,6 +112,21 @@ public class AsyncProfiler implements AsyncProfilerMXBean {
         }
     }
 
+    /**
+     * Get profiler overhead metrics: latency of the signal handler stages
+     * and memory used by internal data structures
+     *
+     * @return Textual report
+     */
+    @Override
+    public String getMetrics() {
+        try {
+            return execute0("metrics");
+        } catch (IOException e) {
+            throw new IllegalStateException(e);
+        }
+    }
+
     /**
      * Execute an agent-compatible profiling command -
      * the comma-separated list of arguments described in arguments.cpp
@@ -174,6 +189,24 @@ public class AsyncProfiler implements AsyncProfilerMXBean {
         }
     }
 
+    /**
+     * Write JFR events retained in memory to a file.
+     * Profiling must have been started with 'jfr' and 'blackbox' options
+     *
+     * @param fileName Name of the JFR file to create
+     */
+    @Override
+    public void dumpJfr(String fileName) {
+        if (fileName == null) {
+            throw new NullPointerException();
+        }
+        try {
+            execute0("dump,jfr,file=" + fileName);
+        } catch (IOException e) {
+            throw new IllegalStateException(e);
+        }
+    }
+
     /**
      * Add the given thread to the set of profiled threads.
      * 'filter' option must be enabled to use this method.
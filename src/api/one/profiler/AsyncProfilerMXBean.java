@@ -34,10 +34,12 @@ public interface AsyncProfilerMXBean {
 
     long getSamples();
     String getVersion();
+    String getMetrics();
 
     String execute(String command) throws IllegalArgumentException, IllegalStateException, java.io.IOException;
 
     String dumpCollapsed(Counter counter);
     String dumpTraces(int maxTraces);
     String dumpFlat(int maxMethods);
+    void dumpJfr(String fileName);
 }
@@ -48,17 +48,29 @@ const size_t EXTRA_BUF_SIZE = 512;
 //     start           - start profiling
 //     resume          - start or resume profiling without resetting collected data
 //     stop            - stop profiling
+//     dump            - dump collected data without stopping profiling session
 //     check           - check if the specified profiling event is available
 //     status          - print profiling status (inactive / running for X seconds)
+//     metrics         - print profiler overhead: stage latencies and memory usage
 //     list            - show the list of available profiling events
 //     version[=full]  - display the agent version
 //     event=EVENT     - which event to trace (cpu, wall, cache-misses, etc.)
 //     alloc[=BYTES]   - profile allocations with BYTES interval
 //     lock[=DURATION] - profile contended locks longer than DURATION ns
+//     offcpu[=DURATION] - profile off-CPU time of threads descheduled longer than DURATION ns
 //     collapsed       - dump collapsed stacks (the format used by FlameGraph script)
 //     flamegraph      - produce Flame Graph in HTML format
 //     tree            - produce call tree in HTML format
 //     jfr             - dump events in Java Flight Recorder format
+//     chunktime=TIME  - start a new JFR chunk every TIME (e.g. 60s)
+//     chunksize=BYTES - start a new JFR chunk when the current one exceeds BYTES (e.g. 64m)
+//     blackbox[=SIZE] - keep only the last SIZE bytes of JFR events in memory until dumped (default: 64m)
+//     maxage=TIME     - in blackbox mode, discard JFR events older than TIME (e.g. 600s)
+//     aggregate[=T]   - write JFR execution samples as counts per thread and stack trace
+//                       over time slices of length T (default: 100ms)
+//     safepoints[=T]  - record JFR safepoint events, polling the VM state every T (default: 1ms)
+//     compress[=ALG]  - compress output files; ALG is 'gzip' (default) or 'none';
+//                       implied by a FILENAME ending with .gz
 //     traces[=N]      - dump top N call traces
 //     flat[=N]        - dump top N methods (aka flat profile)
 //     samples         - count the number of samples (default)
@@ -70,8 +82,26 @@ const size_t EXTRA_BUF_SIZE = 512;
 //     log=FILENAME    - log warnings and errors to the given dedicated stream
 //     filter=FILTER   - thread filter
 //     threads         - profile different threads separately
+//     percpu[=stats]  - record samples into per-CPU buffers instead of a shared lock pool;
+//                       'stats' also counts samples the shared pool would have skipped
+//     timing          - measure latencies of sampling stages for the metrics action
+//     batch[=SIZE]    - drain perf_events samples in batches from per-thread ring buffers
+//                       of SIZE bytes instead of handling a signal per sample (default: 64k)
+//     cpuevents       - open one perf_events counter per CPU for the whole process instead of
+//                       one per thread; implies batch mode
+//     group=LIST      - read up to 3 more perf events with every sample; LIST is '+' separated
+//     ratio=[N*]A/B   - color flame graph frames by the ratio of two counters among the sampled
+//                       event and the group events, e.g. 1000*cache-misses/instructions
+//     tracestore=MODE - how to keep call traces: 'flat' (full copy of each trace, default),
+//                       'trie' (traces share common frame prefixes) or 'compact' (8-byte frames)
+//     memlimit=BYTES  - limit the memory used for storing call traces
+//     normalize=LIST  - simplify call traces before storing; LIST is a '+' separated list of
+//                       'bci' (erase bytecode indices), 'recursion' (collapse recursive calls),
+//                       'lambda' (fold generated lambda, proxy and accessor frames);
+//                       all of them if LIST is omitted
 //     cstack=MODE     - how to collect C stack frames in addition to Java stack
-//                       MODE is 'fp' (Frame Pointer), 'lbr' (Last Branch Record) or 'no'
+//                       MODE is 'fp' (Frame Pointer), 'lbr' (Last Branch Record),
+//                       'dwarf' (DWARF unwind tables) or 'no'
 //     allkernel       - include only kernel-mode events
 //     alluser         - include only user-mode events
 //     simple          - simple class names instead of FQN
@@ -118,12 +148,18 @@ Error Arguments::parse(const char* args) {
             CASE("stop")
                 _action = ACTION_STOP;
 
+            CASE("dump")
+                _action = ACTION_DUMP;
+
             CASE("check")
                 _action = ACTION_CHECK;
 
             CASE("status")
                 _action = ACTION_STATUS;
 
+            CASE("metrics")
+                _action = ACTION_METRICS;
+
             CASE("list")
                 _action = ACTION_LIST;
 
@@ -146,6 +182,45 @@ Error Arguments::parse(const char* args) {
                                strcmp(value, "combine") == 0 ? JFR_COMBINE :
                                (int)strtol(value, NULL, 0);
 
+            CASE("chunktime")
+                if (value == NULL || (_chunk_time = parseUnits(value)) <= 0) {
+                    msg = "Invalid chunktime";
+                }
+
+            CASE("chunksize")
+                if (value == NULL || (_chunk_size = parseUnits(value)) <= 0) {
+                    msg = "Invalid chunksize";
+                }
+
+            CASE("blackbox")
+                if ((_blackbox = value == NULL ? DEFAULT_BLACKBOX_SIZE : parseUnits(value)) <= 0) {
+                    msg = "Invalid blackbox size";
+                }
+
+            CASE("aggregate")
+                if ((_aggregate = value == NULL ? DEFAULT_AGGREGATE_SLICE : parseUnits(value)) <= 0) {
+                    msg = "Invalid aggregate";
+                }
+
+            CASE("safepoints")
+                if ((_safepoints = value == NULL ? DEFAULT_SAFEPOINT_POLL : parseUnits(value)) <= 0) {
+                    msg = "Invalid safepoints interval";
+                }
+
+            CASE("maxage")
+                if (value == NULL || (_max_age = parseUnits(value)) <= 0) {
+                    msg = "Invalid maxage";
+                }
+
+            CASE("compress")
+                if (value == NULL || strcmp(value, "gzip") == 0) {
+                    _compress = COMPRESS_GZIP;
+                } else if (strcmp(value, "none") == 0) {
+                    _compress = COMPRESS_NONE;
+                } else {
+                    msg = "Unsupported compression, only gzip is available";
+                }
+
             CASE("traces")
                 _output = OUTPUT_TEXT;
                 _dump_traces = value == NULL ? INT_MAX : atoi(value);
@@ -186,6 +261,12 @@ Error Arguments::parse(const char* args) {
                     msg = "lock must be >= 0";
                 }
 
+            CASE("offcpu")
+                _offcpu = value == NULL ? 0 : parseUnits(value);
+                if (_offcpu < 0) {
+                    msg = "offcpu must be >= 0";
+                }
+
             CASE("interval")
                 if (value == NULL || (_interval = parseUnits(value)) <= 0) {
                     msg = "Invalid interval";
@@ -221,18 +302,80 @@ Error Arguments::parse(const char* args) {
             CASE("threads")
                 _threads = true;
 
+            CASE("percpu")
+                _percpu = true;
+                _percpu_stats = value != NULL && strcmp(value, "stats") == 0;
+
+            CASE("timing")
+                _timing = true;
+
+            CASE("batch")
+                if ((_perf_batch = value == NULL ? DEFAULT_PERF_BATCH : parseUnits(value)) <= 0) {
+                    msg = "Invalid batch size";
+                }
+
+            CASE("cpuevents")
+                _cpu_events = true;
+
+            CASE("group")
+                if (value == NULL || value[0] == 0) {
+                    msg = "group must specify at least one event";
+                } else {
+                    _group = value;
+                }
+
+            CASE("ratio")
+                if (value == NULL || strchr(value, '/') == NULL) {
+                    msg = "ratio must be in the form [N*]A/B";
+                } else {
+                    _ratio = value;
+                }
+
+            CASE("tracestore")
+                if (value != NULL) {
+                    if (strcmp(value, "flat") == 0) {
+                        _trace_store = TRACE_STORE_FLAT;
+                    } else if (strcmp(value, "trie") == 0) {
+                        _trace_store = TRACE_STORE_TRIE;
+                    } else if (strcmp(value, "compact") == 0) {
+                        _trace_store = TRACE_STORE_COMPACT;
+                    } else {
+                        msg = "tracestore must be 'flat', 'trie' or 'compact'";
+                    }
+                }
+
+            CASE("memlimit")
+                if (value == NULL || (_memlimit = parseUnits(value)) < 0) {
+                    msg = "memlimit must be >= 0";
+                }
+
             CASE("allkernel")
                 _ring = RING_KERNEL;
 
             CASE("alluser")
                 _ring = RING_USER;
 
+            CASE("normalize")
+                if (value == NULL) {
+                    _normalize = NORMALIZE_ALL;
+                } else {
+                    _normalize = 0;
+                    if (strstr(value, "bci") != NULL) _normalize |= NORMALIZE_BCI;
+                    if (strstr(value, "recursion") != NULL) _normalize |= NORMALIZE_RECURSION;
+                    if (strstr(value, "lambda") != NULL) _normalize |= NORMALIZE_LAMBDA;
+                    if (_normalize == 0) {
+                        msg = "normalize must list bci, recursion or lambda";
+                    }
+                }
+
             CASE("cstack")
                 if (value != NULL) {
                     if (value[0] == 'n') {
                         _cstack = CSTACK_NO;
                     } else if (value[0] == 'l') {
                         _cstack = CSTACK_LBR;
+                    } else if (value[0] == 'd') {
+                        _cstack = CSTACK_DWARF;
                     } else {
                         _cstack = CSTACK_FP;
                     }
@@ -274,7 +417,9 @@ Error Arguments::parse(const char* args) {
         return Error(msg);
     }
 
-    if (_event == NULL && _alloc == 0 && _lock == 0) {
+    if (_event == NULL && _offcpu >= 0) {
+        _event = EVENT_OFFCPU;
+    } else if (_event == NULL && _alloc == 0 && _lock == 0) {
         _event = EVENT_CPU;
     }
 
@@ -282,6 +427,10 @@ Error Arguments::parse(const char* args) {
         _file = expandFilePattern(_buf + len + 1, EXTRA_BUF_SIZE - 1, _file);
     }
 
+    if (_file != NULL && hasExtension(_file, strlen(_file), ".gz")) {
+        _compress = COMPRESS_GZIP;
+    }
+
     if (_file != NULL && _output == OUTPUT_NONE) {
         _output = detectOutputFormat(_file);
         if (_output == OUTPUT_SVG) {
@@ -291,8 +440,10 @@ Error Arguments::parse(const char* args) {
         _dump_flat = 200;
     }
 
-    if (_output != OUTPUT_NONE && (_action == ACTION_NONE || _action == ACTION_STOP)) {
-        _action = ACTION_DUMP;
+    if (_output != OUTPUT_NONE && _action == ACTION_NONE) {
+        _action = ACTION_STOP;
+    } else if (_output == OUTPUT_NONE && _action == ACTION_DUMP) {
+        _output = OUTPUT_TEXT;
     }
 
     return Error::OK;
@@ -345,18 +496,26 @@ const char* Arguments::expandFilePattern(char* dest, size_t max_size, const char
     return dest;
 }
 
+bool Arguments::hasExtension(const char* file, size_t len, const char* ext) {
+    size_t ext_len = strlen(ext);
+    return len >= ext_len && strncmp(file + len - ext_len, ext, ext_len) == 0;
+}
+
 Output Arguments::detectOutputFormat(const char* file) {
-    const char* ext = strrchr(file, '.');
-    if (ext != NULL) {
-        if (strcmp(ext, ".html") == 0) {
-            return OUTPUT_FLAMEGRAPH;
-        } else if (strcmp(ext, ".jfr") == 0) {
-            return OUTPUT_JFR;
-        } else if (strcmp(ext, ".collapsed") == 0 || strcmp(ext, ".folded") == 0) {
-            return OUTPUT_COLLAPSED;
-        } else if (strcmp(ext, ".svg") == 0) {
-            return OUTPUT_SVG;
-        }
+    // For a compressed file, look at the extension before .gz
+    size_t len = strlen(file);
+    if (hasExtension(file, len, ".gz")) {
+        len -= 3;
+    }
+
+    if (hasExtension(file, len, ".html")) {
+        return OUTPUT_FLAMEGRAPH;
+    } else if (hasExtension(file, len, ".jfr")) {
+        return OUTPUT_JFR;
+    } else if (hasExtension(file, len, ".collapsed") || hasExtension(file, len, ".folded")) {
+        return OUTPUT_COLLAPSED;
+    } else if (hasExtension(file, len, ".svg")) {
+        return OUTPUT_SVG;
     }
     return OUTPUT_TEXT;
 }
@@ -22,24 +22,31 @@
 
 const long DEFAULT_INTERVAL = 10000000;  // 10 ms
 const int DEFAULT_JSTACKDEPTH = 2048;
+const long DEFAULT_BLACKBOX_SIZE = 64 * 1024 * 1024;
+const long DEFAULT_AGGREGATE_SLICE = 100000000;  // 100 ms
+const long DEFAULT_SAFEPOINT_POLL = 1000000;     // 1 ms
+const long DEFAULT_PERF_BATCH = 64 * 1024;
+const int MAX_GROUP_EVENTS = 3;
 
 const char* const EVENT_CPU    = "cpu";
 const char* const EVENT_ALLOC  = "alloc";
 const char* const EVENT_LOCK   = "lock";
 const char* const EVENT_WALL   = "wall";
 const char* const EVENT_ITIMER = "itimer";
+const char* const EVENT_OFFCPU = "offcpu";
 
 enum Action {
     ACTION_NONE,
     ACTION_START,
     ACTION_RESUME,
     ACTION_STOP,
+    ACTION_DUMP,
     ACTION_CHECK,
     ACTION_STATUS,
+    ACTION_METRICS,
     ACTION_LIST,
     ACTION_VERSION,
-    ACTION_FULL_VERSION,
-    ACTION_DUMP
+    ACTION_FULL_VERSION
 };
 
 enum Counter {
@@ -64,7 +71,21 @@ enum CStack {
     CSTACK_DEFAULT,
     CSTACK_NO,
     CSTACK_FP,
-    CSTACK_LBR
+    CSTACK_LBR,
+    CSTACK_DWARF
+};
+
+enum Normalize {
+    NORMALIZE_BCI       = 1,
+    NORMALIZE_RECURSION = 2,
+    NORMALIZE_LAMBDA    = 4,
+    NORMALIZE_ALL       = NORMALIZE_BCI | NORMALIZE_RECURSION | NORMALIZE_LAMBDA
+};
+
+enum TraceStore {
+    TRACE_STORE_FLAT,
+    TRACE_STORE_TRIE,
+    TRACE_STORE_COMPACT
 };
 
 enum Output {
@@ -77,6 +98,11 @@ enum Output {
     OUTPUT_JFR
 };
 
+enum Compression {
+    COMPRESS_NONE,
+    COMPRESS_GZIP
+};
+
 enum JfrOption {
     NO_SYSTEM_INFO  = 0x1,
     NO_SYSTEM_PROPS = 0x2,
@@ -118,6 +144,7 @@ class Arguments {
 
     static long long hash(const char* arg);
     static const char* expandFilePattern(char* dest, size_t max_size, const char* pattern);
+    static bool hasExtension(const char* file, size_t len, const char* ext);
     static Output detectOutputFormat(const char* file);
     static long parseUnits(const char* str);
 
@@ -129,6 +156,7 @@ class Arguments {
     long _interval;
     long _alloc;
     long _lock;
+    long _offcpu;
     int  _jstackdepth;
     int _safe_mode;
     const char* _file;
@@ -137,10 +165,27 @@ class Arguments {
     int _include;
     int _exclude;
     bool _threads;
+    bool _percpu;
+    bool _percpu_stats;
+    bool _timing;
+    long _perf_batch;
+    bool _cpu_events;
+    const char* _group;
+    const char* _ratio;
+    TraceStore _trace_store;
+    long _memlimit;
+    int _normalize;
     int _style;
     CStack _cstack;
     Output _output;
+    Compression _compress;
     int _jfr_options;
+    long _chunk_time;
+    long _chunk_size;
+    long _blackbox;
+    long _max_age;
+    long _aggregate;
+    long _safepoints;
     int _dump_traces;
     int _dump_flat;
     const char* _begin;
@@ -160,6 +205,7 @@ class Arguments {
         _interval(0),
         _alloc(0),
         _lock(0),
+        _offcpu(-1),
         _jstackdepth(DEFAULT_JSTACKDEPTH),
         _safe_mode(0),
         _file(NULL),
@@ -168,10 +214,27 @@ class Arguments {
         _include(0),
         _exclude(0),
         _threads(false),
+        _percpu(false),
+        _percpu_stats(false),
+        _timing(false),
+        _perf_batch(0),
+        _cpu_events(false),
+        _group(NULL),
+        _ratio(NULL),
+        _trace_store(TRACE_STORE_FLAT),
+        _memlimit(0),
+        _normalize(0),
         _style(0),
         _cstack(CSTACK_DEFAULT),
         _output(OUTPUT_NONE),
+        _compress(COMPRESS_NONE),
         _jfr_options(0),
+        _chunk_time(0),
+        _chunk_size(0),
+        _blackbox(0),
+        _max_age(0),
+        _aggregate(0),
+        _safepoints(0),
         _dump_traces(0),
         _dump_flat(0),
         _begin(NULL),
@@ -188,7 +251,7 @@ class Arguments {
     Error parse(const char* args);
 
     bool hasOutputFile() const {
-        return _file != NULL && (_action == ACTION_DUMP ? _output != OUTPUT_JFR : _action >= ACTION_STATUS);
+        return _file != NULL && (_action == ACTION_STOP || _action == ACTION_DUMP ? _output != OUTPUT_JFR : _action >= ACTION_STATUS);
     }
 
     bool hasOption(JfrOption option) const {
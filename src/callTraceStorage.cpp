@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include "callTraceStorage.h"
+#include "methodIndex.h"
 #include "os.h"
 
 
@@ -24,6 +26,11 @@ static const u32 INITIAL_CAPACITY = 65536;
 static const u32 CALL_TRACE_CHUNK = 8 * 1024 * 1024;
 static const u32 OVERFLOW_TRACE_ID = 0x7fffffff;
 static const size_t PAGE_ALIGNMENT = sysconf(_SC_PAGESIZE) - 1;
+static const int FRAME_TRIE_BITS = 20;
+static const size_t FRAME_TRIE_SIZE = sizeof(FrameNode*) << FRAME_TRIE_BITS;
+// With memlimit, new traces are truncated to this many top frames when the storage is almost full
+static const int TRUNCATED_DEPTH = 16;
+static const int METHOD_INDEX_BITS = 19;
 
 
 class LongHashTable {
@@ -35,12 +42,12 @@ class LongHashTable {
     volatile u32 _size;
     u32 _padding2[15];
 
+  public:
     static size_t getSize(u32 capacity) {
         size_t size = sizeof(LongHashTable) + (sizeof(u64) + sizeof(CallTraceSample)) * capacity;
         return (size + PAGE_ALIGNMENT) & ~PAGE_ALIGNMENT;
     }
 
-  public:
     static LongHashTable* allocate(LongHashTable* prev, u32 capacity) {
         LongHashTable* table = (LongHashTable*)OS::safeAlloc(getSize(capacity));
         if (table != NULL) {
@@ -88,30 +95,230 @@ class LongHashTable {
 };
 
 
-CallTrace CallTraceStorage::_overflow_trace = {1, {BCI_ERROR, (jmethodID)"[storage_overflow]"}};
+// Call traces recorded between two dumps
+class CallTraceEpoch {
+  public:
+    LinearAllocator _allocator;
+    LongHashTable* _current_table;
+    volatile u64 _table_memory;
+    u64 _overflow;
+    u64 _truncated;
+    // Hash buckets of the frame trie, allocated on first use
+    FrameNode** volatile _frame_trie;
+    // Memory of the whole storage, checked against the limit on every put()
+    volatile u64* _memory_counter;
+
+    CallTraceEpoch(volatile u64* memory_counter) : _allocator(CALL_TRACE_CHUNK, memory_counter) {
+        _memory_counter = memory_counter;
+        _table_memory = 0;
+        _current_table = allocateTable(NULL, INITIAL_CAPACITY);
+        _overflow = 0;
+        _truncated = 0;
+        _frame_trie = NULL;
+    }
+
+    ~CallTraceEpoch() {
+        while (_current_table != NULL) {
+            _current_table = destroyTable(_current_table);
+        }
+        if (_frame_trie != NULL) {
+            OS::safeFree(_frame_trie, FRAME_TRIE_SIZE);
+            atomicInc(*_memory_counter, -(u64)FRAME_TRIE_SIZE);
+        }
+    }
+
+    LongHashTable* allocateTable(LongHashTable* prev, u32 capacity) {
+        LongHashTable* table = LongHashTable::allocate(prev, capacity);
+        if (table != NULL) {
+            atomicInc(_table_memory, LongHashTable::getSize(capacity));
+            atomicInc(*_memory_counter, LongHashTable::getSize(capacity));
+        }
+        return table;
+    }
+
+    LongHashTable* destroyTable(LongHashTable* table) {
+        atomicInc(_table_memory, -(u64)LongHashTable::getSize(table->capacity()));
+        atomicInc(*_memory_counter, -(u64)LongHashTable::getSize(table->capacity()));
+        return table->destroy();
+    }
+
+    u64 allocatorMemory() {
+        return _allocator.usedMemory();
+    }
+
+    u64 tableMemory() {
+        return _table_memory + (_frame_trie != NULL ? FRAME_TRIE_SIZE : 0);
+    }
+
+    u64 usedMemory() {
+        return allocatorMemory() + tableMemory();
+    }
+
+    FrameNode* volatile* frameTrieBucket(FrameNode* parent, const ASGCT_CallFrame& frame) {
+        FrameNode** buckets = _frame_trie;
+        if (buckets == NULL) {
+            buckets = (FrameNode**)OS::safeAlloc(FRAME_TRIE_SIZE);
+            if (buckets == NULL) {
+                return NULL;
+            }
+            FrameNode** prev = __sync_val_compare_and_swap(&_frame_trie, NULL, buckets);
+            if (prev != NULL) {
+                OS::safeFree(buckets, FRAME_TRIE_SIZE);
+                buckets = prev;
+            } else {
+                atomicInc(*_memory_counter, FRAME_TRIE_SIZE);
+            }
+        }
 
-CallTraceStorage::CallTraceStorage() : _allocator(CALL_TRACE_CHUNK) {
-    _current_table = LongHashTable::allocate(NULL, INITIAL_CAPACITY);
-    _overflow = 0;
+        u64 h = ((u64)(uintptr_t)parent + (u64)(uintptr_t)frame.method_id * 31 + (u32)frame.bci) * 0xc6a4a7935bd1e995ULL;
+        return &buckets[h >> (64 - FRAME_TRIE_BITS)];
+    }
+
+    void clear(bool keep_memory) {
+        while (_current_table->prev() != NULL) {
+            _current_table = destroyTable(_current_table);
+        }
+        _current_table->clear();
+        if (_frame_trie != NULL) {
+            OS::safeFree(_frame_trie, FRAME_TRIE_SIZE);
+            atomicInc(*_memory_counter, -(u64)FRAME_TRIE_SIZE);
+            _frame_trie = NULL;
+        }
+        if (keep_memory) {
+            _allocator.reset();
+        } else {
+            _allocator.clear();
+        }
+        _overflow = 0;
+        _truncated = 0;
+    }
+};
+
+
+static ASGCT_CallFrame expandFrame(MethodIndex* method_index, const CompactFrame& frame) {
+    ASGCT_CallFrame result;
+    result.bci = frame.bci;
+    result.method_id = method_index->method(frame.method);
+    return result;
+}
+
+
+CallTrace CallTraceStorage::_overflow_trace = {1, false, NULL, {{BCI_ERROR, (jmethodID)"[storage_overflow]"}}};
+
+ASGCT_CallFrame CallTraceStorage::_truncated_frame = {BCI_ERROR, (jmethodID)"truncated"};
+
+CallTraceStorage::CallTraceStorage() {
+    _used_memory = 0;
+    _active = _epochs[0] = new CallTraceEpoch(&_used_memory);
+    _detached = NULL;
+    _spare = _epochs[1] = NULL;
+    _method_index = NULL;
+    _trace_store = TRACE_STORE_FLAT;
+    _memory_limit = 0;
 }
 
 CallTraceStorage::~CallTraceStorage() {
-    while (_current_table != NULL) {
-        _current_table = _current_table->destroy();
-    }
+    delete _active;
+    delete _detached;
+    delete _spare;
+    delete _method_index;
 }
 
 void CallTraceStorage::clear() {
-    while (_current_table->prev() != NULL) {
-        _current_table = _current_table->destroy();
+    _active->clear(false);
+    if (_method_index != NULL) {
+        _method_index->clear();
+    }
+}
+
+// Must not be called while put() may run concurrently
+bool CallTraceStorage::setTraceStore(TraceStore mode) {
+    if (mode == TRACE_STORE_COMPACT && _method_index == NULL) {
+        MethodIndex* method_index = new MethodIndex(METHOD_INDEX_BITS);
+        if (!method_index->valid()) {
+            delete method_index;
+            return false;
+        }
+        _method_index = method_index;
+        atomicInc(_used_memory, method_index->usedMemory());
+    }
+    _trace_store = mode;
+    return true;
+}
+
+// Switches recording to the spare epoch. Until releaseEpoch() is called,
+// collectTraces() and collectSamples() return contents of the detached epoch.
+// The caller is responsible for waiting until concurrent put() calls complete.
+bool CallTraceStorage::detachEpoch() {
+    if (_spare == NULL) {
+        CallTraceEpoch* epoch = new CallTraceEpoch(&_used_memory);
+        if (epoch->_current_table == NULL) {
+            delete epoch;
+            return false;
+        }
+        _spare = _epochs[1] = epoch;
     }
-    _current_table->clear();
-    _allocator.clear();
-    _overflow = 0;
+
+    _detached = __sync_lock_test_and_set(&_active, _spare);
+    _spare = NULL;
+    return true;
+}
+
+// Discards contents of the detached epoch, but keeps its memory for the next switch
+void CallTraceStorage::releaseEpoch() {
+    if (_detached != NULL) {
+        _detached->clear(true);
+        _spare = _detached;
+        _detached = NULL;
+    }
+}
+
+// Sums up memory held by all epochs for reporting; safe to call concurrently with put().
+// The limit is checked against _used_memory, which is updated on every allocation instead
+u64 CallTraceStorage::usedMemory() {
+    u64 total = 0;
+    for (int i = 0; i < 2; i++) {
+        CallTraceEpoch* epoch = _epochs[i];
+        if (epoch != NULL) total += epoch->usedMemory();
+    }
+    if (_method_index != NULL) {
+        total += _method_index->usedMemory();
+    }
+    return total;
+}
+
+u64 CallTraceStorage::allocatorMemory() {
+    u64 total = 0;
+    for (int i = 0; i < 2; i++) {
+        if (_epochs[i] != NULL) total += _epochs[i]->allocatorMemory();
+    }
+    return total;
+}
+
+u64 CallTraceStorage::tableMemory() {
+    u64 total = 0;
+    for (int i = 0; i < 2; i++) {
+        if (_epochs[i] != NULL) total += _epochs[i]->tableMemory();
+    }
+    return total;
+}
+
+u64 CallTraceStorage::indexMemory() {
+    return _method_index != NULL ? _method_index->usedMemory() : 0;
+}
+
+// A smaller limit would be exceeded by an empty storage, turning every new trace into an overflow
+u64 CallTraceStorage::minMemoryLimit() {
+    return LongHashTable::getSize(INITIAL_CAPACITY) + CALL_TRACE_CHUNK;
+}
+
+u64 CallTraceStorage::truncatedSamples() {
+    return collected()->_truncated;
 }
 
 void CallTraceStorage::collectTraces(std::map<u32, CallTrace*>& map) {
-    for (LongHashTable* table = _current_table; table != NULL; table = table->prev()) {
+    CallTraceEpoch* epoch = collected();
+    for (LongHashTable* table = epoch->_current_table; table != NULL; table = table->prev()) {
         u64* keys = table->keys();
         CallTraceSample* values = table->values();
         u32 capacity = table->capacity();
@@ -123,13 +330,42 @@ void CallTraceStorage::collectTraces(std::map<u32, CallTrace*>& map) {
         }
     }
 
-    if (_overflow > 0) {
+    if (epoch->_overflow > 0) {
+        map[OVERFLOW_TRACE_ID] = &_overflow_trace;
+    }
+}
+
+// Incremental variant for streaming output: skips traces already marked in the known bitmap
+// and marks the collected ones. Trace IDs start from 1, so bit 0 stands for the overflow trace.
+void CallTraceStorage::collectNewTraces(std::map<u32, CallTrace*>& map, std::vector<bool>& known) {
+    CallTraceEpoch* epoch = collected();
+    for (LongHashTable* table = epoch->_current_table; table != NULL; table = table->prev()) {
+        u64* keys = table->keys();
+        CallTraceSample* values = table->values();
+        u32 capacity = table->capacity();
+        u32 base_id = capacity - (INITIAL_CAPACITY - 1);
+        if (known.size() < base_id + capacity) {
+            known.resize(base_id + capacity);
+        }
+
+        for (u32 slot = 0; slot < capacity; slot++) {
+            // The trace may still be in the middle of insertion
+            CallTrace* trace = values[slot].trace;
+            if (keys[slot] != 0 && trace != NULL && !known[base_id + slot]) {
+                known[base_id + slot] = true;
+                map[base_id + slot] = trace;
+            }
+        }
+    }
+
+    if (epoch->_overflow > 0 && !known[0]) {
+        known[0] = true;
         map[OVERFLOW_TRACE_ID] = &_overflow_trace;
     }
 }
 
 void CallTraceStorage::collectSamples(std::vector<CallTraceSample*>& samples) {
-    for (LongHashTable* table = _current_table; table != NULL; table = table->prev()) {
+    for (LongHashTable* table = collected()->_current_table; table != NULL; table = table->prev()) {
         u64* keys = table->keys();
         CallTraceSample* values = table->values();
         u32 capacity = table->capacity();
@@ -143,7 +379,7 @@ void CallTraceStorage::collectSamples(std::vector<CallTraceSample*>& samples) {
 }
 
 void CallTraceStorage::collectSamples(std::map<u64, CallTraceSample>& map) {
-    for (LongHashTable* table = _current_table; table != NULL; table = table->prev()) {
+    for (LongHashTable* table = collected()->_current_table; table != NULL; table = table->prev()) {
         u64* keys = table->keys();
         CallTraceSample* values = table->values();
         u32 capacity = table->capacity();
@@ -157,14 +393,13 @@ void CallTraceStorage::collectSamples(std::map<u64, CallTraceSample>& map) {
 }
 
 // Adaptation of MurmurHash64A by Austin Appleby
-u64 CallTraceStorage::calcHash(int num_frames, ASGCT_CallFrame* frames) {
+static u64 murmurHash(const void* key, int len) {
     const u64 M = 0xc6a4a7935bd1e995ULL;
     const int R = 47;
 
-    int len = num_frames * sizeof(ASGCT_CallFrame);
     u64 h = len * M;
 
-    const u64* data = (const u64*)frames;
+    const u64* data = (const u64*)key;
     const u64* end = data + len / 8;
 
     while (data != end) {
@@ -188,11 +423,209 @@ u64 CallTraceStorage::calcHash(int num_frames, ASGCT_CallFrame* frames) {
     return h;
 }
 
-CallTrace* CallTraceStorage::storeCallTrace(int num_frames, ASGCT_CallFrame* frames) {
+#if defined(__x86_64__) || defined(__aarch64__)
+
+#if defined(__x86_64__)
+
+static inline u64 crc32c(u64 crc, u64 value) {
+    asm("crc32q %1, %0" : "+r"(crc) : "rm"(value));
+    return crc;
+}
+
+static bool hasCrc32c() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+static inline u64 crc32c(u64 crc, u64 value) {
+    u32 result = (u32)crc;
+    asm(".arch_extension crc\n\tcrc32cx %w0, %w0, %x1" : "+r"(result) : "r"(value));
+    return result;
+}
+
+#ifdef __APPLE__
+
+// CRC32 instructions are mandatory on all Apple ARM64 processors
+static bool hasCrc32c() {
+    return true;
+}
+
+#else
+
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+
+static bool hasCrc32c() {
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#endif // __APPLE__
+
+#endif // __x86_64__
+
+// Two CRC32C lanes give a 64-bit hash: the second lane sees each word through
+// a multiplication, which is not linear over GF(2), so the lanes do not collide together.
+// Pairs of words (i.e. one ASGCT_CallFrame) are folded before hashing
+// to halve the length of the dependency chain.
+static u64 crc32cHash(const void* key, int len) {
+    const u64 M = 0xc6a4a7935bd1e995ULL;
+    const int R = 47;
+
+    u64 h1 = len;
+    u64 h2 = ~h1;
+
+    const u64* data = (const u64*)key;
+    const u64* end = data + (len / 16) * 2;
+
+    while (data != end) {
+        u64 k = data[0] * M ^ data[1];
+        data += 2;
+        h1 = crc32c(h1, k);
+        h2 = crc32c(h2, k * M);
+    }
+
+    if (len & 8) {
+        u64 k = *data;
+        h1 = crc32c(h1, k);
+        h2 = crc32c(h2, k * M);
+    }
+
+    u64 h = (h2 << 32 | (u32)h1) * M;
+    h ^= h >> R;
+    h *= M;
+    h ^= h >> R;
+
+    return h;
+}
+
+#else
+
+static bool hasCrc32c() {
+    return false;
+}
+
+static u64 crc32cHash(const void* key, int len) {
+    return murmurHash(key, len);
+}
+
+#endif
+
+static u64 (*hash_func)(const void* key, int len) = hasCrc32c() ? crc32cHash : murmurHash;
+
+bool CallTraceStorage::setHardwareHash(bool enabled) {
+    if (enabled && !hasCrc32c()) {
+        return false;
+    }
+    hash_func = enabled ? crc32cHash : murmurHash;
+    return true;
+}
+
+bool CallTraceStorage::hardwareHash() {
+    return hash_func == crc32cHash;
+}
+
+u64 CallTraceStorage::calcHash(int num_frames, ASGCT_CallFrame* frames) {
+    return hash_func(frames, num_frames * sizeof(ASGCT_CallFrame));
+}
+
+// Returns false if the method index is full
+bool CallTraceStorage::compactFrames(int num_frames, ASGCT_CallFrame* frames, CompactFrame* compact) {
+    for (int i = 0; i < num_frames; i++) {
+        u32 method = _method_index->lookup(frames[i].method_id);
+        if (method == MethodIndex::NO_INDEX) {
+            return false;
+        }
+        compact[i].bci = frames[i].bci;
+        compact[i].method = method;
+    }
+    return true;
+}
+
+// Finds or inserts a trie node for the given frame called from the parent node.
+// Lock-free: a new node is published with CAS on the bucket head.
+FrameNode* CallTraceStorage::internFrame(CallTraceEpoch* epoch, FrameNode* parent, const ASGCT_CallFrame& frame) {
+    FrameNode* volatile* bucket = epoch->frameTrieBucket(parent, frame);
+    if (bucket == NULL) {
+        return NULL;
+    }
+
+    FrameNode* head = *bucket;
+    for (FrameNode* node = head; node != NULL; node = node->next) {
+        if (node->parent == parent && node->frame.method_id == frame.method_id && node->frame.bci == frame.bci) {
+            return node;
+        }
+    }
+
+    FrameNode* new_node = (FrameNode*)epoch->_allocator.alloc(sizeof(FrameNode));
+    if (new_node == NULL) {
+        return NULL;
+    }
+    new_node->parent = parent;
+    new_node->frame = frame;
+
+    while (true) {
+        new_node->next = head;
+        FrameNode* witness = __sync_val_compare_and_swap(bucket, head, new_node);
+        if (witness == head) {
+            return new_node;
+        }
+
+        // Check if someone else has just inserted the same node. If so, new_node is wasted
+        for (FrameNode* node = witness; node != head; node = node->next) {
+            if (node->parent == parent && node->frame.method_id == frame.method_id && node->frame.bci == frame.bci) {
+                return node;
+            }
+        }
+        head = witness;
+    }
+}
+
+CallTrace* CallTraceStorage::storeCallTrace(CallTraceEpoch* epoch, int num_frames, ASGCT_CallFrame* frames) {
     const size_t header_size = sizeof(CallTrace) - sizeof(ASGCT_CallFrame);
-    CallTrace* buf = (CallTrace*)_allocator.alloc(header_size + num_frames * sizeof(ASGCT_CallFrame));
+
+    if (_trace_store == TRACE_STORE_TRIE) {
+        // Intern frames starting from the bottom of the stack; the trace then refers to the top node
+        FrameNode* leaf = NULL;
+        for (int i = num_frames - 1; i >= 0; i--) {
+            if ((leaf = internFrame(epoch, leaf, frames[i])) == NULL) break;
+        }
+
+        if (leaf != NULL || num_frames == 0) {
+            CallTrace* buf = (CallTrace*)epoch->_allocator.alloc(header_size);
+            if (buf != NULL) {
+                buf->num_frames = num_frames;
+                buf->compact = false;
+                buf->leaf = leaf;
+            }
+            return buf;
+        }
+        // Fall back to the flat representation if the trie could not be allocated
+    }
+
+    if (_trace_store == TRACE_STORE_COMPACT) {
+        CallTrace* buf = (CallTrace*)epoch->_allocator.alloc(header_size + num_frames * sizeof(CompactFrame));
+        if (buf == NULL) {
+            return NULL;
+        }
+        if (compactFrames(num_frames, frames, (CompactFrame*)buf->frames)) {
+            buf->num_frames = num_frames;
+            buf->compact = true;
+            buf->leaf = NULL;
+            return buf;
+        }
+        // Fall back to the flat representation if the method index is full; buf is wasted
+    }
+
+    CallTrace* buf = (CallTrace*)epoch->_allocator.alloc(header_size + num_frames * sizeof(ASGCT_CallFrame));
     if (buf != NULL) {
         buf->num_frames = num_frames;
+        buf->compact = false;
+        buf->leaf = NULL;
         // Do not use memcpy inside signal handler
         for (int i = 0; i < num_frames; i++) {
             buf->frames[i] = frames[i];
@@ -220,10 +653,52 @@ CallTrace* CallTraceStorage::findCallTrace(LongHashTable* table, u64 hash) {
     return table->values()[slot].trace;
 }
 
-u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame* frames, u64 counter) {
+// Keeps top frames of a trace, and replaces the rest with a special frame.
+// The frame that denotes a thread is preserved.
+int CallTraceStorage::truncateTrace(int num_frames, ASGCT_CallFrame* frames) {
+    if (num_frames <= TRUNCATED_DEPTH + 1) {
+        return num_frames;
+    }
+
+    ASGCT_CallFrame thread_frame = frames[num_frames - 1];
+    num_frames = TRUNCATED_DEPTH;
+    frames[num_frames++] = _truncated_frame;
+    if (thread_frame.bci == BCI_THREAD_ID) {
+        frames[num_frames++] = thread_frame;
+    }
+    return num_frames;
+}
+
+bool CallTraceStorage::isKnownTrace(CallTraceEpoch* epoch, u64 hash) {
+    for (LongHashTable* table = epoch->_current_table; table != NULL; table = table->prev()) {
+        if (findCallTrace(table, hash) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame* frames, u64 counter, CallTraceDeltas* deltas,
+                          const u64* group) {
     u64 hash = calcHash(num_frames, frames);
+    CallTraceEpoch* epoch = _active;
+
+    if (_memory_limit > 0) {
+        // Past 7/8 of the limit, new traces are folded into their truncated versions,
+        // while the known ones are still counted precisely. Beyond the limit, new traces are dropped.
+        u64 used = _used_memory;
+        if (used >= _memory_limit - _memory_limit / 8 && !isKnownTrace(epoch, hash)) {
+            if (used >= _memory_limit) {
+                atomicInc(epoch->_overflow);
+                return OVERFLOW_TRACE_ID;
+            }
+            atomicInc(epoch->_truncated);
+            num_frames = truncateTrace(num_frames, frames);
+            hash = calcHash(num_frames, frames);
+        }
+    }
 
-    LongHashTable* table = _current_table;
+    LongHashTable* table = epoch->_current_table;
     u64* keys = table->keys();
     u32 capacity = table->capacity();
     u32 slot = hash & (capacity - 1);
@@ -236,17 +711,17 @@ u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame* frames, u64 counter)
             }
 
             // Increment the table size, and if the load factor exceeds 0.75, reserve a new table
-            if (table->incSize() == capacity * 3 / 4) {
-                LongHashTable* new_table = LongHashTable::allocate(table, capacity * 2);
-                if (new_table != NULL) {
-                    __sync_bool_compare_and_swap(&_current_table, table, new_table);
+            if (table->incSize() == capacity * 3 / 4 && !exceedsLimit(LongHashTable::getSize(capacity * 2))) {
+                LongHashTable* new_table = epoch->allocateTable(table, capacity * 2);
+                if (new_table != NULL && !__sync_bool_compare_and_swap(&epoch->_current_table, table, new_table)) {
+                    epoch->destroyTable(new_table);
                 }
             }
 
             // Migrate from a previous table to save space
             CallTrace* trace = table->prev() == NULL ? NULL : findCallTrace(table->prev(), hash);
             if (trace == NULL) {
-                trace = storeCallTrace(num_frames, frames);
+                trace = storeCallTrace(epoch, num_frames, frames);
             }
             table->values()[slot].trace = trace;
             break;
@@ -254,7 +729,7 @@ u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame* frames, u64 counter)
 
         if (++step >= capacity) {
             // Very unlikely case of a table overflow
-            atomicInc(_overflow);
+            atomicInc(epoch->_overflow);
             return OVERFLOW_TRACE_ID;
         }
         // Improved version of linear probing
@@ -262,8 +737,76 @@ u32 CallTraceStorage::put(int num_frames, ASGCT_CallFrame* frames, u64 counter)
     }
 
     CallTraceSample& s = table->values()[slot];
-    atomicInc(s.samples);
-    atomicInc(s.counter, counter);
+    u32 trace_id = capacity - (INITIAL_CAPACITY - 1) + slot;
+
+    if (deltas == NULL) {
+        atomicInc(s.samples);
+        atomicInc(s.counter, counter);
+    } else {
+        CallTraceDeltas::Entry& e = deltas->_entries[trace_id % CALL_TRACE_DELTAS];
+        if (e.sample != &s) {
+            if (e.samples > 0) {
+                atomicInc(e.sample->samples, e.samples);
+                atomicInc(e.sample->counter, e.counter);
+            }
+            e.sample = &s;
+            e.samples = 0;
+            e.counter = 0;
+        }
+        e.samples++;
+        e.counter += counter;
+    }
+
+    if (group != NULL) {
+        // Only perf events in group mode provide these, so they are not worth batching in deltas
+        for (int i = 0; i < MAX_GROUP_EVENTS; i++) {
+            if (group[i] != 0) atomicInc(s.group[i], group[i]);
+        }
+    }
+
+    return trace_id;
+}
+
+// The caller must own the slot of the given deltas, i.e. no put() may use them concurrently
+void CallTraceStorage::flushDeltas(CallTraceDeltas* deltas) {
+    for (int i = 0; i < CALL_TRACE_DELTAS; i++) {
+        CallTraceDeltas::Entry& e = deltas->_entries[i];
+        if (e.samples > 0) {
+            atomicInc(e.sample->samples, e.samples);
+            atomicInc(e.sample->counter, e.counter);
+        }
+        e.sample = NULL;
+        e.samples = 0;
+        e.counter = 0;
+    }
+}
+
+// Interned and compact traces are expanded into the given buffer, top frame first
+ASGCT_CallFrame* CallTraceStorage::getFrames(CallTrace* trace, std::vector<ASGCT_CallFrame>& buf) {
+    if (trace->compact) {
+        CompactFrame* frames = (CompactFrame*)trace->frames;
+        buf.resize(trace->num_frames);
+        for (int i = 0; i < trace->num_frames; i++) {
+            buf[i] = expandFrame(_method_index, frames[i]);
+        }
+        return &buf[0];
+    } else if (trace->leaf == NULL) {
+        return trace->frames;
+    }
+
+    buf.clear();
+    for (FrameNode* node = trace->leaf; node != NULL; node = node->parent) {
+        buf.push_back(node->frame);
+    }
+    return &buf[0];
+}
 
-    return capacity - (INITIAL_CAPACITY - 1) + slot;
+ASGCT_CallFrame CallTraceStorage::getTopFrame(CallTrace* trace) {
+    if (trace->compact) {
+        CompactFrame* frames = (CompactFrame*)trace->frames;
+        return expandFrame(_method_index, frames[0]);
+    } else if (trace->leaf != NULL) {
+        return trace->leaf->frame;
+    }
+    return trace->frames[0];
 }
@@ -18,16 +18,36 @@
 #define _CALLTRACESTORAGE_H
 
 #include <map>
+#include <string.h>
 #include <vector>
 #include "arch.h"
+#include "arguments.h"
 #include "linearAllocator.h"
 #include "vmEntry.h"
 
 
 class LongHashTable;
+class CallTraceEpoch;
+class MethodIndex;
+
+// Node of the frame trie. Traces that share the bottom part of the stack
+// share the corresponding chain of nodes.
+struct FrameNode {
+    FrameNode* parent;
+    FrameNode* next;  // next node in the same hash bucket
+    ASGCT_CallFrame frame;
+};
+
+// ASGCT_CallFrame with method_id replaced by its index in MethodIndex
+struct CompactFrame {
+    jint bci;
+    u32 method;
+};
 
 struct CallTrace {
     int num_frames;
+    bool compact;     // frames[] is actually an array of CompactFrame
+    FrameNode* leaf;  // top frame of an interned trace; frames[] are not stored then
     ASGCT_CallFrame frames[1];
 };
 
@@ -35,11 +55,15 @@ struct CallTraceSample {
     CallTrace* trace;
     u64 samples;
     u64 counter;
+    u64 group[MAX_GROUP_EVENTS];  // values of perf events counted along with the sampled one
 
     CallTraceSample& operator+=(const CallTraceSample& s) {
         trace = s.trace;
         samples += s.samples;
         counter += s.counter;
+        for (int i = 0; i < MAX_GROUP_EVENTS; i++) {
+            group[i] += s.group[i];
+        }
         return *this;
     }
 
@@ -48,28 +72,93 @@ struct CallTraceSample {
     }
 };
 
+const int CALL_TRACE_DELTAS = 32;
+
+// Pending updates of recently hit CallTraceSamples owned by one recording slot.
+// The owner holds the slot lock, so a hot trace is counted without atomic operations
+// on a shared cache line. Deltas are applied when an entry is evicted or by flushDeltas().
+class CallTraceDeltas {
+  private:
+    struct Entry {
+        CallTraceSample* sample;
+        u64 samples;
+        u64 counter;
+    };
+
+    Entry _entries[CALL_TRACE_DELTAS];
+
+    friend class CallTraceStorage;
+
+  public:
+    void clear() {
+        memset(_entries, 0, sizeof(_entries));
+    }
+};
+
 class CallTraceStorage {
   private:
     static CallTrace _overflow_trace;
+    static ASGCT_CallFrame _truncated_frame;
 
-    LinearAllocator _allocator;
-    LongHashTable* _current_table;
-    u64 _overflow;
+    // New samples go to the active epoch. A dump may detach the active epoch
+    // and replace it with the spare one, so that sampling continues while
+    // the detached epoch is being drained.
+    CallTraceEpoch* volatile _active;
+    CallTraceEpoch* _detached;
+    CallTraceEpoch* _spare;
+    CallTraceEpoch* _epochs[2];
+    MethodIndex* _method_index;
+    TraceStore _trace_store;
+    u64 _memory_limit;
+    volatile u64 _used_memory;
+
+    CallTraceEpoch* collected() {
+        return _detached != NULL ? _detached : _active;
+    }
 
     u64 calcHash(int num_frames, ASGCT_CallFrame* frames);
-    CallTrace* storeCallTrace(int num_frames, ASGCT_CallFrame* frames);
+    bool compactFrames(int num_frames, ASGCT_CallFrame* frames, CompactFrame* compact);
+    FrameNode* internFrame(CallTraceEpoch* epoch, FrameNode* parent, const ASGCT_CallFrame& frame);
+    CallTrace* storeCallTrace(CallTraceEpoch* epoch, int num_frames, ASGCT_CallFrame* frames);
     CallTrace* findCallTrace(LongHashTable* table, u64 hash);
+    bool isKnownTrace(CallTraceEpoch* epoch, u64 hash);
+    int truncateTrace(int num_frames, ASGCT_CallFrame* frames);
+
+    bool exceedsLimit(u64 extra) {
+        return _memory_limit > 0 && _used_memory + extra > _memory_limit;
+    }
 
   public:
     CallTraceStorage();
     ~CallTraceStorage();
 
     void clear();
+    bool setTraceStore(TraceStore mode);
+    void setMemoryLimit(u64 limit) { _memory_limit = limit; }
+    u64 memoryLimit() { return _memory_limit; }
+    static u64 minMemoryLimit();
+    u64 usedMemory();
+    u64 allocatorMemory();
+    u64 tableMemory();
+    u64 indexMemory();
+    u64 truncatedSamples();
+    bool detachEpoch();
+    void releaseEpoch();
     void collectTraces(std::map<u32, CallTrace*>& map);
+    void collectNewTraces(std::map<u32, CallTrace*>& map, std::vector<bool>& known);
     void collectSamples(std::vector<CallTraceSample*>& samples);
     void collectSamples(std::map<u64, CallTraceSample>& map);
 
-    u32 put(int num_frames, ASGCT_CallFrame* frames, u64 counter);
+    u32 put(int num_frames, ASGCT_CallFrame* frames, u64 counter, CallTraceDeltas* deltas = NULL,
+            const u64* group = NULL);
+    void flushDeltas(CallTraceDeltas* deltas);
+
+    // Hardware CRC32C hashing is selected by default when the CPU supports it
+    static bool setHardwareHash(bool enabled);
+    static bool hardwareHash();
+
+    ASGCT_CallFrame* getFrames(CallTrace* trace, std::vector<ASGCT_CallFrame>& buf);
+    ASGCT_CallFrame getTopFrame(CallTrace* trace);
 };
 
 #endif // _CALLTRACESTORAGE
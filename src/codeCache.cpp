@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "codeCache.h"
@@ -75,6 +76,10 @@ jmethodID CodeCache::find(const void* address) {
 
 NativeCodeCache::NativeCodeCache(const char* name, const void* min_address, const void* max_address) {
     _name = strdup(name);
+    _names_size = 0;
+    _dwarf_base = NULL;
+    _dwarf_table = NULL;
+    _dwarf_table_length = 0;
     _min_address = min_address;
     _max_address = max_address;
 }
@@ -84,6 +89,7 @@ NativeCodeCache::~NativeCodeCache() {
         free(_blobs[i]._method);
     }
     free(_name);
+    free(_dwarf_table);
 }
 
 void NativeCodeCache::add(const void* start, int length, const char* name, bool update_bounds) {
@@ -92,6 +98,7 @@ void NativeCodeCache::add(const void* start, int length, const char* name, bool
     for (char* s = name_copy; *s != 0; s++) {
         if (*s < ' ') *s = '?';
     }
+    _names_size += strlen(name_copy) + 1;
     CodeCache::add(start, length, (jmethodID)name_copy, update_bounds);
 }
 
@@ -150,3 +157,28 @@ const void* NativeCodeCache::findSymbolByPrefix(const char* prefix, int prefix_l
     }
     return NULL;
 }
+
+void NativeCodeCache::setDwarfTable(const char* base, FrameDesc* table, int length) {
+    free(_dwarf_table);
+    _dwarf_base = base;
+    _dwarf_table = table;
+    _dwarf_table_length = length;
+}
+
+// Returns the last unwind rule that starts at or before pc
+FrameDesc* NativeCodeCache::findFrameDesc(const void* pc) {
+    u32 target = (u32)((uintptr_t)pc - (uintptr_t)_dwarf_base);
+    int low = 0;
+    int high = _dwarf_table_length - 1;
+
+    while (low <= high) {
+        int mid = (unsigned int)(low + high) >> 1;
+        if (_dwarf_table[mid].loc <= target) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return high >= 0 ? &_dwarf_table[high] : NULL;
+}
@@ -18,6 +18,7 @@
 #define _CODECACHE_H
 
 #include <jvmti.h>
+#include "dwarf.h"
 
 
 #define NO_MIN_ADDRESS  ((const void*)-1)
@@ -78,12 +79,21 @@ class CodeCache {
     void add(const void* start, int length, jmethodID method, bool update_bounds = false);
     void remove(const void* start, jmethodID method);
     jmethodID find(const void* address);
+
+    long long usedMemory() {
+        return (long long)_capacity * sizeof(CodeBlob);
+    }
 };
 
 
 class NativeCodeCache : public CodeCache {
   private:
     char* _name;
+    long long _names_size;
+
+    const char* _dwarf_base;
+    FrameDesc* _dwarf_table;
+    int _dwarf_table_length;
 
   public:
     NativeCodeCache(const char* name,
@@ -102,6 +112,13 @@ class NativeCodeCache : public CodeCache {
     const void* findSymbol(const char* name);
     const void* findSymbolByPrefix(const char* prefix);
     const void* findSymbolByPrefix(const char* prefix, int prefix_len);
+
+    void setDwarfTable(const char* base, FrameDesc* table, int length);
+    FrameDesc* findFrameDesc(const void* pc);
+
+    long long usedMemory() {
+        return CodeCache::usedMemory() + _names_size + _dwarf_table_length * sizeof(FrameDesc);
+    }
 };
 
 #endif // _CODECACHE_H
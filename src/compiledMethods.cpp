@@ -0,0 +1,140 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+#include <jvmticmlr.h>
+#include "compiledMethods.h"
+
+
+const u32 INITIAL_CAPACITY = 4096;
+
+
+CompiledMethods::~CompiledMethods() {
+    for (u32 i = 0; i < _capacity; i++) {
+        free(_table[i].inlined);
+    }
+    free(_table);
+}
+
+CompiledMethod* CompiledMethods::lookup(jmethodID method, bool insert) {
+    u32 mask = _capacity - 1;
+    for (u32 i = hash(method) & mask; ; i = (i + 1) & mask) {
+        CompiledMethod* cm = &_table[i];
+        if (cm->method == method) {
+            return cm;
+        } else if (cm->method == NULL) {
+            if (!insert) {
+                return NULL;
+            }
+            // Keep the load factor under 3/4
+            if ((_size + 1) * 4 > _capacity * 3) {
+                grow();
+                return lookup(method, true);
+            }
+            cm->method = method;
+            _size++;
+            return cm;
+        }
+    }
+}
+
+void CompiledMethods::grow() {
+    CompiledMethod* old_table = _table;
+    u32 old_capacity = _capacity;
+
+    _capacity = old_capacity == 0 ? INITIAL_CAPACITY : old_capacity * 2;
+    _table = (CompiledMethod*)calloc(_capacity, sizeof(CompiledMethod));
+
+    u32 mask = _capacity - 1;
+    for (u32 j = 0; j < old_capacity; j++) {
+        if (old_table[j].method != NULL) {
+            u32 i = hash(old_table[j].method) & mask;
+            while (_table[i].method != NULL) {
+                i = (i + 1) & mask;
+            }
+            _table[i] = old_table[j];
+        }
+    }
+
+    free(old_table);
+}
+
+jmethodID* CompiledMethods::collectInlined(const void* compile_info, jmethodID method, int* count) {
+    std::vector<jmethodID> methods;
+
+    const jvmtiCompiledMethodLoadRecordHeader* record = (const jvmtiCompiledMethodLoadRecordHeader*)compile_info;
+    for (; record != NULL; record = record->next) {
+        if (record->kind != JVMTI_CMLR_INLINE_INFO) {
+            continue;
+        }
+
+        const jvmtiCompiledMethodLoadInlineRecord* inline_record = (const jvmtiCompiledMethodLoadInlineRecord*)record;
+        for (jint i = 0; i < inline_record->numpcs; i++) {
+            const PCStackInfo* info = &inline_record->pcinfo[i];
+            // The last frame of a virtual stack is the compiled method itself
+            for (jint j = 0; j < info->numstackframes - 1; j++) {
+                if (info->methods[j] != method) {
+                    methods.push_back(info->methods[j]);
+                }
+            }
+        }
+    }
+
+    std::sort(methods.begin(), methods.end());
+    methods.erase(std::unique(methods.begin(), methods.end()), methods.end());
+
+    *count = methods.size();
+    if (methods.empty()) {
+        return NULL;
+    }
+
+    jmethodID* result = (jmethodID*)malloc(methods.size() * sizeof(jmethodID));
+    std::copy(methods.begin(), methods.end(), result);
+    return result;
+}
+
+void CompiledMethods::add(jmethodID method, const void* code, FrameTier tier, jmethodID* inlined, int inlined_count) {
+    if (_table == NULL) {
+        grow();
+    }
+
+    CompiledMethod* cm = lookup(method, true);
+    free(cm->inlined);
+    _inlined_size += inlined_count - cm->inlined_count;
+    cm->code = code;
+    cm->tier = tier;
+    cm->inlined = inlined;
+    cm->inlined_count = inlined_count;
+}
+
+void CompiledMethods::remove(jmethodID method, const void* code) {
+    CompiledMethod* cm = _table != NULL ? lookup(method, false) : NULL;
+    // Another version of the method may have been installed since; keep it then
+    if (cm != NULL && cm->code == code) {
+        free(cm->inlined);
+        _inlined_size -= cm->inlined_count;
+        cm->tier = TIER_INTERPRETED;
+        cm->inlined = NULL;
+        cm->inlined_count = 0;
+    }
+}
+
+bool CompiledMethods::inlines(const CompiledMethod* cm, jmethodID callee) {
+    return cm->inlined_count > 0 && std::binary_search(cm->inlined, cm->inlined + cm->inlined_count, callee);
+}
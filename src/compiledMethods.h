@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _COMPILEDMETHODS_H
+#define _COMPILEDMETHODS_H
+
+#include <stdint.h>
+#include <jvmti.h>
+#include "arch.h"
+
+
+// Compilation tier of a Java frame. It is stored in the upper bits of bci
+// of the frame, so that frames of the same method in different tiers are distinct.
+enum FrameTier {
+    TIER_UNKNOWN     = 0,
+    TIER_INTERPRETED = 1,
+    TIER_C1          = 2,
+    TIER_C2          = 3,
+    TIER_INLINED     = 4
+};
+
+const int FRAME_TIER_SHIFT = 24;
+const jint FRAME_BCI_MASK = (1 << FRAME_TIER_SHIFT) - 1;
+
+// Only frames with a valid bci carry the tier; special negative bci values are left intact
+static inline jint encodeFrameTier(FrameTier tier, jint bci) {
+    return bci >= 0 ? (jint)tier << FRAME_TIER_SHIFT | bci : bci;
+}
+
+static inline FrameTier frameTier(jint bci) {
+    return bci >= 0 ? (FrameTier)(bci >> FRAME_TIER_SHIFT) : TIER_UNKNOWN;
+}
+
+static inline jint frameBci(jint bci) {
+    return bci >= 0 ? bci & FRAME_BCI_MASK : bci;
+}
+
+
+struct CompiledMethod {
+    jmethodID method;
+    // The last installed compiled code of the method
+    const void* code;
+    // TIER_C1 or TIER_C2 while the code is installed, TIER_INTERPRETED after it is unloaded
+    FrameTier tier;
+    int inlined_count;
+    // Sorted list of methods inlined into the code
+    jmethodID* inlined;
+};
+
+// Open-addressing hash table from jmethodID to the state of its compiled code,
+// fed by CompiledMethodLoad / CompiledMethodUnload events.
+// Not thread-safe: guarded by the same lock as the JIT code cache.
+class CompiledMethods {
+  private:
+    CompiledMethod* _table;
+    u32 _capacity;
+    u32 _size;
+    long long _inlined_size;
+
+    static u32 hash(jmethodID method) {
+        u64 h = (u64)(uintptr_t)method * 0x9e3779b97f4a7c15ULL;
+        return (u32)(h >> 32);
+    }
+
+    CompiledMethod* lookup(jmethodID method, bool insert);
+    void grow();
+
+  public:
+    CompiledMethods() : _table(NULL), _capacity(0), _size(0), _inlined_size(0) {
+    }
+
+    ~CompiledMethods();
+
+    // Collects methods inlined into a compiled method from JVM TI compile_info records.
+    // Returns a malloc'ed sorted array. Does not touch the table, so it may run outside the lock
+    static jmethodID* collectInlined(const void* compile_info, jmethodID method, int* count);
+
+    // Takes ownership of the inlined array
+    void add(jmethodID method, const void* code, FrameTier tier, jmethodID* inlined, int inlined_count);
+    void remove(jmethodID method, const void* code);
+
+    // Returns NULL if the method has never been compiled
+    const CompiledMethod* find(jmethodID method) {
+        return _table != NULL ? lookup(method, false) : NULL;
+    }
+
+    static bool inlines(const CompiledMethod* cm, jmethodID callee);
+
+    long long usedMemory() {
+        return (long long)_capacity * sizeof(CompiledMethod) + _inlined_size * sizeof(jmethodID);
+    }
+};
+
+#endif // _COMPILEDMETHODS_H
@@ -174,6 +174,10 @@ public class FlameGraph {
             return 1;
         } else if (title.endsWith("_[k]")) {
             return 2;
+        } else if (title.endsWith("_[0]")) {
+            return 5;
+        } else if (title.endsWith("_[1]")) {
+            return 6;
         } else if (title.contains("::") || title.startsWith("-[") || title.startsWith("+[")) {
             return 3;
         } else if (title.indexOf('/') > 0 || title.indexOf('.') > 0 && Character.isUpperCase(title.charAt(0))) {
@@ -269,6 +273,8 @@ public class FlameGraph {
             "\t\t[0xe17d00, 30, 30,  0],\n" +
             "\t\t[0xc8c83c, 30, 30, 10],\n" +
             "\t\t[0xe15a5a, 30, 40, 40],\n" +
+            "\t\t[0xb2e1b2, 20, 20, 20],\n" +
+            "\t\t[0xcce880, 20, 20, 20],\n" +
             "\t];\n" +
             "\n" +
             "\tfunction getColor(p) {\n" +
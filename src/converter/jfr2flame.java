@@ -27,13 +27,19 @@ import java.nio.charset.StandardCharsets;
  */
 public class jfr2flame {
 
+    private static final int FRAME_INTERPRETED = 0;
+    private static final int FRAME_INLINED = 2;
     private static final int FRAME_KERNEL = 5;
+    private static final int FRAME_C1_COMPILED = 6;
 
     private final JfrReader jfr;
     private final Dictionary<String> methodNames = new Dictionary<>();
+    // Older recordings mark all Java frames as interpreted
+    private final boolean hasTiers;
 
     public jfr2flame(JfrReader jfr) {
         this.jfr = jfr;
+        this.hasTiers = jfr.frameTypes.containsKey(FRAME_C1_COMPILED);
     }
 
     public void convert(final FlameGraph fg) {
@@ -55,7 +61,9 @@ public class jfr2flame {
     }
 
     private String getMethodName(long methodId, int type) {
-        String result = methodNames.get(methodId);
+        // The same method has a different name suffix in each frame type
+        long key = methodId << 3 | type;
+        String result = methodNames.get(key);
         if (result != null) {
             return result;
         }
@@ -71,13 +79,27 @@ public class jfr2flame {
         } else {
             String classStr = new String(className, StandardCharsets.UTF_8);
             String methodStr = new String(methodName, StandardCharsets.UTF_8);
-            result = classStr + '.' + methodStr + "_[j]";
+            result = classStr + '.' + methodStr + javaSuffix(type);
         }
 
-        methodNames.put(methodId, result);
+        methodNames.put(key, result);
         return result;
     }
 
+    private String javaSuffix(int type) {
+        if (hasTiers) {
+            switch (type) {
+                case FRAME_INTERPRETED:
+                    return "_[0]";
+                case FRAME_C1_COMPILED:
+                    return "_[1]";
+                case FRAME_INLINED:
+                    return "_[i]";
+            }
+        }
+        return "_[j]";
+    }
+
     public static void main(String[] args) throws Exception {
         FlameGraph fg = new FlameGraph(args);
         if (fg.input == null) {
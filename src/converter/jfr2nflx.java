@@ -35,7 +35,7 @@ import java.util.Arrays;
  */
 public class jfr2nflx {
 
-    private static final String[] FRAME_TYPE = {"jit", "jit", "inlined", "user", "user", "kernel"};
+    private static final String[] FRAME_TYPE = {"jit", "jit", "inlined", "user", "user", "kernel", "jit"};
     private static final byte[] NO_STACK = "[no_stack]".getBytes();
 
     private final JfrReader jfr;
@@ -104,7 +104,9 @@ public class jfr2nflx {
     private Proto packSamples() {
         Proto proto = new Proto(10000);
         for (Sample sample : jfr.samples) {
-            proto.writeInt(sample.stackTraceId);
+            for (int i = 0; i < sample.samples; i++) {
+                proto.writeInt(sample.stackTraceId);
+            }
         }
         return proto;
     }
@@ -114,7 +116,11 @@ public class jfr2nflx {
         double ticksPerSec = jfr.ticksPerSec;
         long prevTime = jfr.startTicks;
         for (Sample sample : jfr.samples) {
+            // Aggregated samples are all placed at the start of their time slice
             proto.writeDouble((sample.time - prevTime) / ticksPerSec);
+            for (int i = 1; i < sample.samples; i++) {
+                proto.writeDouble(0);
+            }
             prevTime = sample.time;
         }
         return proto;
@@ -123,7 +129,9 @@ public class jfr2nflx {
     private Proto packTids() {
         Proto proto = new Proto(10000);
         for (Sample sample : jfr.samples) {
-            proto.writeInt(sample.tid);
+            for (int i = 0; i < sample.samples; i++) {
+                proto.writeInt(sample.tid);
+            }
         }
         return proto;
     }
@@ -36,17 +36,21 @@ public class Dictionary<T> {
             throw new IllegalArgumentException("Zero key not allowed");
         }
 
-        if (++size * 2 > keys.length) {
-            resize(keys.length * 2);
-        }
-
         int mask = keys.length - 1;
         int i = hashCode(key) & mask;
-        while (keys[i] != 0 && keys[i] != key) {
+        while (keys[i] != 0) {
+            if (keys[i] == key) {
+                values[i] = value;
+                return;
+            }
             i = (i + 1) & mask;
         }
         keys[i] = key;
         values[i] = value;
+
+        if (++size * 2 > keys.length) {
+            resize(keys.length * 2);
+        }
     }
 
     @SuppressWarnings("unchecked")
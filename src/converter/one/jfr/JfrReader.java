@@ -16,8 +16,11 @@
 
 package one.jfr;
 
+import java.io.ByteArrayOutputStream;
 import java.io.Closeable;
+import java.io.FileInputStream;
 import java.io.IOException;
+import java.io.InputStream;
 import java.nio.ByteBuffer;
 import java.nio.channels.FileChannel;
 import java.nio.charset.StandardCharsets;
@@ -28,9 +31,12 @@ import java.util.Collections;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.zip.GZIPInputStream;
 
 /**
  * Parses JFR output produced by async-profiler.
+ * A recording may consist of several chunks, where each chunk's constant pool
+ * holds only the entries not defined in previous chunks.
  */
 public class JfrReader implements Closeable {
     private static final int CHUNK_HEADER_SIZE = 68;
@@ -55,30 +61,53 @@ public class JfrReader implements Closeable {
     public final Map<Integer, String> frameTypes = new HashMap<>();
     public final Map<Integer, String> threadStates = new HashMap<>();
     public final List<Sample> samples = new ArrayList<>();
+    public final List<Pause> pauses = new ArrayList<>();
 
     public JfrReader(String fileName) throws IOException {
         this.ch = FileChannel.open(Paths.get(fileName), StandardOpenOption.READ);
-        this.buf = ch.map(FileChannel.MapMode.READ_ONLY, 0, ch.size());
+        this.buf = isGzip() ? decompress(fileName) : ch.map(FileChannel.MapMode.READ_ONLY, 0, ch.size());
 
-        if (buf.getInt(0) != 0x464c5200) {
-            throw new IOException("Not a valid JFR file");
-        }
+        long durationNanos = 0;
+        int chunkStart = 0;
+        int fileSize = buf.capacity();
+
+        while (chunkStart < fileSize) {
+            if (buf.getInt(chunkStart) != 0x464c5200) {
+                throw new IOException("Not a valid JFR file");
+            }
 
-        int version = buf.getInt(4);
-        if (version < 0x20000 || version > 0x2ffff) {
-            throw new IOException("Unsupported JFR version: " + (version >>> 16) + "." + (version & 0xffff));
+            int version = buf.getInt(chunkStart + 4);
+            if (version < 0x20000 || version > 0x2ffff) {
+                throw new IOException("Unsupported JFR version: " + (version >>> 16) + "." + (version & 0xffff));
+            }
+
+            // Zero size means the chunk is still being written
+            int chunkSize = (int) buf.getLong(chunkStart + 8);
+            if (chunkSize == 0) {
+                break;
+            }
+
+            durationNanos += buf.getLong(chunkStart + 40);
+            buf.limit(chunkStart + chunkSize);
+
+            readMeta(chunkStart);
+            readConstantPool(chunkStart);
+            readEvents(chunkStart);
+
+            buf.limit(fileSize);
+            chunkStart += chunkSize;
         }
 
-        buf.limit((int) buf.getLong(8));
+        if (chunkStart == 0) {
+            throw new IOException("Incomplete JFR recording");
+        }
 
         this.startNanos = buf.getLong(32);
-        this.durationNanos = buf.getLong(40);
+        this.durationNanos = durationNanos;
         this.startTicks = buf.getLong(48);
         this.ticksPerSec = buf.getLong(56);
 
-        readMeta();
-        readConstantPool();
-        readEvents();
+        Collections.sort(samples);
     }
 
     @Override
@@ -86,8 +115,25 @@ public class JfrReader implements Closeable {
         ch.close();
     }
 
-    private void readMeta() {
-        buf.position(buf.getInt(META_OFFSET + 4));
+    private boolean isGzip() throws IOException {
+        ByteBuffer magic = ByteBuffer.allocate(2);
+        return ch.read(magic, 0) == 2 && magic.get(0) == (byte) 0x1f && magic.get(1) == (byte) 0x8b;
+    }
+
+    // Recordings written with the compress option; each chunk is a separate gzip member
+    private static ByteBuffer decompress(String fileName) throws IOException {
+        try (InputStream in = new GZIPInputStream(new FileInputStream(fileName), 65536)) {
+            ByteArrayOutputStream out = new ByteArrayOutputStream(1 << 20);
+            byte[] chunk = new byte[65536];
+            for (int bytes; (bytes = in.read(chunk)) > 0; ) {
+                out.write(chunk, 0, bytes);
+            }
+            return ByteBuffer.wrap(out.toByteArray());
+        }
+    }
+
+    private void readMeta(int chunkStart) {
+        buf.position(chunkStart + buf.getInt(chunkStart + META_OFFSET + 4));
         getVarint();
         getVarint();
         getVarlong();
@@ -135,8 +181,8 @@ public class JfrReader implements Closeable {
         }
     }
 
-    private void readConstantPool() {
-        int offset = buf.getInt(CPOOL_OFFSET + 4);
+    private void readConstantPool(int chunkStart) {
+        int offset = chunkStart + buf.getInt(chunkStart + CPOOL_OFFSET + 4);
         while (true) {
             buf.position(offset);
             getVarint();
@@ -296,23 +342,31 @@ public class JfrReader implements Closeable {
         }
     }
 
-    private void readEvents() {
+    private void readEvents(int chunkStart) {
         int executionSample = getTypeId("jdk.ExecutionSample");
         int nativeMethodSample = getTypeId("jdk.NativeMethodSample");
+        int aggregatedSample = getTypeId("profiler.AggregatedSample");
+        int gcPause = getTypeId("jdk.GCPhasePause");
+        int safepointBegin = getTypeId("jdk.SafepointBegin");
+        int safepointSync = getTypeId("jdk.SafepointStateSynchronization");
 
-        buf.position(CHUNK_HEADER_SIZE);
+        buf.position(chunkStart + CHUNK_HEADER_SIZE);
         while (buf.hasRemaining()) {
             int position = buf.position();
             int size = getVarint();
             int type = getVarint();
             if (type == executionSample || type == nativeMethodSample) {
                 readExecutionSample();
+            } else if (type == aggregatedSample) {
+                readAggregatedSample();
+            } else if (type == gcPause) {
+                readGCPause();
+            } else if (type == safepointBegin) {
+                readSafepoint(position + size, safepointSync);
             } else {
                 buf.position(position + size);
             }
         }
-
-        Collections.sort(samples);
     }
 
     private void readExecutionSample() {
@@ -328,6 +382,50 @@ public class JfrReader implements Closeable {
         }
     }
 
+    private void readAggregatedSample() {
+        long time = getVarlong();
+        long duration = getVarlong();
+        int tid = getVarint();
+        int stackTraceId = getVarint();
+        int threadState = getVarint();
+        int count = getVarint();
+        samples.add(new Sample(time, tid, stackTraceId, threadState, count));
+
+        StackTrace stackTrace = stackTraces.get(stackTraceId);
+        if (stackTrace != null) {
+            stackTrace.samples += count;
+        }
+    }
+
+    private void readGCPause() {
+        long time = getVarlong();
+        long duration = getVarlong();
+        getVarint();  // eventThread
+        long gcId = getVarlong();
+        pauses.add(new Pause(true, gcId, time, duration, 0));
+    }
+
+    // async-profiler writes the synchronization event of a safepoint right after its begin event
+    private void readSafepoint(int end, int safepointSync) {
+        long time = getVarlong();
+        long duration = getVarlong();
+        getVarint();  // eventThread
+        long safepointId = getVarlong();
+
+        long syncDuration = 0;
+        buf.position(end);
+        if (buf.hasRemaining()) {
+            int size = getVarint();
+            if (getVarint() == safepointSync) {
+                getVarlong();  // startTime
+                syncDuration = getVarlong();
+                end += size;
+            }
+            buf.position(end);
+        }
+        pauses.add(new Pause(false, safepointId, time, duration, syncDuration));
+    }
+
     private int getTypeId(String typeName) {
         JfrClass type = typesByName.get(typeName);
         return type != null ? type.id : -1;
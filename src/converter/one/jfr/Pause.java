@@ -0,0 +1,48 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package one.jfr;
+
+/**
+ * An interval when Java threads were stopped: a GC pause or a safepoint.
+ * Times are in JFR ticks, like sample times.
+ */
+public class Pause implements Comparable<Pause> {
+    public final boolean gc;
+    public final long id;
+    public final long startTime;
+    public final long duration;
+    // Time-to-safepoint; 0 for GC pauses
+    public final long syncDuration;
+
+    public Pause(boolean gc, long id, long startTime, long duration, long syncDuration) {
+        this.gc = gc;
+        this.id = id;
+        this.startTime = startTime;
+        this.duration = duration;
+        this.syncDuration = syncDuration;
+    }
+
+    public long endTime() {
+        return startTime + duration;
+    }
+
+    @Override
+    public int compareTo(Pause o) {
+        return Long.compare(startTime, o.startTime);
+    }
+}
@@ -21,12 +21,19 @@ public class Sample implements Comparable<Sample> {
     public final int tid;
     public final int stackTraceId;
     public final int threadState;
+    public final int samples;
 
     public Sample(long time, int tid, int stackTraceId, int threadState) {
+        this(time, tid, stackTraceId, threadState, 1);
+    }
+
+    // An aggregated event stands for several samples of the same stack trace within a time slice
+    public Sample(long time, int tid, int stackTraceId, int threadState, int samples) {
         this.time = time;
         this.tid = tid;
         this.stackTraceId = stackTraceId;
         this.threadState = threadState;
+        this.samples = samples;
     }
 
     @Override
@@ -35,6 +35,7 @@ static inline bool keyEquals(const char* candidate, const char* key, size_t leng
 Dictionary::Dictionary() {
     _table = (DictTable*)calloc(1, sizeof(DictTable));
     _table->base_index = _base_index = 1;
+    _used_memory = sizeof(DictTable);
 }
 
 Dictionary::~Dictionary() {
@@ -46,6 +47,7 @@ void Dictionary::clear() {
     clear(_table);
     memset(_table, 0, sizeof(DictTable));
     _table->base_index = _base_index = 1;
+    _used_memory = sizeof(DictTable);
 }
 
 void Dictionary::clear(DictTable* table) {
@@ -85,6 +87,7 @@ unsigned int Dictionary::lookup(const char* key, size_t length) {
             if (row->keys[c] == NULL) {
                 char* new_key = allocateKey(key, length);
                 if (__sync_bool_compare_and_swap(&row->keys[c], NULL, new_key)) {
+                    __sync_fetch_and_add(&_used_memory, length + 1);
                     return table->index(h % ROWS, c);
                 }
                 free(new_key);
@@ -97,7 +100,9 @@ unsigned int Dictionary::lookup(const char* key, size_t length) {
         if (row->next == NULL) {
             DictTable* new_table = (DictTable*)calloc(1, sizeof(DictTable));
             new_table->base_index = __sync_add_and_fetch(&_base_index, TABLE_CAPACITY);
-            if (!__sync_bool_compare_and_swap(&row->next, NULL, new_table)) {
+            if (__sync_bool_compare_and_swap(&row->next, NULL, new_table)) {
+                __sync_fetch_and_add(&_used_memory, sizeof(DictTable));
+            } else {
                 free(new_table);
             }
         }
@@ -48,6 +48,7 @@ class Dictionary {
   private:
     DictTable* _table;
     volatile unsigned int _base_index;
+    volatile long long _used_memory;
 
     static void clear(DictTable* table);
 
@@ -65,6 +66,11 @@ class Dictionary {
     unsigned int lookup(const char* key, size_t length);
 
     void collect(std::map<unsigned int, const char*>& map);
+
+    // Bytes allocated for tables and keys
+    long long usedMemory() {
+        return _used_memory;
+    }
 };
 
 #endif // _DICTIONARY_H
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include "dwarf.h"
+
+
+enum {
+    DW_CFA_nop                        = 0x0,
+    DW_CFA_set_loc                    = 0x1,
+    DW_CFA_advance_loc1               = 0x2,
+    DW_CFA_advance_loc2               = 0x3,
+    DW_CFA_advance_loc4               = 0x4,
+    DW_CFA_offset_extended            = 0x5,
+    DW_CFA_restore_extended           = 0x6,
+    DW_CFA_undefined                  = 0x7,
+    DW_CFA_same_value                 = 0x8,
+    DW_CFA_register                   = 0x9,
+    DW_CFA_remember_state             = 0xa,
+    DW_CFA_restore_state              = 0xb,
+    DW_CFA_def_cfa                    = 0xc,
+    DW_CFA_def_cfa_register           = 0xd,
+    DW_CFA_def_cfa_offset             = 0xe,
+    DW_CFA_def_cfa_expression         = 0xf,
+    DW_CFA_expression                 = 0x10,
+    DW_CFA_offset_extended_sf         = 0x11,
+    DW_CFA_def_cfa_sf                 = 0x12,
+    DW_CFA_def_cfa_offset_sf          = 0x13,
+    DW_CFA_val_offset                 = 0x14,
+    DW_CFA_val_offset_sf              = 0x15,
+    DW_CFA_val_expression             = 0x16,
+    DW_CFA_GNU_args_size              = 0x2e,
+    DW_CFA_GNU_negative_offset_extended = 0x2f,
+
+    DW_CFA_advance_loc                = 0x1,
+    DW_CFA_offset                     = 0x2,
+    DW_CFA_restore                    = 0x3
+};
+
+enum {
+    DW_EH_PE_absptr  = 0x00,
+    DW_EH_PE_uleb128 = 0x01,
+    DW_EH_PE_udata2  = 0x02,
+    DW_EH_PE_udata4  = 0x03,
+    DW_EH_PE_udata8  = 0x04,
+    DW_EH_PE_sleb128 = 0x09,
+    DW_EH_PE_sdata2  = 0x0a,
+    DW_EH_PE_sdata4  = 0x0b,
+    DW_EH_PE_sdata8  = 0x0c,
+    DW_EH_PE_pcrel   = 0x10,
+    DW_EH_PE_omit    = 0xff
+};
+
+const int MAX_REMEMBERED_STATES = 8;
+const int INITIAL_TABLE_CAPACITY = 128;
+
+
+DwarfParser::DwarfParser(const char* section, size_t size, u64 section_addr, bool debug_frame) {
+    _section = section;
+    _section_end = section + size;
+    _section_addr = section_addr;
+    _debug_frame = debug_frame;
+
+    _capacity = INITIAL_TABLE_CAPACITY;
+    _count = 0;
+    _table = (FrameDesc*)malloc(_capacity * sizeof(FrameDesc));
+
+    _cie = NULL;
+    parse();
+}
+
+void DwarfParser::parse() {
+    _ptr = _section;
+
+    while (_ptr + 4 <= _section_end) {
+        u32 length = get32();
+        if (length == 0) {
+            continue;
+        } else if (length == 0xffffffff || length > (size_t)(_section_end - _ptr)) {
+            // 64-bit DWARF format is not supported
+            break;
+        }
+
+        const char* entry_end = _ptr + length;
+        u32 cie_id = get32();
+
+        // CIEs are parsed lazily when referenced from an FDE
+        if (_debug_frame ? cie_id != 0xffffffff : cie_id != 0) {
+            const char* fde = _ptr;
+            const char* cie = _debug_frame ? _section + cie_id : fde - 4 - cie_id;
+            if (parseCie(cie)) {
+                _ptr = fde;
+                parseFde(entry_end);
+            }
+        }
+
+        _ptr = entry_end;
+    }
+
+    if (_count > 1) {
+        qsort(_table, _count, sizeof(FrameDesc), FrameDesc::comparator);
+    }
+}
+
+u64 DwarfParser::getPtr(u8 encoding) {
+    if (encoding == DW_EH_PE_omit) {
+        return 0;
+    }
+
+    const char* field = _ptr;
+    u64 value;
+
+    switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:
+            value = sizeof(void*) == 8 ? get64() : get32();
+            break;
+        case DW_EH_PE_uleb128:
+            value = getLeb();
+            break;
+        case DW_EH_PE_udata2:
+            value = get16();
+            break;
+        case DW_EH_PE_udata4:
+            value = get32();
+            break;
+        case DW_EH_PE_udata8:
+        case DW_EH_PE_sdata8:
+            value = get64();
+            break;
+        case DW_EH_PE_sleb128:
+            value = (u64)(long long)getSLeb();
+            break;
+        case DW_EH_PE_sdata2:
+            value = (u64)(long long)(short)get16();
+            break;
+        case DW_EH_PE_sdata4:
+            value = (u64)(long long)(int)get32();
+            break;
+        default:
+            value = 0;
+    }
+
+    if ((encoding & 0x70) == DW_EH_PE_pcrel) {
+        value += _section_addr + (field - _section);
+    }
+    return value;
+}
+
+bool DwarfParser::parseCie(const char* cie) {
+    if (cie == _cie) {
+        return true;
+    }
+
+    _cie = NULL;
+    if (cie < _section || cie + 8 > _section_end) {
+        return false;
+    }
+
+    _ptr = cie;
+    u32 length = get32();
+    if (length == 0 || length == 0xffffffff || length > (size_t)(_section_end - _ptr)) {
+        return false;
+    }
+
+    const char* cie_end = _ptr + length;
+    _ptr += 4;  // CIE id
+
+    u8 version = get8();
+    const char* augmentation = _ptr;
+    _ptr += strlen(augmentation) + 1;
+    if (version >= 4) {
+        _ptr += 2;  // address_size, segment_size
+    }
+
+    _code_align = getLeb();
+    _data_align = getSLeb();
+    if (version == 1) {
+        get8();
+    } else {
+        getLeb();
+    }
+
+    _fde_encoding = DW_EH_PE_absptr;
+    _has_augmentation = augmentation[0] == 'z';
+
+    if (_has_augmentation) {
+        u32 augmentation_length = getLeb();
+        const char* augmentation_end = _ptr + augmentation_length;
+        for (const char* a = augmentation + 1; *a != 0 && _ptr < augmentation_end; a++) {
+            if (*a == 'R') {
+                _fde_encoding = get8();
+            } else if (*a == 'P') {
+                getPtr(get8());
+            } else if (*a == 'L') {
+                get8();
+            }
+        }
+        _ptr = augmentation_end;
+    } else if (augmentation[0] != 0) {
+        return false;
+    }
+
+    _cie = cie;
+    _cie_instructions = _ptr;
+    _cie_end = cie_end;
+    return true;
+}
+
+void DwarfParser::parseFde(const char* end) {
+    u32 range_start = (u32)getPtr(_fde_encoding);
+    u32 range_length = (u32)getPtr(_fde_encoding & 0x0f);
+    if (range_length == 0) {
+        return;
+    }
+
+    if (_has_augmentation) {
+        u32 augmentation_length = getLeb();
+        _ptr += augmentation_length;
+    }
+    const char* instructions = _ptr;
+
+    // At the entry point, CFA is SP before the call, and the return address is the last pushed slot
+    _cfa_reg = DW_REG_SP;
+    _cfa_off = DW_STACK_SLOT;
+    _fp_off = DW_SAME_FP;
+
+    u32 loc = range_start;
+    _ptr = _cie_instructions;
+    parseInstructions(loc, _cie_end, DW_SAME_FP);
+
+    int init_fp_off = _fp_off;
+    _ptr = instructions;
+    parseInstructions(loc, end, init_fp_off);
+
+    addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+    addRecord(range_start + range_length, DW_REG_INVALID, 0, DW_SAME_FP);
+}
+
+void DwarfParser::parseInstructions(u32& loc, const char* end, int init_fp_off) {
+    int saved_states[MAX_REMEMBERED_STATES][3];
+    int saved_count = 0;
+
+    while (_ptr < end) {
+        u8 op = get8();
+
+        switch (op >> 6) {
+            case DW_CFA_advance_loc:
+                addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+                loc += (op & 0x3f) * _code_align;
+                continue;
+            case DW_CFA_offset: {
+                int offset = getLeb() * _data_align;
+                if ((op & 0x3f) == DW_REG_FP) _fp_off = offset;
+                continue;
+            }
+            case DW_CFA_restore:
+                if ((op & 0x3f) == DW_REG_FP) _fp_off = init_fp_off;
+                continue;
+        }
+
+        switch (op) {
+            case DW_CFA_nop:
+                break;
+            case DW_CFA_GNU_args_size:
+                getLeb();
+                break;
+            case DW_CFA_set_loc:
+                addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+                loc = (u32)getPtr(_fde_encoding);
+                break;
+            case DW_CFA_advance_loc1:
+                addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+                loc += get8() * _code_align;
+                break;
+            case DW_CFA_advance_loc2:
+                addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+                loc += get16() * _code_align;
+                break;
+            case DW_CFA_advance_loc4:
+                addRecord(loc, _cfa_reg, _cfa_off, _fp_off);
+                loc += get32() * _code_align;
+                break;
+            case DW_CFA_offset_extended: {
+                u32 reg = getLeb();
+                int offset = getLeb() * _data_align;
+                if (reg == DW_REG_FP) _fp_off = offset;
+                break;
+            }
+            case DW_CFA_offset_extended_sf: {
+                u32 reg = getLeb();
+                int offset = getSLeb() * _data_align;
+                if (reg == DW_REG_FP) _fp_off = offset;
+                break;
+            }
+            case DW_CFA_GNU_negative_offset_extended: {
+                u32 reg = getLeb();
+                int offset = -(int)getLeb() * _data_align;
+                if (reg == DW_REG_FP) _fp_off = offset;
+                break;
+            }
+            case DW_CFA_restore_extended:
+                if (getLeb() == DW_REG_FP) _fp_off = init_fp_off;
+                break;
+            case DW_CFA_undefined: {
+                u32 reg = getLeb();
+                if (reg == DW_REG_PC) {
+                    // The outermost frame: there is nothing to unwind
+                    _cfa_reg = DW_REG_INVALID;
+                } else if (reg == DW_REG_FP) {
+                    _fp_off = DW_SAME_FP;
+                }
+                break;
+            }
+            case DW_CFA_same_value:
+            case DW_CFA_register:
+                // A copy of FP in another register cannot be tracked
+                if (getLeb() == DW_REG_FP) _fp_off = DW_SAME_FP;
+                if (op == DW_CFA_register) getLeb();
+                break;
+            case DW_CFA_remember_state:
+                if (saved_count < MAX_REMEMBERED_STATES) {
+                    saved_states[saved_count][0] = _cfa_reg;
+                    saved_states[saved_count][1] = _cfa_off;
+                    saved_states[saved_count][2] = _fp_off;
+                }
+                saved_count++;
+                break;
+            case DW_CFA_restore_state:
+                if (saved_count > 0 && --saved_count < MAX_REMEMBERED_STATES) {
+                    _cfa_reg = saved_states[saved_count][0];
+                    _cfa_off = saved_states[saved_count][1];
+                    _fp_off = saved_states[saved_count][2];
+                }
+                break;
+            case DW_CFA_def_cfa:
+                _cfa_reg = getLeb();
+                _cfa_off = getLeb();
+                break;
+            case DW_CFA_def_cfa_sf:
+                _cfa_reg = getLeb();
+                _cfa_off = getSLeb() * _data_align;
+                break;
+            case DW_CFA_def_cfa_register:
+                _cfa_reg = getLeb();
+                break;
+            case DW_CFA_def_cfa_offset:
+                _cfa_off = getLeb();
+                break;
+            case DW_CFA_def_cfa_offset_sf:
+                _cfa_off = getSLeb() * _data_align;
+                break;
+            case DW_CFA_def_cfa_expression: {
+                // Typical for PLT entries; such frames are unwound heuristically
+                u32 length = getLeb();
+                _ptr += length;
+                _cfa_reg = DW_REG_INVALID;
+                break;
+            }
+            case DW_CFA_expression:
+            case DW_CFA_val_expression: {
+                u32 reg = getLeb();
+                u32 length = getLeb();
+                _ptr += length;
+                if (reg == DW_REG_FP) _fp_off = DW_SAME_FP;
+                break;
+            }
+            case DW_CFA_val_offset:
+                getLeb();
+                getLeb();
+                break;
+            case DW_CFA_val_offset_sf:
+                getLeb();
+                getSLeb();
+                break;
+            default:
+                // Unknown instruction: the rest of the sequence cannot be decoded
+                _cfa_reg = DW_REG_INVALID;
+                _ptr = end;
+        }
+    }
+}
+
+void DwarfParser::addRecord(u32 loc, int cfa_reg, int cfa_off, int fp_off) {
+    if (cfa_reg != DW_REG_SP && cfa_reg != DW_REG_FP) {
+        cfa_reg = DW_REG_INVALID;
+        cfa_off = 0;
+        fp_off = DW_SAME_FP;
+    }
+    int cfa = (int)((u32)cfa_off << 8) | cfa_reg;
+
+    if (_count > 0) {
+        FrameDesc* prev = &_table[_count - 1];
+        if (prev->loc == loc) {
+            // Several instructions at the same location: the last one wins
+            prev->cfa = cfa;
+            prev->fp_off = fp_off;
+            return;
+        } else if (prev->cfa == cfa && prev->fp_off == fp_off) {
+            return;
+        }
+    }
+
+    if (_count >= _capacity) {
+        _capacity *= 2;
+        _table = (FrameDesc*)realloc(_table, _capacity * sizeof(FrameDesc));
+    }
+
+    FrameDesc* fd = &_table[_count++];
+    fd->loc = loc;
+    fd->cfa = cfa;
+    fd->fp_off = fp_off;
+}
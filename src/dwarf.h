@@ -0,0 +1,177 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _DWARF_H
+#define _DWARF_H
+
+#include <stddef.h>
+#include <string.h>
+#include "arch.h"
+
+
+#if defined(__x86_64__)
+
+#define DWARF_SUPPORTED true
+
+const int DW_REG_FP = 6;
+const int DW_REG_SP = 7;
+const int DW_REG_PC = 16;
+
+#elif defined(__i386__)
+
+#define DWARF_SUPPORTED true
+
+const int DW_REG_FP = 5;
+const int DW_REG_SP = 4;
+const int DW_REG_PC = 8;
+
+#else
+
+#define DWARF_SUPPORTED false
+
+const int DW_REG_FP = 0;
+const int DW_REG_SP = 0;
+const int DW_REG_PC = 0;
+
+#endif
+
+const int DW_REG_INVALID = 255;  // CFA is not computable from SP or FP
+const int DW_SAME_FP = 0x80000000;  // Caller's FP is not saved in this frame
+const int DW_STACK_SLOT = sizeof(void*);
+
+
+// Compact unwind rule that holds from loc up to the next FrameDesc
+struct FrameDesc {
+    u32 loc;     // virtual address relative to the image base
+    int cfa;     // (CFA offset << 8) | CFA register
+    int fp_off;  // Location of the saved FP relative to CFA, or DW_SAME_FP
+
+    int cfa_reg() const { return cfa & 0xff; }
+    int cfa_off() const { return cfa >> 8; }
+
+    static int comparator(const void* p1, const void* p2) {
+        const FrameDesc* fd1 = (const FrameDesc*)p1;
+        const FrameDesc* fd2 = (const FrameDesc*)p2;
+        if (fd1->loc != fd2->loc) {
+            return fd1->loc < fd2->loc ? -1 : 1;
+        }
+        // End-of-function markers go first, so that a function starting
+        // at the same address takes precedence in a binary search
+        return (fd2->cfa_reg() == DW_REG_INVALID) - (fd1->cfa_reg() == DW_REG_INVALID);
+    }
+};
+
+
+// Converts Call Frame Information from .eh_frame or .debug_frame
+// into a sorted table of FrameDesc records
+class DwarfParser {
+  private:
+    const char* _section;
+    const char* _section_end;
+    u64 _section_addr;
+    bool _debug_frame;
+    const char* _ptr;
+
+    int _capacity;
+    int _count;
+    FrameDesc* _table;
+
+    const char* _cie;
+    const char* _cie_instructions;
+    const char* _cie_end;
+    u32 _code_align;
+    int _data_align;
+    u8 _fde_encoding;
+    bool _has_augmentation;
+
+    int _cfa_reg;
+    int _cfa_off;
+    int _fp_off;
+
+    u8 get8() {
+        return *_ptr++;
+    }
+
+    u16 get16() {
+        u16 result;
+        memcpy(&result, _ptr, sizeof(result));
+        _ptr += sizeof(result);
+        return result;
+    }
+
+    u32 get32() {
+        u32 result;
+        memcpy(&result, _ptr, sizeof(result));
+        _ptr += sizeof(result);
+        return result;
+    }
+
+    u64 get64() {
+        u64 result;
+        memcpy(&result, _ptr, sizeof(result));
+        _ptr += sizeof(result);
+        return result;
+    }
+
+    u32 getLeb() {
+        u32 result = 0;
+        for (u32 shift = 0; ; shift += 7) {
+            u8 b = *_ptr++;
+            if (shift < 32) result |= (u32)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return result;
+            }
+        }
+    }
+
+    int getSLeb() {
+        u32 result = 0;
+        u32 shift = 0;
+        u8 b;
+        do {
+            b = *_ptr++;
+            if (shift < 32) result |= (u32)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+
+        if (shift < 32 && (b & 0x40) != 0) {
+            result |= ~0U << shift;
+        }
+        return (int)result;
+    }
+
+    u64 getPtr(u8 encoding);
+    bool parseCie(const char* cie);
+    void parse();
+    void parseFde(const char* end);
+    void parseInstructions(u32& loc, const char* end, int init_fp_off);
+    void addRecord(u32 loc, int cfa_reg, int cfa_off, int fp_off);
+
+  public:
+    DwarfParser(const char* section, size_t size, u64 section_addr, bool debug_frame);
+
+    // The caller takes ownership of the table
+    FrameDesc* table() const {
+        return _table;
+    }
+
+    int count() const {
+        return _count;
+    }
+};
+
+#endif // _DWARF_H
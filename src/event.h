@@ -18,6 +18,7 @@
 #define _EVENT_H
 
 #include <stdint.h>
+#include "arguments.h"
 #include "os.h"
 
 
@@ -31,8 +32,12 @@ class Event {
 class ExecutionEvent : public Event {
   public:
     ThreadState _thread_state;
+    u64 _time;  // 0 means the sample is recorded right when it is taken
+    // Deltas of perf events counted in the same group as the sampled event
+    int _group_count;
+    u64 _group[MAX_GROUP_EVENTS];
 
-    ExecutionEvent() : _thread_state(THREAD_RUNNING) {
+    ExecutionEvent() : _thread_state(THREAD_RUNNING), _time(0), _group_count(0), _group() {
     }
 };
 
@@ -52,4 +57,17 @@ class LockEvent : public Event {
     long long _timeout;
 };
 
+enum PauseType {
+    PAUSE_GC,
+    PAUSE_SAFEPOINT
+};
+
+class PauseEvent : public Event {
+  public:
+    u32 _id;
+    u64 _start_time;
+    u64 _sync_time;  // when all threads reached the safepoint
+    u64 _end_time;
+};
+
 #endif // _EVENT_H
@@ -53,6 +53,7 @@ static const char FLAMEGRAPH_HEADER[] =
     "\t'use strict';\n"
     "\tvar root, rootLevel, px, pattern;\n"
     "\tvar reverse = %s;\n"
+    "\tconst ratioName = '%s';\n"
     "\tconst levels = Array(%d);\n"
     "\tfor (let h = 0; h < levels.length; h++) {\n"
     "\t\tlevels[h] = [];\n"
@@ -77,6 +78,8 @@ static const char FLAMEGRAPH_HEADER[] =
     "\t\t[0xe17d00, 30, 30,  0],\n"
     "\t\t[0xc8c83c, 30, 30, 10],\n"
     "\t\t[0xe15a5a, 30, 40, 40],\n"
+    "\t\t[0xb2e1b2, 20, 20, 20],\n"
+    "\t\t[0xcce880, 20, 20, 20],\n"
     "\t];\n"
     "\n"
     "\tfunction getColor(p) {\n"
@@ -84,8 +87,16 @@ static const char FLAMEGRAPH_HEADER[] =
     "\t\treturn '#' + (p[0] + ((p[1] * v) << 16 | (p[2] * v) << 8 | (p[3] * v))).toString(16);\n"
     "\t}\n"
     "\n"
-    "\tfunction f(level, left, width, type, title) {\n"
-    "\t\tlevels[level].push({left: left, width: width, color: getColor(palette[type]), title: title});\n"
+    "\tlet baseRatio;\n"
+    "\tfunction ratioColor(r) {\n"
+    "\t\tif (baseRatio === undefined) baseRatio = r || 1;\n"
+    "\t\tconst v = Math.min(r / baseRatio, 2) / 2;\n"
+    "\t\treturn 'hsl(' + Math.round(240 * (1 - v)) + ', 70%%, 65%%)';\n"
+    "\t}\n"
+    "\n"
+    "\tfunction f(level, left, width, type, title, ratio) {\n"
+    "\t\tconst color = ratio === undefined ? getColor(palette[type]) : ratioColor(ratio);\n"
+    "\t\tlevels[level].push({left: left, width: width, color: color, title: title, ratio: ratio});\n"
     "\t}\n"
     "\n"
     "\tfunction samples(n) {\n"
@@ -200,7 +211,8 @@ static const char FLAMEGRAPH_HEADER[] =
     "\t\t\t\thl.style.top = ((reverse ? h * 16 : canvasHeight - (h + 1) * 16) + canvas.offsetTop) + 'px';\n"
     "\t\t\t\thl.firstChild.textContent = f.title;\n"
     "\t\t\t\thl.style.display = 'block';\n"
-    "\t\t\t\tcanvas.title = f.title + '\\n(' + samples(f.width) + ', ' + pct(f.width, levels[0][0].width) + '%%)';\n"
+    "\t\t\t\tcanvas.title = f.title + '\\n(' + samples(f.width) + ', ' + pct(f.width, levels[0][0].width) + '%%'\n"
+    "\t\t\t\t\t+ (f.ratio === undefined ? ')' : ', ' + ratioName + ' = ' + f.ratio + ')');\n"
     "\t\t\t\tcanvas.style.cursor = 'pointer';\n"
     "\t\t\t\tcanvas.onclick = function() {\n"
     "\t\t\t\t\tif (f != root) {\n"
@@ -309,6 +321,12 @@ static const char TREE_HEADER[] =
     ".t4 {\n"
     "    color: #c83232;\n"
     "}\n"
+    ".t5 {\n"
+    "    color: #64a064;\n"
+    "}\n"
+    ".t6 {\n"
+    "    color: #8cb432;\n"
+    "}\n"
     "ul.tree li > div {\n"
     "    display: inline;\n"
     "    cursor: pointer;\n"
@@ -479,7 +497,8 @@ void FlameGraph::dump(std::ostream& out, bool tree) {
         out << TREE_FOOTER;
     } else {
         char buf[sizeof(FLAMEGRAPH_HEADER) + 256];
-        snprintf(buf, sizeof(buf) - 1, FLAMEGRAPH_HEADER, _title, depth * 16, _reverse ? "true" : "false", depth);
+        snprintf(buf, sizeof(buf) - 1, FLAMEGRAPH_HEADER, _title, depth * 16, _reverse ? "true" : "false",
+                 _ratio_name != NULL ? _ratio_name : "", depth);
         out << buf;
 
         printFrame(out, "all", _root, 0, 0);
@@ -493,7 +512,12 @@ void FlameGraph::printFrame(std::ostream& out, const std::string& name, const Tr
     int type = frameType(name_copy);
     StringUtils::replace(name_copy, '\'', "\\'");
 
-    snprintf(_buf, sizeof(_buf) - 1, "f(%d,%llu,%llu,%d,'%s')\n", level, x, f._total, type, name_copy.c_str());
+    if (_ratio_name != NULL && f._ratio_den > 0) {
+        snprintf(_buf, sizeof(_buf) - 1, "f(%d,%llu,%llu,%d,'%s',%.4g)\n", level, x, f._total, type, name_copy.c_str(),
+                 (double)f._ratio_num * _ratio_scale / f._ratio_den);
+    } else {
+        snprintf(_buf, sizeof(_buf) - 1, "f(%d,%llu,%llu,%d,'%s')\n", level, x, f._total, type, name_copy.c_str());
+    }
     out << _buf;
 
     x += f._self;
@@ -563,6 +587,14 @@ int FlameGraph::frameType(std::string& name) {
         // Kernel function
         name = name.substr(0, name.length() - 4);
         return 2;
+    } else if (StringUtils::endsWith(name, "_[0]", 4)) {
+        // Java interpreted frame
+        name = name.substr(0, name.length() - 4);
+        return 5;
+    } else if (StringUtils::endsWith(name, "_[1]", 4)) {
+        // Java frame compiled by C1
+        name = name.substr(0, name.length() - 4);
+        return 6;
     } else if (name.find("::") != std::string::npos || name.compare(0, 2, "-[") == 0 || name.compare(0, 2, "+[") == 0) {
         // C++ function or Objective C method
         return 3;
@@ -29,18 +29,33 @@ class Trie {
     std::map<std::string, Trie> _children;
     u64 _total;
     u64 _self;
+    // Numerator and denominator of the counter ratio that colors the frame
+    u64 _ratio_num;
+    u64 _ratio_den;
 
-    Trie() : _children(), _total(0), _self(0) {
+    Trie() : _children(), _total(0), _self(0), _ratio_num(0), _ratio_den(0) {
     }
     
-    Trie* addChild(const std::string& key, u64 value) {
+    Trie* addChild(const std::string& key, u64 value, u64 num = 0, u64 den = 0) {
         _total += value;
+        _ratio_num += num;
+        _ratio_den += den;
         return &_children[key];
     }
 
-    void addLeaf(u64 value) {
+    // Descend to a child which is already known
+    Trie* addChild(Trie* child, u64 value, u64 num = 0, u64 den = 0) {
+        _total += value;
+        _ratio_num += num;
+        _ratio_den += den;
+        return child;
+    }
+
+    void addLeaf(u64 value, u64 num = 0, u64 den = 0) {
         _total += value;
         _self += value;
+        _ratio_num += num;
+        _ratio_den += den;
     }
 
     int depth(u64 cutoff) const {
@@ -68,6 +83,8 @@ class FlameGraph {
     Counter _counter;
     double _minwidth;
     bool _reverse;
+    const char* _ratio_name;
+    double _ratio_scale;
 
     void printFrame(std::ostream& out, const std::string& name, const Trie& f, int level, u64 x);
     void printTreeFrame(std::ostream& out, const Trie& f, int level);
@@ -79,10 +96,18 @@ class FlameGraph {
         _title(title),
         _counter(counter),
         _minwidth(minwidth),
-        _reverse(reverse) {
+        _reverse(reverse),
+        _ratio_name(NULL),
+        _ratio_scale(1) {
         _buf[sizeof(_buf) - 1] = 0;
     }
 
+    // Frames are colored by num * scale / den accumulated in Trie nodes
+    void setRatio(const char* name, double scale) {
+        _ratio_name = name;
+        _ratio_scale = scale;
+    }
+
     Trie* root() {
         return &_root;
     }
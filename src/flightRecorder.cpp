@@ -14,24 +14,31 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <map>
 #include <string>
-#include <arpa/inet.h>
 #include <cxxabi.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
+#include <time.h>
 #include <unistd.h>
 #include "flightRecorder.h"
+#include "gzipWriter.h"
+#include "jfrBuffer.h"
+#include "jfrWriter.h"
 #include "jfrMetadata.h"
+#include "methodMap.h"
 #include "dictionary.h"
 #include "log.h"
 #include "os.h"
 #include "profiler.h"
+#include "sampleAggregator.h"
 #include "threadFilter.h"
 #include "vmStructs.h"
 
@@ -41,25 +48,8 @@ static const unsigned char JFR_COMBINER_CLASS[] = {
 };
 
 
-const int BUFFER_SIZE = 1024;
-const int BUFFER_LIMIT = BUFFER_SIZE - 128;
-const int RECORDING_BUFFER_SIZE = 65536;
-const int RECORDING_BUFFER_LIMIT = RECORDING_BUFFER_SIZE - 4096;
-const int MAX_STRING_LENGTH = 8191;
-
-
 static const char* const SETTING_RING[] = {NULL, "kernel", "user"};
-static const char* const SETTING_CSTACK[] = {NULL, "no", "fp", "lbr"};
-
-
-enum FrameTypeId {
-    FRAME_INTERPRETED  = 0,
-    FRAME_JIT_COMPILED = 1,
-    FRAME_INLINED      = 2,
-    FRAME_NATIVE       = 3,
-    FRAME_CPP          = 4,
-    FRAME_KERNEL       = 5,
-};
+static const char* const SETTING_CSTACK[] = {NULL, "no", "fp", "lbr", "dwarf"};
 
 
 struct CpuTime {
@@ -73,154 +63,9 @@ struct CpuTimes {
     CpuTime total;
 };
 
-
-class MethodInfo {
-  public:
-    MethodInfo() : _key(0) {
-    }
-
-    u32 _key;
-    u32 _class;
-    u32 _name;
-    u32 _sig;
-    jint _modifiers;
-    jint _line_number_table_size;
-    jvmtiLineNumberEntry* _line_number_table;
-    FrameTypeId _type;
-
-    jint getLineNumber(jint bci) {
-        if (_line_number_table_size == 0) {
-            return 0;
-        }
-
-        int i = 1;
-        while (i < _line_number_table_size && bci >= _line_number_table[i].start_location) {
-            i++;
-        }
-        return _line_number_table[i - 1].line_number;
-    }
-};
-
-
-class Buffer {
-  private:
-    int _offset;
-    char _data[BUFFER_SIZE - sizeof(int)];
-
-  public:
-    Buffer() : _offset(0) {
-    }
-
-    const char* data() const {
-        return _data;
-    }
-
-    int offset() const {
-        return _offset;
-    }
-
-    int skip(int delta) {
-        int offset = _offset;
-        _offset = offset + delta;
-        return offset;
-    }
-
-    void reset() {
-        _offset = 0;
-    }
-
-    void put(const char* v, u32 len) {
-        memcpy(_data + _offset, v, len);
-        _offset += (int)len;
-    }
-
-    void put8(char v) {
-        _data[_offset++] = v;
-    }
-
-    void put16(short v) {
-        *(short*)(_data + _offset) = htons(v);
-        _offset += 2;
-    }
-
-    void put32(int v) {
-        *(int*)(_data + _offset) = htonl(v);
-        _offset += 4;
-    }
-
-    void put64(u64 v) {
-        *(u64*)(_data + _offset) = OS::hton64(v);
-        _offset += 8;
-    }
-
-    void putFloat(float v) {
-        union {
-            float f;
-            int i;
-        } u;
-
-        u.f = v;
-        put32(u.i);
-    }
-
-    void putVar32(u32 v) {
-        while (v > 0x7f) {
-            _data[_offset++] = (char)v | 0x80;
-            v >>= 7;
-        }
-        _data[_offset++] = (char)v;
-    }
-
-    void putVar64(u64 v) {
-        int iter = 0;
-        while (v > 0x1fffff) {
-            _data[_offset++] = (char)v | 0x80; v >>= 7;
-            _data[_offset++] = (char)v | 0x80; v >>= 7;
-            _data[_offset++] = (char)v | 0x80; v >>= 7;
-            if (++iter == 3) return;
-        }
-        while (v > 0x7f) {
-            _data[_offset++] = (char)v | 0x80;
-            v >>= 7;
-        }
-        _data[_offset++] = (char)v;
-    }
-
-    void putUtf8(const char* v) {
-        if (v == NULL) {
-            put8(0);
-        } else {
-            putUtf8(v, strlen(v) & MAX_STRING_LENGTH);
-        }
-    }
-
-    void putUtf8(const char* v, u32 len) {
-        put8(3);
-        putVar32(len);
-        put(v, len);
-    }
-
-    void put8(int offset, char v) {
-        _data[offset] = v;
-    }
-
-    void putVar32(int offset, u32 v) {
-        _data[offset] = v | 0x80;
-        _data[offset + 1] = (v >> 7) | 0x80;
-        _data[offset + 2] = (v >> 14) | 0x80;
-        _data[offset + 3] = (v >> 21) | 0x80;
-        _data[offset + 4] = (v >> 28);
-    }
-};
-
-class RecordingBuffer : public Buffer {
-  private:
-    char _buf[RECORDING_BUFFER_SIZE - sizeof(Buffer)];
-
-  public:
-    RecordingBuffer() : Buffer() {
-    }
-};
+// Bounds the cost of one CPU monitor cycle: with more live threads than this,
+// each cycle reads the next window of threads, so every thread is visited in turn
+const size_t MAX_THREAD_CPU_READS = 1024;
 
 
 class Recording {
@@ -233,13 +78,34 @@ class Recording {
     static char* _jvm_flags;
     static char* _java_command;
 
-    RecordingBuffer _buf[CONCURRENCY_LEVEL];
+    RecordingBuffer** _buf;
+    int _buf_count;
+    // Per-slot sample counts in aggregate mode, NULL otherwise
+    SampleAggregator* _aggregators;
+    u64 _slice_nanos;
     int _fd;
+    // With compression, _fd is a staging file, and finished chunks are moved here
+    int _gzip_fd;
+    JfrWriter _writer;
+    RecordingBuffer _chunk_buf;
+    // In memory mode, the chunk header, metadata and initial events to start each dump with
+    std::string _prologue;
     off_t _chunk_start;
+    long _chunk_time;
+    long _chunk_size;
+    pthread_t _rotation_thread;
+    bool _rotation_started;
+    volatile bool _stopping;
     ThreadFilter _thread_set;
     Dictionary _packages;
     Dictionary _symbols;
-    std::map<jmethodID, MethodInfo> _method_map;
+    MethodMap _method_map;
+    // Constant pool entries already written to previous chunks
+    std::vector<MethodInfo*> _new_methods;
+    std::vector<bool> _written_traces;
+    std::vector<bool> _written_classes;
+    std::vector<bool> _written_packages;
+    std::vector<bool> _written_symbols;
     u64 _start_time;
     u64 _start_nanos;
     u64 _stop_time;
@@ -249,8 +115,12 @@ class Recording {
     Buffer _cpu_monitor_buf;
     Timer* _cpu_monitor;
     CpuTimes _last_times;
+    // Previous CPU time reading per thread, and the thread to start the next window with
+    std::map<int, CpuTime> _last_thread_times;
+    int _thread_cpu_cursor;
 
     void startCpuMonitor(bool enabled) {
+        _thread_cpu_cursor = 0;
         _last_times.proc.real = OS::getProcessCpuTime(&_last_times.proc.user, &_last_times.proc.system);
         _last_times.total.real = OS::getTotalCpuTime(&_last_times.total.user, &_last_times.total.system);
 
@@ -288,9 +158,71 @@ class Recording {
         }
 
         recordCpuLoad(&_cpu_monitor_buf, proc_user, proc_system, machine_total);
-        flushIfNeeded(&_cpu_monitor_buf, BUFFER_LIMIT);
+        if (_cpu_monitor_buf.offset() >= BUFFER_LIMIT) {
+            flushEvents(&_cpu_monitor_buf);
+        }
 
         _last_times = times;
+
+        threadCpuCycle();
+    }
+
+    void threadCpuCycle() {
+        std::vector<int> tids;
+        ThreadList* thread_list = OS::listThreads();
+        for (int tid; (tid = thread_list->next()) != -1; ) {
+            tids.push_back(tid);
+        }
+        delete thread_list;
+        std::sort(tids.begin(), tids.end());
+
+        // Forget threads that have exited
+        for (std::map<int, CpuTime>::iterator it = _last_thread_times.begin(); it != _last_thread_times.end(); ) {
+            if (std::binary_search(tids.begin(), tids.end(), it->first)) {
+                ++it;
+            } else {
+                _last_thread_times.erase(it++);
+            }
+        }
+
+        size_t count = tids.size();
+        if (count == 0) {
+            return;
+        }
+
+        // Continue where the previous window stopped; the first reading of a thread is only a baseline
+        size_t first = std::lower_bound(tids.begin(), tids.end(), _thread_cpu_cursor) - tids.begin();
+        size_t reads = count < MAX_THREAD_CPU_READS ? count : MAX_THREAD_CPU_READS;
+        for (size_t i = 0; i < reads; i++) {
+            int tid = tids[(first + i) % count];
+
+            CpuTime time;
+            if (!OS::getThreadCpuTime(tid, &time.user, &time.system)) {
+                continue;
+            }
+            time.real = OS::nanotime();
+
+            std::map<int, CpuTime>::iterator last = _last_thread_times.find(tid);
+            if (last == _last_thread_times.end()) {
+                _last_thread_times[tid] = time;
+                continue;
+            }
+
+            if (time.real > last->second.real) {
+                float delta = (time.real - last->second.real) * _available_processors;
+                float user = ratio((time.user - last->second.user) / delta);
+                float system = ratio((time.system - last->second.system) / delta);
+
+                addThread(tid);
+                recordThreadCpuLoad(&_cpu_monitor_buf, tid, user, system);
+                if (_cpu_monitor_buf.offset() >= BUFFER_LIMIT) {
+                    flushEvents(&_cpu_monitor_buf);
+                }
+            }
+            last->second = time;
+        }
+
+        _thread_cpu_cursor = tids[(first + reads) % count];
     }
 
     static void cpuMonitorCallback(void* arg) {
@@ -304,67 +236,320 @@ class Recording {
         return value < 0 ? 0 : value > 1 ? 1 : value;
     }
 
-  public:
-    Recording(int fd, Arguments& args) : _fd(fd), _thread_set(), _packages(), _symbols(), _method_map() {
+    static bool markWritten(std::vector<bool>& written, u32 id) {
+        if (id >= written.size()) {
+            written.resize(id * 2 + 1);
+        }
+        if (written[id]) {
+            return false;
+        }
+        written[id] = true;
+        return true;
+    }
+
+    // Packed ring buffers are more than half full on average, since two neighbours
+    // are merged whenever they fit together into one buffer
+    static int ringBuffers(Arguments& args) {
+        return args._blackbox > 0 ? (int)(args._blackbox * 2 / RECORDING_BUFFER_LIMIT) + 2 : 0;
+    }
+
+    void startRotation(Arguments& args) {
+        _chunk_time = args._chunk_time;
+        _chunk_size = args._chunk_size;
+        _rotation_started = (_chunk_time > 0 || _chunk_size > 0) && !_writer.inMemory() &&
+                            pthread_create(&_rotation_thread, NULL, rotationThreadEntry, this) == 0;
+    }
+
+    void stopRotation() {
+        _stopping = true;
+        if (_rotation_started) {
+            pthread_join(_rotation_thread, NULL);
+        }
+    }
+
+    static void* rotationThreadEntry(void* arg) {
+        // Resolving methods for the constant pool requires JVM TI calls
+        VM::attachThread("Async-profiler JFR rotation");
+        ((Recording*)arg)->rotationLoop();
+        VM::detachThread();
+        return NULL;
+    }
+
+    void rotationLoop() {
+        struct timespec interval = {0, 100000000};
+        while (!_stopping) {
+            nanosleep(&interval, NULL);
+            if (rotationDue()) {
+                rotateChunk();
+            }
+        }
+    }
+
+    bool rotationDue() {
+        return (_chunk_time > 0 && OS::nanotime() - _start_nanos >= (u64)_chunk_time) ||
+               (_chunk_size > 0 && lseek(_fd, 0, SEEK_CUR) - _chunk_start >= _chunk_size);
+    }
+
+    // Closes the current chunk and starts a new one while profiling goes on.
+    // Signal handlers are held off only to hand over their partially filled buffers.
+    // The writer thread is paused meanwhile, so that events recorded after the hand-off
+    // are written to the new chunk, after the constant pool of the current one.
+    void rotateChunk() {
+        _writer.pause();
+        if (!detachSlotBuffers()) {
+            _writer.resume();
+            return;
+        }
+        _writer.flush();
+
+        _cpu_monitor_lock.lock();
+        flushEvents(&_cpu_monitor_buf);
+        compressChunk(finishChunk());
+        startChunk(_stop_time, _stop_nanos);
+        flush(&_chunk_buf);
+        _cpu_monitor_lock.unlock();
+
+        _writer.resume();
+    }
+
+    bool detachSlotBuffers() {
+        PaddedSpinLock* locks = Profiler::_instance._locks;
+        for (int i = 0; i < _buf_count; i++) {
+            while (!locks[i].tryLock()) {
+                if (_stopping) {
+                    // Profiler::stop() holds the locks and waits for this thread
+                    while (--i >= 0) locks[i].unlock();
+                    return false;
+                }
+                spinPause();
+            }
+        }
+
+        // No events are being recorded now: this is the boundary between chunks
+        _stop_time = OS::millis();
+        _stop_nanos = OS::nanotime();
+
+        if (_aggregators != NULL) {
+            for (int i = 0; i < _buf_count; i++) {
+                flushAggregator(i, _stop_nanos);
+            }
+        }
+
+        for (int i = 0; i < _buf_count; i++) {
+            if (_buf[i]->offset() > 0) {
+                RecordingBuffer* spare = _writer.acquire();
+                if (spare != NULL) {
+                    _writer.submit(_buf[i]);
+                    _buf[i] = spare;
+                } else {
+                    flushEvents(_buf[i]);
+                }
+            }
+        }
+
+        for (int i = 0; i < _buf_count; i++) {
+            locks[i].unlock();
+        }
+        return true;
+    }
+
+    void startChunk(u64 start_time, u64 start_nanos) {
         _chunk_start = lseek(_fd, 0, SEEK_END);
-        _start_time = OS::millis();
-        _start_nanos = OS::nanotime();
+        _start_time = start_time;
+        _start_nanos = start_nanos;
+
+        writeHeader(&_chunk_buf);
+        writeMetadata(&_chunk_buf);
+    }
+
+    off_t finishChunk() {
+        Buffer* buf = &_chunk_buf;
+        off_t cpool_offset = lseek(_fd, 0, SEEK_CUR);
+        writeCpool(buf);
+        flush(buf);
+
+        off_t chunk_end = lseek(_fd, 0, SEEK_CUR);
+
+        // Patch cpool size field
+        buf->putVar32(0, chunk_end - cpool_offset);
+        ssize_t result = pwrite(_fd, buf->data(), 5, cpool_offset);
+        (void)result;
+
+        // Patch chunk header
+        buf->put64(chunk_end - _chunk_start);
+        buf->put64(cpool_offset - _chunk_start);
+        buf->put64(68);
+        buf->put64(_start_time * 1000000);
+        buf->put64(_stop_nanos - _start_nanos);
+        result = pwrite(_fd, buf->data(), 40, _chunk_start + 8);
+        (void)result;
+
+        buf->reset();
+        return chunk_end;
+    }
+
+    // Chunk headers are patched when a chunk ends, so chunks are staged uncompressed
+    // and deflated as a whole. Each chunk becomes a separate gzip member
+    void compressChunk(off_t chunk_end) {
+        if (_gzip_fd >= 0) {
+            if (!GzipWriter::compressFile(_fd, _chunk_start, chunk_end - _chunk_start, _gzip_fd)) {
+                Log::warn("Failed to write compressed JFR chunk");
+            }
+            if (ftruncate(_fd, 0) == 0) {
+                lseek(_fd, 0, SEEK_SET);
+            }
+        }
+    }
+
+    // The next constant pool repeats all entries, since it has to be self-contained
+    void forgetWritten() {
+        _written_traces.clear();
+        _written_classes.clear();
+        _written_packages.clear();
+        _written_symbols.clear();
+
+        _new_methods.clear();
+        for (u32 i = 0; i < _method_map.size(); i++) {
+            _new_methods.push_back(_method_map.at(i));
+        }
+    }
+
+  public:
+    Recording(int fd, int gzip_fd, Arguments& args) : _fd(fd), _gzip_fd(gzip_fd), _writer(fd, Profiler::_instance.concurrency_level() * 2 + ringBuffers(args)),
+                                         _chunk_buf(), _rotation_started(false), _stopping(false),
+                                         _thread_set(), _packages(), _symbols(), _method_map() {
+        // One buffer per sample slot of the Profiler, plus as many spares for the writer thread
+        _buf_count = Profiler::_instance.concurrency_level();
+        _buf = new RecordingBuffer*[_buf_count];
+        for (int i = 0; i < _buf_count; i++) {
+            _buf[i] = _writer.acquire();
+        }
+
         _tid = OS::threadId();
         addThread(_tid);
         VM::jvmti()->GetAvailableProcessors(&_available_processors);
 
-        writeHeader(_buf);
-        writeMetadata(_buf);
-        writeRecordingInfo(_buf);
-        writeSettings(_buf, args);
+        startChunk(OS::millis(), OS::nanotime());
+
+        _aggregators = NULL;
+        _slice_nanos = args._aggregate;
+        if (_slice_nanos > 0) {
+            _aggregators = new SampleAggregator[_buf_count];
+            for (int i = 0; i < _buf_count; i++) {
+                _aggregators[i].startSlice(_start_nanos);
+            }
+        }
+
+        Buffer* buf = &_chunk_buf;
+        writeRecordingInfo(buf);
+        writeSettings(buf, args);
         if (!args.hasOption(NO_SYSTEM_INFO)) {
-            writeOsCpuInfo(_buf);
-            writeJvmInfo(_buf);
+            writeOsCpuInfo(buf);
+            writeJvmInfo(buf);
         }
         if (!args.hasOption(NO_SYSTEM_PROPS)) {
-            writeSystemProperties(_buf);
+            writeSystemProperties(buf);
+        }
+        flush(buf);
+
+        if (args._blackbox > 0) {
+            _writer.keepInMemory(ringBuffers(args), args._blackbox, args._max_age);
+        }
+        if (!_writer.start()) {
+            Log::warn("Failed to start JFR writer thread, events may be dropped until the recording is flushed");
         }
-        flush(_buf);
 
         startCpuMonitor(!args.hasOption(NO_CPU_LOAD));
+
+        if (_writer.running()) {
+            startRotation(args);
+        }
     }
 
     ~Recording() {
+        stopRotation();
         stopCpuMonitor();
 
         _stop_nanos = OS::nanotime();
         _stop_time = OS::millis();
 
-        for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
-            flush(&_buf[i]);
+        // Slots are locked by Profiler::stop(), so pending counts can be written out
+        if (_aggregators != NULL) {
+            for (int i = 0; i < _buf_count; i++) {
+                flushAggregator(i, _stop_nanos);
+            }
         }
-        flush(&_cpu_monitor_buf);
 
-        off_t cpool_offset = lseek(_fd, 0, SEEK_CUR);
-        writeCpool(_buf);
-        flush(_buf);
+        // Buffers queued by signal handlers go first, then the partially filled ones
+        if (!_writer.stop()) {
+            Log::warn("JFR recording is incomplete: some events could not be written");
+        }
+        if (_writer.droppedEvents() > 0) {
+            Log::warn("JFR writer could not keep up, %lld events dropped", _writer.droppedEvents());
+        }
 
-        off_t chunk_end = lseek(_fd, 0, SEEK_CUR);
+        // Unless dumped, a memory mode recording is discarded
+        if (_fd >= 0) {
+            for (int i = 0; i < _buf_count; i++) {
+                flush(_buf[i]);
+            }
+            flush(&_cpu_monitor_buf);
 
-        // Patch cpool size field
-        _buf->putVar32(0, chunk_end - cpool_offset);
-        ssize_t result = pwrite(_fd, _buf->data(), 5, cpool_offset);
-        (void)result;
+            off_t chunk_end = finishChunk();
 
-        // Patch chunk header
-        _buf->put64(chunk_end - _chunk_start);
-        _buf->put64(cpool_offset - _chunk_start);
-        _buf->put64(68);
-        _buf->put64(_start_time * 1000000);
-        _buf->put64(_stop_nanos - _start_nanos);
-        result = pwrite(_fd, _buf->data(), 40, _chunk_start + 8);
-        (void)result;
+            if (_append_fd >= 0 && !OS::copyFile(_fd, _append_fd, 0, chunk_end)) {
+                Log::warn("Failed to append profiler recording: %s", strerror(errno));
+            }
 
-        if (_append_fd >= 0) {
-            OS::copyFile(_fd, _append_fd, 0, chunk_end);
+            if (_gzip_fd >= 0) {
+                compressChunk(chunk_end);
+                close(_gzip_fd);
+            }
+
+            close(_fd);
         }
 
-        close(_fd);
+        jvmtiEnv* jvmti = VM::jvmti();
+        for (u32 i = 0; i < _method_map.size(); i++) {
+            MethodInfo* mi = _method_map.at(i);
+            if (mi->_line_number_table != NULL) {
+                jvmti->Deallocate((unsigned char*)mi->_line_number_table);
+            }
+        }
+
+        delete[] _aggregators;
+        delete[] _buf;
+    }
+
+    bool inMemory() {
+        return _writer.inMemory();
+    }
+
+    // Writes the events retained in memory to fd as a standalone chunk.
+    // Like chunk rotation, this hands over partially filled slot buffers first,
+    // so that the constant pool covers every event in the dump.
+    bool dump(int fd) {
+        _writer.pause();
+        if (!detachSlotBuffers()) {
+            _writer.resume();
+            return false;
+        }
+
+        _cpu_monitor_lock.lock();
+        flushEvents(&_cpu_monitor_buf);
+        _writer.flush();
+
+        _fd = fd;
+        _chunk_start = 0;
+        bool success = write(fd, _prologue.data(), _prologue.size()) == (ssize_t)_prologue.size() &&
+                       _writer.writeRing(fd);
+        forgetWritten();
+        finishChunk();
+        _fd = -1;
+
+        _cpu_monitor_lock.unlock();
+        _writer.resume();
+        return success;
     }
 
     static void JNICALL appendRecording(JNIEnv* env, jclass cls, jstring file_name) {
@@ -386,8 +571,58 @@ class Recording {
         env->ReleaseStringUTFChars(file_name, file_name_str);
     }
 
+    // Returns NULL if the slot buffer is full and there is no spare one to switch to
     Buffer* buffer(int lock_index) {
-        return &_buf[lock_index];
+        RecordingBuffer* buf = _buf[lock_index];
+        if (buf->offset() >= RECORDING_BUFFER_LIMIT) {
+            RecordingBuffer* spare = _writer.acquire();
+            if (spare == NULL) {
+                _writer.drop();
+                return NULL;
+            }
+            _writer.submit(buf);
+            _buf[lock_index] = buf = spare;
+        }
+        return buf;
+    }
+
+    u64 droppedEvents() {
+        return _writer.droppedEvents();
+    }
+
+    bool aggregating() {
+        return _aggregators != NULL;
+    }
+
+    // Called under the slot lock instead of recording an ExecutionSample event
+    void aggregateExecutionSample(int lock_index, int tid, u32 call_trace_id, ExecutionEvent* event) {
+        SampleAggregator* agg = &_aggregators[lock_index];
+        u64 now = OS::nanotime();
+        if (now - agg->sliceStart() >= _slice_nanos) {
+            flushAggregator(lock_index, now);
+        }
+        if (!agg->add(tid, call_trace_id, event->_thread_state)) {
+            // Too many distinct keys: end the slice early
+            flushAggregator(lock_index, now);
+            agg->add(tid, call_trace_id, event->_thread_state);
+        }
+    }
+
+    void flushAggregator(int lock_index, u64 now) {
+        SampleAggregator* agg = &_aggregators[lock_index];
+        if (agg->size() > 0) {
+            for (int i = 0; i < AGGREGATOR_CAPACITY; i++) {
+                AggregatedSample* sample = agg->at(i);
+                if (sample->count > 0) {
+                    Buffer* buf = buffer(lock_index);
+                    if (buf != NULL) {
+                        recordAggregatedSample(buf, agg->sliceStart(), now, sample);
+                    }
+                }
+            }
+            agg->clear();
+        }
+        agg->startSlice(now);
     }
 
     void fillNativeMethodInfo(MethodInfo* mi, const char* name) {
@@ -452,6 +687,8 @@ class Recording {
         if (jvmti->GetLineNumberTable(method, &mi->_line_number_table_size, &mi->_line_number_table) != 0) {
             mi->_line_number_table_size = 0;
             mi->_line_number_table = NULL;
+        } else {
+            mi->sortLineNumberTable();
         }
 
         mi->_type = FRAME_INTERPRETED;
@@ -459,10 +696,11 @@ class Recording {
 
     MethodInfo* resolveMethod(ASGCT_CallFrame& frame) {
         jmethodID method = frame.method_id;
-        MethodInfo* mi = &_method_map[method];
+        MethodInfo* mi = _method_map.get(method);
 
         if (mi->_key == 0) {
             mi->_key = _method_map.size();
+            _new_methods.push_back(mi);
 
             if (method == NULL) {
                 fillNativeMethodInfo(mi, "unknown");
@@ -534,8 +772,32 @@ class Recording {
     }
 
     void flush(Buffer* buf) {
-        ssize_t result = write(_fd, buf->data(), buf->offset());
-        (void)result;
+        if (_fd >= 0) {
+            ssize_t result = write(_fd, buf->data(), buf->offset());
+            (void)result;
+        } else {
+            _prologue.append(buf->data(), buf->offset());
+        }
+        buf->reset();
+    }
+
+    // Events recorded outside signal handlers go to the file directly,
+    // or are copied to the writer's ring in memory mode
+    void flushEvents(Buffer* buf) {
+        if (!_writer.inMemory()) {
+            flush(buf);
+            return;
+        }
+
+        if (buf->offset() > 0) {
+            RecordingBuffer* copy = _writer.acquire();
+            if (copy != NULL) {
+                copy->put(buf->data(), buf->offset());
+                _writer.submit(copy);
+            } else {
+                _writer.drop();
+            }
+        }
         buf->reset();
     }
 
@@ -627,6 +889,19 @@ class Recording {
             writeIntSetting(buf, T_EXECUTION_SAMPLE, "interval", args._interval);
         }
 
+        writeBoolSetting(buf, T_AGGREGATED_SAMPLE, "enabled", args._event != NULL && args._aggregate > 0);
+        if (args._event != NULL && args._aggregate > 0) {
+            writeIntSetting(buf, T_AGGREGATED_SAMPLE, "slice", args._aggregate);
+        }
+
+        // Counters of a PerfCounters event follow the order of this list
+        writeBoolSetting(buf, T_PERF_COUNTERS, "enabled", args._event != NULL && args._group != NULL);
+        if (args._event != NULL && args._group != NULL) {
+            char counters[256];
+            snprintf(counters, sizeof(counters), "%s+%s", args._event, args._group);
+            writeStringSetting(buf, T_PERF_COUNTERS, "counters", counters);
+        }
+
         writeBoolSetting(buf, T_ALLOC_IN_NEW_TLAB, "enabled", args._alloc > 0);
         writeBoolSetting(buf, T_ALLOC_OUTSIDE_TLAB, "enabled", args._alloc > 0);
         if (args._alloc > 0) {
@@ -774,13 +1049,14 @@ class Recording {
 
     void writeFrameTypes(Buffer* buf) {
         buf->putVar32(T_FRAME_TYPE);
-        buf->putVar32(6);
+        buf->putVar32(7);
         buf->putVar32(FRAME_INTERPRETED);  buf->putUtf8("Interpreted");
         buf->putVar32(FRAME_JIT_COMPILED); buf->putUtf8("JIT compiled");
         buf->putVar32(FRAME_INLINED);      buf->putUtf8("Inlined");
         buf->putVar32(FRAME_NATIVE);       buf->putUtf8("Native");
         buf->putVar32(FRAME_CPP);          buf->putUtf8("C++");
         buf->putVar32(FRAME_KERNEL);       buf->putUtf8("Kernel");
+        buf->putVar32(FRAME_C1_COMPILED);  buf->putUtf8("C1 compiled");
     }
 
     void writeThreadStates(Buffer* buf) {
@@ -828,8 +1104,10 @@ class Recording {
     }
 
     void writeStackTraces(Buffer* buf) {
+        CallTraceStorage* storage = &Profiler::_instance._call_trace_storage;
         std::map<u32, CallTrace*> traces;
-        Profiler::_instance._call_trace_storage.collectTraces(traces);
+        storage->collectNewTraces(traces, _written_traces);
+        std::vector<ASGCT_CallFrame> frame_buf;
 
         buf->putVar32(T_STACK_TRACE);
         buf->putVar32(traces.size());
@@ -838,31 +1116,51 @@ class Recording {
             buf->putVar32(it->first);
             buf->putVar32(0);  // truncated
             buf->putVar32(trace->num_frames);
-            for (int i = 0; i < trace->num_frames; i++) {
-                MethodInfo* mi = resolveMethod(trace->frames[i]);
-                buf->putVar32(mi->_key);
-                jint bci = trace->frames[i].bci;
-                if (bci >= 0) {
-                    buf->putVar32(mi->getLineNumber(bci));
-                    buf->putVar32(bci);
-                } else {
-                    buf->put8(0);
-                    buf->put8(0);
+            if (trace->leaf != NULL) {
+                // Interned trace: walk the frame trie from the top frame
+                for (FrameNode* node = trace->leaf; node != NULL; node = node->parent) {
+                    writeFrame(buf, node->frame);
+                }
+            } else {
+                ASGCT_CallFrame* frames = storage->getFrames(trace, frame_buf);
+                for (int i = 0; i < trace->num_frames; i++) {
+                    writeFrame(buf, frames[i]);
                 }
-                buf->putVar32(mi->_type);
-                flushIfNeeded(buf);
             }
             flushIfNeeded(buf);
         }
     }
 
-    void writeMethods(Buffer* buf) {
-        jvmtiEnv* jvmti = VM::jvmti();
+    void writeFrame(Buffer* buf, ASGCT_CallFrame& frame) {
+        MethodInfo* mi = resolveMethod(frame);
+        buf->putVar32(mi->_key);
+        jint bci = frameBci(frame.bci);
+        if (bci >= 0) {
+            buf->putVar32(mi->getLineNumber(bci));
+            buf->putVar32(bci);
+        } else {
+            buf->put8(0);
+            buf->put8(0);
+        }
+        buf->putVar32(frameType(frameTier(frame.bci), mi->_type));
+        flushIfNeeded(buf);
+    }
+
+    static FrameTypeId frameType(FrameTier tier, FrameTypeId method_type) {
+        switch (tier) {
+            case TIER_INTERPRETED: return FRAME_INTERPRETED;
+            case TIER_C1:          return FRAME_C1_COMPILED;
+            case TIER_C2:          return FRAME_JIT_COMPILED;
+            case TIER_INLINED:     return FRAME_INLINED;
+            default:               return method_type;
+        }
+    }
 
+    void writeMethods(Buffer* buf) {
         buf->putVar32(T_METHOD);
-        buf->putVar32(_method_map.size());
-        for (std::map<jmethodID, MethodInfo>::const_iterator it = _method_map.begin(); it != _method_map.end(); ++it) {
-            const MethodInfo& mi = it->second;
+        buf->putVar32(_new_methods.size());
+        for (size_t i = 0; i < _new_methods.size(); i++) {
+            const MethodInfo& mi = *_new_methods[i];
             buf->putVar32(mi._key);
             buf->putVar32(mi._class);
             buf->putVar32(mi._name);
@@ -870,9 +1168,16 @@ class Recording {
             buf->putVar32(mi._modifiers);
             buf->putVar32(0);  // hidden
             flushIfNeeded(buf);
+        }
+        _new_methods.clear();
+    }
 
-            if (mi._line_number_table != NULL) {
-                jvmti->Deallocate((unsigned char*)mi._line_number_table);
+    static void removeWritten(std::map<u32, const char*>& map, std::vector<bool>& written) {
+        for (std::map<u32, const char*>::iterator it = map.begin(); it != map.end(); ) {
+            if (markWritten(written, it->first)) {
+                ++it;
+            } else {
+                map.erase(it++);
             }
         }
     }
@@ -880,6 +1185,7 @@ class Recording {
     void writeClasses(Buffer* buf) {
         std::map<u32, const char*> classes;
         Profiler::_instance.classMap()->collect(classes);
+        removeWritten(classes, _written_classes);
 
         buf->putVar32(T_CLASS);
         buf->putVar32(classes.size());
@@ -897,6 +1203,7 @@ class Recording {
     void writePackages(Buffer* buf) {
         std::map<u32, const char*> packages;
         _packages.collect(packages);
+        removeWritten(packages, _written_packages);
 
         buf->putVar32(T_PACKAGE);
         buf->putVar32(packages.size());
@@ -910,6 +1217,7 @@ class Recording {
     void writeSymbols(Buffer* buf) {
         std::map<u32, const char*> symbols;
         _symbols.collect(symbols);
+        removeWritten(symbols, _written_symbols);
 
         buf->putVar32(T_SYMBOL);
         buf->putVar32(symbols.size());
@@ -923,13 +1231,39 @@ class Recording {
     void recordExecutionSample(Buffer* buf, int tid, u32 call_trace_id, ExecutionEvent* event) {
         int start = buf->skip(1);
         buf->put8(T_EXECUTION_SAMPLE);
-        buf->putVar64(OS::nanotime());
+        buf->putVar64(event->_time != 0 ? event->_time : OS::nanotime());
         buf->putVar32(tid);
         buf->putVar32(call_trace_id);
         buf->putVar32(event->_thread_state);
         buf->put8(start, buf->offset() - start);
     }
 
+    void recordPerfCounters(Buffer* buf, int tid, u32 call_trace_id, ExecutionEvent* event, u64 counter) {
+        int start = buf->skip(1);
+        buf->put8(T_PERF_COUNTERS);
+        buf->putVar64(event->_time != 0 ? event->_time : OS::nanotime());
+        buf->putVar32(tid);
+        buf->putVar32(call_trace_id);
+        buf->putVar32(1 + event->_group_count);
+        buf->putVar64(counter);
+        for (int i = 0; i < event->_group_count; i++) {
+            buf->putVar64(event->_group[i]);
+        }
+        buf->put8(start, buf->offset() - start);
+    }
+
+    void recordAggregatedSample(Buffer* buf, u64 start_nanos, u64 end_nanos, AggregatedSample* sample) {
+        int start = buf->skip(1);
+        buf->put8(T_AGGREGATED_SAMPLE);
+        buf->putVar64(start_nanos);
+        buf->putVar64(end_nanos - start_nanos);
+        buf->putVar32(sample->tid);
+        buf->putVar32(sample->call_trace_id);
+        buf->putVar32(sample->thread_state);
+        buf->putVar32(sample->count);
+        buf->put8(start, buf->offset() - start);
+    }
+
     void recordAllocationInNewTLAB(Buffer* buf, int tid, u32 call_trace_id, AllocEvent* event) {
         int start = buf->skip(1);
         buf->put8(T_ALLOC_IN_NEW_TLAB);
@@ -978,6 +1312,35 @@ class Recording {
         buf->put8(start, buf->offset() - start);
     }
 
+    void recordGCPause(Buffer* buf, int tid, PauseEvent* event) {
+        int start = buf->skip(1);
+        buf->put8(T_GC_PAUSE);
+        buf->putVar64(event->_start_time);
+        buf->putVar64(event->_end_time - event->_start_time);
+        buf->putVar32(tid);
+        buf->putVar32(event->_id);
+        buf->putUtf8("GC Pause");
+        buf->put8(start, buf->offset() - start);
+    }
+
+    void recordSafepoint(Buffer* buf, int tid, PauseEvent* event) {
+        int start = buf->skip(1);
+        buf->put8(T_SAFEPOINT_BEGIN);
+        buf->putVar64(event->_start_time);
+        buf->putVar64(event->_end_time - event->_start_time);
+        buf->putVar32(tid);
+        buf->putVar64(event->_id);
+        buf->put8(start, buf->offset() - start);
+
+        start = buf->skip(1);
+        buf->put8(T_SAFEPOINT_SYNC);
+        buf->putVar64(event->_start_time);
+        buf->putVar64(event->_sync_time - event->_start_time);
+        buf->putVar32(tid);
+        buf->putVar64(event->_id);
+        buf->put8(start, buf->offset() - start);
+    }
+
     void recordCpuLoad(Buffer* buf, float proc_user, float proc_system, float machine_total) {
         int start = buf->skip(1);
         buf->put8(T_CPU_LOAD);
@@ -988,6 +1351,16 @@ class Recording {
         buf->put8(start, buf->offset() - start);
     }
 
+    void recordThreadCpuLoad(Buffer* buf, int tid, float user, float system) {
+        int start = buf->skip(1);
+        buf->put8(T_THREAD_CPU_LOAD);
+        buf->putVar64(OS::nanotime());
+        buf->putVar32(tid);
+        buf->putFloat(user);
+        buf->putFloat(system);
+        buf->put8(start, buf->offset() - start);
+    }
+
     void addThread(int tid) {
         if (!_thread_set.accept(tid)) {
             _thread_set.add(tid);
@@ -1004,35 +1377,117 @@ char* Recording::_jvm_flags = NULL;
 char* Recording::_java_command = NULL;
 
 
+static int createTempFile(const char* base) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.XXXXXX", base);
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
 Error FlightRecorder::start(Arguments& args, bool reset) {
+    if (args._blackbox > 0) {
+        if (args.hasOption(JFR_SYNC)) {
+            return Error("jfr=combine is not supported in blackbox mode");
+        }
+        _dropped_events = 0;
+        _rec = new Recording(-1, -1, args);
+        return Error::OK;
+    }
+
     if (args._file == NULL || args._file[0] == 0) {
         return Error("Flight Recorder output file is not specified");
     }
 
+    if (args._compress == COMPRESS_GZIP) {
+        if (args.hasOption(JFR_SYNC)) {
+            return Error("jfr=combine does not support compression");
+        } else if (!GzipWriter::available()) {
+            return Error("zlib is not available");
+        }
+    }
+
     if (args.hasOption(JFR_SYNC) && !loadJavaHelper()) {
         return Error("Could not load JFR combiner class");
     }
 
-    int fd = open(args._file, O_CREAT | O_RDWR | (reset ? O_TRUNC : 0), 0644);
-    if (fd == -1) {
-        return Error("Could not open Flight Recorder output file");
+    int fd;
+    int gzip_fd = -1;
+    if (args._compress == COMPRESS_GZIP) {
+        // gzip members can be concatenated, so resuming appends to the compressed file
+        gzip_fd = open(args._file, O_CREAT | O_WRONLY | (reset ? O_TRUNC : O_APPEND), 0644);
+        if (gzip_fd == -1) {
+            return Error("Could not open Flight Recorder output file");
+        }
+        fd = createTempFile(args._file);
+        if (fd == -1) {
+            close(gzip_fd);
+            return Error("Could not create Flight Recorder staging file");
+        }
+    } else {
+        fd = open(args._file, O_CREAT | O_RDWR | (reset ? O_TRUNC : 0), 0644);
+        if (fd == -1) {
+            return Error("Could not open Flight Recorder output file");
+        }
     }
 
     if (args.hasOption(JFR_TEMP_FILE)) {
         unlink(args._file);
     }
 
-    _rec = new Recording(fd, args);
+    _dropped_events = 0;
+    _rec = new Recording(fd, gzip_fd, args);
     return Error::OK;
 }
 
 void FlightRecorder::stop() {
     if (_rec != NULL) {
+        _dropped_events = _rec->droppedEvents();
         delete _rec;
         _rec = NULL;
     }
 }
 
+Error FlightRecorder::dump(Arguments& args) {
+    if (args._file == NULL || args._file[0] == 0) {
+        return Error("Flight Recorder output file is not specified");
+    }
+
+    if (args._compress == COMPRESS_GZIP && !GzipWriter::available()) {
+        return Error("zlib is not available");
+    }
+
+    int fd = open(args._file, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd == -1) {
+        return Error("Could not open Flight Recorder output file");
+    }
+
+    bool success;
+    if (args._compress == COMPRESS_GZIP) {
+        int temp_fd = createTempFile(args._file);
+        success = temp_fd >= 0 && _rec->dump(temp_fd) &&
+                  GzipWriter::compressFile(temp_fd, 0, lseek(temp_fd, 0, SEEK_END), fd);
+        if (temp_fd >= 0) {
+            close(temp_fd);
+        }
+    } else {
+        success = _rec->dump(fd);
+    }
+
+    close(fd);
+    return success ? Error::OK : Error("Failed to write Flight Recorder output file");
+}
+
+bool FlightRecorder::inMemory() {
+    return _rec != NULL && _rec->inMemory();
+}
+
+u64 FlightRecorder::droppedEvents() {
+    return _rec != NULL ? _rec->droppedEvents() : _dropped_events;
+}
+
 bool FlightRecorder::loadJavaHelper() {
     if (!_java_helper_loaded) {
         JNIEnv* jni = VM::jni();
@@ -1056,10 +1511,22 @@ bool FlightRecorder::loadJavaHelper() {
 void FlightRecorder::recordEvent(int lock_index, int tid, u32 call_trace_id,
                                  int event_type, Event* event, u64 counter) {
     if (_rec != NULL) {
+        if (event_type == 0 && _rec->aggregating()) {
+            _rec->aggregateExecutionSample(lock_index, tid, call_trace_id, (ExecutionEvent*)event);
+            _rec->addThread(tid);
+            return;
+        }
+
         Buffer* buf = _rec->buffer(lock_index);
+        if (buf == NULL) {
+            return;
+        }
         switch (event_type) {
             case 0:
                 _rec->recordExecutionSample(buf, tid, call_trace_id, (ExecutionEvent*)event);
+                if (((ExecutionEvent*)event)->_group_count > 0) {
+                    _rec->recordPerfCounters(buf, tid, call_trace_id, (ExecutionEvent*)event, counter);
+                }
                 break;
             case BCI_ALLOC:
                 _rec->recordAllocationInNewTLAB(buf, tid, call_trace_id, (AllocEvent*)event);
@@ -1074,7 +1541,21 @@ void FlightRecorder::recordEvent(int lock_index, int tid, u32 call_trace_id,
                 _rec->recordThreadPark(buf, tid, call_trace_id, (LockEvent*)event);
                 break;
         }
-        _rec->flushIfNeeded(buf);
+        _rec->addThread(tid);
+    }
+}
+
+void FlightRecorder::recordPause(int lock_index, int tid, PauseType type, PauseEvent* event) {
+    if (_rec != NULL) {
+        Buffer* buf = _rec->buffer(lock_index);
+        if (buf == NULL) {
+            return;
+        }
+        if (type == PAUSE_GC) {
+            _rec->recordGCPause(buf, tid, event);
+        } else {
+            _rec->recordSafepoint(buf, tid, event);
+        }
         _rec->addThread(tid);
     }
 }
@@ -27,22 +27,31 @@ class FlightRecorder {
   private:
     Recording* _rec;
     bool _java_helper_loaded;
+    u64 _dropped_events;
 
     bool loadJavaHelper();
 
   public:
-    FlightRecorder() : _rec(NULL), _java_helper_loaded(false) {
+    FlightRecorder() : _rec(NULL), _java_helper_loaded(false), _dropped_events(0) {
     }
 
     Error start(Arguments& args, bool reset);
     void stop();
 
+    // Blackbox mode: events are kept in memory until dumped
+    bool inMemory();
+    Error dump(Arguments& args);
+
     bool active() {
         return _rec != NULL;
     }
 
+    // Events discarded because the writer thread could not keep up
+    u64 droppedEvents();
+
     void recordEvent(int lock_index, int tid, u32 call_trace_id,
                      int event_type, Event* event, u64 counter);
+    void recordPause(int lock_index, int tid, PauseType type, PauseEvent* event);
 };
 
 #endif // _FLIGHTRECORDER_H
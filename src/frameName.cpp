@@ -143,7 +143,6 @@ char* FrameName::javaMethodName(jmethodID method) {
         strcat(result, ".");
         strcat(result, method_name);
         if (_style & STYLE_SIGNATURES) strcat(result, truncate(method_sig, 255));
-        if (_style & STYLE_ANNOTATE) strcat(result, "_[j]");
     } else {
         snprintf(_buf, sizeof(_buf) - 1, "[jvmtiError %d]", err);
         result = _buf;
@@ -204,6 +203,19 @@ char* FrameName::javaClassName(const char* symbol, int length, int style) {
     return result;
 }
 
+const char* FrameName::tierSuffix(FrameTier tier) {
+    switch (tier) {
+        case TIER_INTERPRETED:
+            return "_[0]";
+        case TIER_C1:
+            return "_[1]";
+        case TIER_INLINED:
+            return "_[i]";
+        default:
+            return "_[j]";
+    }
+}
+
 const char* FrameName::name(ASGCT_CallFrame& frame, bool for_matching) {
     if (frame.method_id == NULL) {
         return "[unknown]";
@@ -246,13 +258,15 @@ const char* FrameName::name(ASGCT_CallFrame& frame, bool for_matching) {
 
         default: {
             JMethodCache::iterator it = _cache.lower_bound(frame.method_id);
-            if (it != _cache.end() && it->first == frame.method_id) {
-                return it->second.c_str();
+            if (it == _cache.end() || it->first != frame.method_id) {
+                it = _cache.insert(it, JMethodCache::value_type(frame.method_id, javaMethodName(frame.method_id)));
             }
 
-            const char* newName = javaMethodName(frame.method_id);
-            _cache.insert(it, JMethodCache::value_type(frame.method_id, newName));
-            return newName;
+            if (for_matching || !(_style & STYLE_ANNOTATE)) {
+                return it->second.c_str();
+            }
+            snprintf(_buf, sizeof(_buf) - 1, "%s%s", it->second.c_str(), tierSuffix(frameTier(frame.bci)));
+            return _buf;
         }
     }
 }
@@ -23,6 +23,7 @@
 #include <vector>
 #include <string>
 #include "arguments.h"
+#include "compiledMethods.h"
 #include "mutex.h"
 #include "vmEntry.h"
 
@@ -77,6 +78,7 @@ class FrameName {
     char* truncate(char* name, int max_length);
     const char* cppDemangle(const char* name);
     char* javaMethodName(jmethodID method);
+    static const char* tierSuffix(FrameTier tier);
     char* javaClassName(const char* symbol, int length, int style);
 
   public:
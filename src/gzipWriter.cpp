@@ -0,0 +1,204 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "gzipWriter.h"
+
+
+const int Z_NO_FLUSH = 0;
+const int Z_FINISH = 4;
+const int Z_STREAM_END = 1;
+const int Z_STREAM_ERROR = -2;
+const int Z_DEFLATED = 8;
+const int Z_DEFAULT_STRATEGY = 0;
+const int Z_LEVEL = 6;
+const int Z_MEM_LEVEL = 8;
+// 15-bit window with gzip header and trailer
+const int Z_GZIP_WINDOW_BITS = 15 + 16;
+
+const size_t GZIP_OUT_SIZE = 256 * 1024;
+
+#ifdef __APPLE__
+static const char ZLIB_NAME[] = "libz.1.dylib";
+#else
+static const char ZLIB_NAME[] = "libz.so.1";
+#endif
+
+static const char* (*_zlibVersion)();
+static int (*_deflateInit2_)(ZStream* strm, int level, int method, int window_bits,
+                             int mem_level, int strategy, const char* version, int stream_size);
+static int (*_deflate)(ZStream* strm, int flush);
+static int (*_deflateEnd)(ZStream* strm);
+
+static bool loadZlib() {
+    void* lib = dlopen(ZLIB_NAME, RTLD_LAZY);
+    if (lib == NULL) {
+        return false;
+    }
+
+    _zlibVersion = (const char* (*)())dlsym(lib, "zlibVersion");
+    _deflateInit2_ = (int (*)(ZStream*, int, int, int, int, int, const char*, int))dlsym(lib, "deflateInit2_");
+    _deflate = (int (*)(ZStream*, int))dlsym(lib, "deflate");
+    _deflateEnd = (int (*)(ZStream*))dlsym(lib, "deflateEnd");
+    return _zlibVersion != NULL && _deflateInit2_ != NULL && _deflate != NULL && _deflateEnd != NULL;
+}
+
+static bool writeFully(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t bytes = ::write(fd, data, size);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += bytes;
+        size -= (size_t)bytes;
+    }
+    return true;
+}
+
+
+bool GzipWriter::available() {
+    static bool loaded = loadZlib();
+    return loaded;
+}
+
+GzipWriter::GzipWriter(int fd) : _fd(fd), _ok(false), _strm(), _out(NULL) {
+    if (available() && _deflateInit2_(&_strm, Z_LEVEL, Z_DEFLATED, Z_GZIP_WINDOW_BITS, Z_MEM_LEVEL,
+                                      Z_DEFAULT_STRATEGY, _zlibVersion(), sizeof(ZStream)) == 0) {
+        _out = (unsigned char*)malloc(GZIP_OUT_SIZE);
+        _ok = _out != NULL;
+        if (!_ok) {
+            _deflateEnd(&_strm);
+        }
+    }
+}
+
+GzipWriter::~GzipWriter() {
+    if (_ok) {
+        _deflateEnd(&_strm);
+    }
+    free(_out);
+}
+
+bool GzipWriter::deflateData(const void* data, size_t size, int flush) {
+    _strm.next_in = (const unsigned char*)data;
+    _strm.avail_in = (unsigned int)size;
+
+    int result;
+    do {
+        _strm.next_out = _out;
+        _strm.avail_out = GZIP_OUT_SIZE;
+        result = _deflate(&_strm, flush);
+        if (result == Z_STREAM_ERROR || !writeFully(_fd, _out, GZIP_OUT_SIZE - _strm.avail_out)) {
+            return false;
+        }
+    } while (_strm.avail_out == 0);
+
+    return flush != Z_FINISH || result == Z_STREAM_END;
+}
+
+bool GzipWriter::write(const void* data, size_t size) {
+    // avail_in is 32-bit
+    const size_t max_step = 1 << 30;
+    while (_ok && size > max_step) {
+        _ok = deflateData(data, max_step, Z_NO_FLUSH);
+        data = (const char*)data + max_step;
+        size -= max_step;
+    }
+    return _ok && (_ok = deflateData(data, size, Z_NO_FLUSH));
+}
+
+bool GzipWriter::finish() {
+    if (!_ok) {
+        return false;
+    }
+    bool success = deflateData(NULL, 0, Z_FINISH);
+    _deflateEnd(&_strm);
+    _ok = false;
+    return success;
+}
+
+bool GzipWriter::compressFile(int src_fd, off_t offset, size_t size, int dst_fd) {
+    GzipWriter writer(dst_fd);
+    char* buf = (char*)malloc(GZIP_OUT_SIZE);
+    if (buf == NULL) {
+        return false;
+    }
+
+    while (size > 0) {
+        ssize_t bytes = pread(src_fd, buf, size < GZIP_OUT_SIZE ? size : GZIP_OUT_SIZE, offset);
+        if (bytes <= 0 || !writer.write(buf, bytes)) {
+            break;
+        }
+        offset += bytes;
+        size -= (size_t)bytes;
+    }
+
+    free(buf);
+    return writer.finish() && size == 0;
+}
+
+
+bool GzipStreamBuf::flushBuffer() {
+    size_t size = pptr() - pbase();
+    setp(_buf, _buf + sizeof(_buf));
+    return size == 0 || _writer.write(_buf, size);
+}
+
+GzipStreamBuf::int_type GzipStreamBuf::overflow(int_type c) {
+    if (!flushBuffer()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int GzipStreamBuf::sync() {
+    return flushBuffer() ? 0 : -1;
+}
+
+
+GzipOutputStream::GzipOutputStream(const char* file) : std::ostream(NULL), _buf(NULL) {
+    _fd = GzipWriter::available() ? open(file, O_CREAT | O_WRONLY | O_TRUNC, 0644) : -1;
+    if (_fd >= 0) {
+        _buf = new GzipStreamBuf(_fd);
+        rdbuf(_buf);
+    }
+}
+
+GzipOutputStream::~GzipOutputStream() {
+    close();
+}
+
+void GzipOutputStream::close() {
+    if (_buf != NULL) {
+        if (!_buf->finish()) {
+            setstate(std::ios::badbit);
+        }
+        rdbuf(NULL);
+        delete _buf;
+        _buf = NULL;
+        ::close(_fd);
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _GZIPWRITER_H
+#define _GZIPWRITER_H
+
+#include <ostream>
+#include <sys/types.h>
+
+
+// The subset of zlib's z_stream used by deflate. Its layout has been stable
+// since zlib 1.0, so the agent needs neither zlib headers nor a link-time dependency
+struct ZStream {
+    const unsigned char* next_in;
+    unsigned int avail_in;
+    unsigned long total_in;
+    unsigned char* next_out;
+    unsigned int avail_out;
+    unsigned long total_out;
+    const char* msg;
+    void* state;
+    void* zalloc;
+    void* zfree;
+    void* opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+};
+
+// Streams data to a file descriptor in gzip format.
+// zlib is loaded at runtime; available() tells if it has been found.
+class GzipWriter {
+  private:
+    int _fd;
+    bool _ok;
+    ZStream _strm;
+    unsigned char* _out;
+
+    bool deflateData(const void* data, size_t size, int flush);
+
+  public:
+    static bool available();
+
+    GzipWriter(int fd);
+    ~GzipWriter();
+
+    bool write(const void* data, size_t size);
+    // Writes the gzip trailer; the writer cannot be used afterwards
+    bool finish();
+
+    // Appends size bytes of src_fd starting at offset to dst_fd as a separate gzip member.
+    // Concatenated members decompress to the concatenated input
+    static bool compressFile(int src_fd, off_t offset, size_t size, int dst_fd);
+};
+
+class GzipStreamBuf : public std::streambuf {
+  private:
+    GzipWriter _writer;
+    char _buf[65536];
+
+    bool flushBuffer();
+
+  protected:
+    int_type overflow(int_type c);
+    int sync();
+
+  public:
+    GzipStreamBuf(int fd) : _writer(fd) {
+        setp(_buf, _buf + sizeof(_buf));
+    }
+
+    bool finish() {
+        return flushBuffer() && _writer.finish();
+    }
+};
+
+// Text outputs of Profiler::dump written to a gzip-compressed file
+class GzipOutputStream : public std::ostream {
+  private:
+    int _fd;
+    GzipStreamBuf* _buf;
+
+  public:
+    GzipOutputStream(const char* file);
+    ~GzipOutputStream();
+
+    bool is_open() {
+        return _buf != NULL;
+    }
+
+    void close();
+};
+
+#endif // _GZIPWRITER_H
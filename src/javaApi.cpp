@@ -20,6 +20,7 @@
 #include <string.h>
 #include "javaApi.h"
 #include "arguments.h"
+#include "gzipWriter.h"
 #include "os.h"
 #include "profiler.h"
 #include "vmStructs.h"
@@ -73,6 +74,17 @@ Java_one_profiler_AsyncProfiler_execute0(JNIEnv* env, jobject unused, jstring co
         if (!error) {
             return env->NewStringUTF(out.str().c_str());
         }
+    } else if (args._compress == COMPRESS_GZIP) {
+        GzipOutputStream out(args._file);
+        if (!out.is_open()) {
+            JavaAPI::throwNew(env, "java/io/IOException", GzipWriter::available() ? strerror(errno) : "zlib is not available");
+            return NULL;
+        }
+        error = Profiler::_instance.runInternal(args, out);
+        out.close();
+        if (!error) {
+            return env->NewStringUTF("OK");
+        }
     } else {
         std::ofstream out(args._file, std::ios::out | std::ios::trunc);
         if (!out.is_open()) {
@@ -89,6 +89,22 @@ JfrMetadata::JfrMetadata() : Element("root") {
                 << field("stackTrace", T_STACK_TRACE, "Stack Trace", F_CPOOL)
                 << field("state", T_THREAD_STATE, "Thread State", F_CPOOL))
 
+            << (type("profiler.AggregatedSample", T_AGGREGATED_SAMPLE, "Aggregated Profiling Samples")
+                << category("Java Virtual Machine", "Profiling")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                << field("sampledThread", T_THREAD, "Thread", F_CPOOL)
+                << field("stackTrace", T_STACK_TRACE, "Stack Trace", F_CPOOL)
+                << field("state", T_THREAD_STATE, "Thread State", F_CPOOL)
+                << field("samples", T_INT, "Samples", F_UNSIGNED))
+
+            << (type("profiler.PerfCounters", T_PERF_COUNTERS, "Perf Event Counters")
+                << category("Java Virtual Machine", "Profiling")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("sampledThread", T_THREAD, "Thread", F_CPOOL)
+                << field("stackTrace", T_STACK_TRACE, "Stack Trace", F_CPOOL)
+                << field("counters", T_LONG, "Counters", F_ARRAY))
+
             << (type("jdk.ObjectAllocationInNewTLAB", T_ALLOC_IN_NEW_TLAB, "Allocation in new TLAB")
                 << category("Java Application")
                 << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
@@ -132,6 +148,35 @@ JfrMetadata::JfrMetadata() : Element("root") {
                 << field("jvmSystem", T_FLOAT, "JVM System", F_PERCENTAGE)
                 << field("machineTotal", T_FLOAT, "Machine Total", F_PERCENTAGE))
 
+            << (type("jdk.GCPhasePause", T_GC_PAUSE, "GC Pause")
+                << category("Java Virtual Machine", "GC")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                << field("eventThread", T_THREAD, "Event Thread", F_CPOOL)
+                << field("gcId", T_INT, "GC Identifier", F_UNSIGNED)
+                << field("name", T_STRING, "Name"))
+
+            << (type("jdk.SafepointBegin", T_SAFEPOINT_BEGIN, "Safepoint Begin")
+                << category("Java Virtual Machine", "Runtime")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                << field("eventThread", T_THREAD, "Event Thread", F_CPOOL)
+                << field("safepointId", T_LONG, "Safepoint Identifier", F_UNSIGNED))
+
+            << (type("jdk.SafepointStateSynchronization", T_SAFEPOINT_SYNC, "Safepoint State Synchronization")
+                << category("Java Virtual Machine", "Runtime")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("duration", T_LONG, "Duration", F_DURATION_TICKS)
+                << field("eventThread", T_THREAD, "Event Thread", F_CPOOL)
+                << field("safepointId", T_LONG, "Safepoint Identifier", F_UNSIGNED))
+
+            << (type("jdk.ThreadCPULoad", T_THREAD_CPU_LOAD, "Thread CPU Load")
+                << category("Operating System", "Processor")
+                << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
+                << field("eventThread", T_THREAD, "Event Thread", F_CPOOL)
+                << field("user", T_FLOAT, "User Mode CPU Load", F_PERCENTAGE)
+                << field("system", T_FLOAT, "System Mode CPU Load", F_PERCENTAGE))
+
             << (type("jdk.ActiveRecording", T_ACTIVE_RECORDING, "Flight Recording")
                 << category("Flight Recorder")
                 << field("startTime", T_LONG, "Start Time", F_TIME_TICKS)
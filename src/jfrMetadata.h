@@ -62,6 +62,12 @@ enum JfrType {
     T_CPU_INFORMATION = 110,
     T_JVM_INFORMATION = 111,
     T_INITIAL_SYSTEM_PROPERTY = 112,
+    T_AGGREGATED_SAMPLE = 113,
+    T_THREAD_CPU_LOAD = 114,
+    T_GC_PAUSE = 115,
+    T_SAFEPOINT_BEGIN = 116,
+    T_SAFEPOINT_SYNC = 117,
+    T_PERF_COUNTERS = 118,
 
     T_ANNOTATION = 200,
     T_LABEL = 201,
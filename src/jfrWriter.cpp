@@ -0,0 +1,301 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+#include "jfrWriter.h"
+#include "log.h"
+#include "os.h"
+
+
+JfrWriter::JfrWriter(int fd, int pool_size) : _fd(fd), _pool_size(pool_size), _write_lock() {
+    _pool = new RecordingBuffer[pool_size];
+    _next = new u32[pool_size];
+    _free_head = 0;
+    _full_head = 0;
+    _dropped = 0;
+    _write_error = 0;
+    _running = false;
+    _ring_capacity = 0;
+    _ring_max_bytes = 0;
+    _ring_bytes = 0;
+    _max_age = 0;
+    _ring_head = 0;
+    _ring_tail = 0;
+    _ring_count = 0;
+    _ring_time = NULL;
+    _wakeup[0] = _wakeup[1] = -1;
+
+    for (int i = pool_size - 1; i >= 0; i--) {
+        _next[i] = (u32)_free_head;
+        _free_head = i + 1;
+    }
+}
+
+JfrWriter::~JfrWriter() {
+    delete[] _ring_time;
+    delete[] _next;
+    delete[] _pool;
+}
+
+void JfrWriter::keepInMemory(int capacity, u64 max_bytes, u64 max_age) {
+    _ring_capacity = capacity;
+    _ring_max_bytes = max_bytes;
+    _max_age = max_age;
+    _ring_time = new u64[_pool_size];
+}
+
+bool JfrWriter::start() {
+    if (pipe(_wakeup) != 0) {
+        return false;
+    }
+    // Signal handlers must never block on a full pipe
+    fcntl(_wakeup[1], F_SETFL, O_NONBLOCK);
+
+    _running = true;
+    if (pthread_create(&_thread, NULL, threadEntry, this) != 0) {
+        _running = false;
+        close(_wakeup[0]);
+        close(_wakeup[1]);
+        return false;
+    }
+    return true;
+}
+
+// Writes all submitted buffers before returning
+bool JfrWriter::stop() {
+    if (_running) {
+        _running = false;
+        char c = 0;
+        ssize_t result = write(_wakeup[1], &c, 1);
+        (void)result;
+        pthread_join(_thread, NULL);
+
+        close(_wakeup[0]);
+        close(_wakeup[1]);
+    }
+    writeBatch(takeAll());
+    return _write_error == 0;
+}
+
+void JfrWriter::pause() {
+    _write_lock.lock();
+}
+
+bool JfrWriter::flush() {
+    writeBatch(takeAll());
+    return _write_error == 0;
+}
+
+void JfrWriter::resume() {
+    if (!_running) {
+        writeBatch(takeAll());
+    }
+    _write_lock.unlock();
+    if (_running && _full_head != 0) {
+        char c = 1;
+        ssize_t result = write(_wakeup[1], &c, 1);
+        (void)result;
+    }
+}
+
+// Called from signal handlers: gets a spare buffer or NULL if the pool is exhausted
+RecordingBuffer* JfrWriter::acquire() {
+    while (true) {
+        u64 head = _free_head;
+        u32 index = (u32)head;
+        if (index == 0) {
+            return NULL;
+        }
+        u64 new_head = ((head >> 32) + 1) << 32 | _next[index - 1];
+        if (__sync_bool_compare_and_swap(&_free_head, head, new_head)) {
+            return &_pool[index - 1];
+        }
+    }
+}
+
+void JfrWriter::release(RecordingBuffer* buf) {
+    u32 index = indexOf(buf) + 1;
+    while (true) {
+        u64 head = _free_head;
+        _next[index - 1] = (u32)head;
+        u64 new_head = ((head >> 32) + 1) << 32 | index;
+        if (__sync_bool_compare_and_swap(&_free_head, head, new_head)) {
+            return;
+        }
+    }
+}
+
+// Called from signal handlers: queues a full buffer for writing and wakes up the writer
+void JfrWriter::submit(RecordingBuffer* buf) {
+    u32 index = indexOf(buf) + 1;
+    while (true) {
+        u32 head = _full_head;
+        _next[index - 1] = head;
+        if (__sync_bool_compare_and_swap(&_full_head, head, index)) {
+            break;
+        }
+    }
+
+    // Without a writer thread, the buffer stays queued until flush() or stop():
+    // writing here would race with them, and the recursive lock cannot stop
+    // a handler that interrupted the same thread in the middle of a write
+    if (_running) {
+        char c = 1;
+        ssize_t result = write(_wakeup[1], &c, 1);
+        (void)result;
+    }
+}
+
+// Detaches the whole list of submitted buffers. The list is pushed in LIFO order,
+// so reverse it to write buffers in the order they were submitted.
+u32 JfrWriter::takeAll() {
+    u32 list = __sync_lock_test_and_set(&_full_head, 0);
+    u32 reversed = 0;
+    while (list != 0) {
+        u32 next = _next[list - 1];
+        _next[list - 1] = reversed;
+        reversed = list;
+        list = next;
+    }
+    return reversed;
+}
+
+void JfrWriter::writeBatch(u32 list) {
+    if (_ring_capacity > 0) {
+        keepBatch(list);
+    } else {
+        int err = writeList(_fd, list, true);
+        if (err != 0 && __sync_bool_compare_and_swap(&_write_error, 0, err)) {
+            Log::warn("Failed to write JFR recording: %s", strerror(err));
+        }
+    }
+}
+
+// Appends submitted buffers to the ring and evicts the oldest ones beyond the limits
+void JfrWriter::keepBatch(u32 list) {
+    u64 now = OS::nanotime();
+    while (list != 0) {
+        u32 next = _next[list - 1];
+        RecordingBuffer* buf = &_pool[list - 1];
+        _ring_bytes += buf->offset();
+
+        RecordingBuffer* tail = _ring_tail != 0 ? &_pool[_ring_tail - 1] : NULL;
+        if (tail != NULL && tail->offset() + buf->offset() <= RECORDING_BUFFER_LIMIT) {
+            // Buffers hold whole events, so they can be concatenated
+            tail->put(buf->data(), buf->offset());
+            _ring_time[_ring_tail - 1] = now;
+            buf->reset();
+            release(buf);
+            list = next;
+            continue;
+        }
+
+        _next[list - 1] = 0;
+        _ring_time[list - 1] = now;
+        if (_ring_tail != 0) {
+            _next[_ring_tail - 1] = list;
+        } else {
+            _ring_head = list;
+        }
+        _ring_tail = list;
+        _ring_count++;
+        list = next;
+    }
+    trimRing(now);
+}
+
+void JfrWriter::trimRing(u64 now) {
+    while (_ring_head != 0 && (_ring_count > _ring_capacity || _ring_bytes > _ring_max_bytes ||
+                               (_max_age > 0 && now - _ring_time[_ring_head - 1] > _max_age))) {
+        RecordingBuffer* buf = &_pool[_ring_head - 1];
+        _ring_bytes -= buf->offset();
+        _ring_head = _next[_ring_head - 1];
+        if (_ring_head == 0) {
+            _ring_tail = 0;
+        }
+        _ring_count--;
+        buf->reset();
+        release(buf);
+    }
+}
+
+bool JfrWriter::writeRing(int fd) {
+    trimRing(OS::nanotime());
+    return writeList(fd, _ring_head, false) == 0;
+}
+
+// Returns 0 on success, or errno of the first failed write. Buffers are recycled anyway
+int JfrWriter::writeList(int fd, u32 list, bool recycle) {
+    struct iovec iov[MAX_WRITE_BATCH];
+    RecordingBuffer* bufs[MAX_WRITE_BATCH];
+    int error = 0;
+
+    while (list != 0) {
+        int count = 0;
+        for (; list != 0 && count < MAX_WRITE_BATCH; list = _next[list - 1]) {
+            bufs[count] = &_pool[list - 1];
+            iov[count].iov_base = (void*)bufs[count]->data();
+            iov[count].iov_len = bufs[count]->offset();
+            count++;
+        }
+
+        // Resume after partial writes until the whole batch is on disk
+        struct iovec* v = iov;
+        int remaining = count;
+        while (remaining > 0) {
+            ssize_t bytes = writev(fd, v, remaining);
+            if (bytes < 0) {
+                if (errno == EINTR) continue;
+                if (error == 0) error = errno;
+                break;
+            }
+            while (remaining > 0 && (size_t)bytes >= v->iov_len) {
+                bytes -= v->iov_len;
+                v++;
+                remaining--;
+            }
+            if (remaining > 0) {
+                v->iov_base = (char*)v->iov_base + bytes;
+                v->iov_len -= bytes;
+            }
+        }
+
+        if (recycle) {
+            for (int i = 0; i < count; i++) {
+                bufs[i]->reset();
+                release(bufs[i]);
+            }
+        }
+    }
+
+    return error;
+}
+
+void JfrWriter::writerLoop() {
+    char signals[256];
+    while (_running) {
+        ssize_t result = read(_wakeup[0], signals, sizeof(signals));
+        if (result < 0 && errno != EINTR) {
+            break;
+        }
+        MutexLocker ml(_write_lock);
+        writeBatch(takeAll());
+    }
+}
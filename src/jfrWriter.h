@@ -0,0 +1,124 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _JFRWRITER_H
+#define _JFRWRITER_H
+
+#include <pthread.h>
+#include "arch.h"
+#include "jfrBuffer.h"
+#include "mutex.h"
+
+
+const int MAX_WRITE_BATCH = 64;
+
+// Moves JFR file I/O out of signal handlers. Full recording buffers are pushed
+// onto a lock-free list and written by a dedicated thread in batches with writev.
+// Written buffers are recycled through a lock-free pool of spares.
+// When the writer falls behind and the pool is empty, events are dropped
+// rather than blocking the application thread.
+//
+// In memory mode, nothing is written: submitted buffers are appended to a ring
+// that retains at most a given number of bytes of the most recent events, optionally
+// no older than a given age, until writeRing() materializes them into a file.
+// Partially filled buffers are packed into the ring tail, so that the ring
+// does not run out of buffers before reaching its size in bytes.
+class JfrWriter {
+  private:
+    int _fd;
+    int _pool_size;
+    RecordingBuffer* _pool;
+    // Lists link buffers by index + 1, so that 0 means empty
+    u32* _next;
+    // Free list head carries a modification tag in the upper half to avoid ABA
+    volatile u64 _free_head;
+    volatile u32 _full_head;
+    volatile u64 _dropped;
+    // The first error of writing to the recording file, kept until the recording stops
+    volatile int _write_error;
+    volatile bool _running;
+    // Ring of retained buffers in memory mode, linked from the oldest one
+    int _ring_capacity;
+    u64 _ring_max_bytes;
+    u64 _ring_bytes;
+    u64 _max_age;
+    u32 _ring_head;
+    u32 _ring_tail;
+    int _ring_count;
+    u64* _ring_time;
+    Mutex _write_lock;
+    int _wakeup[2];
+    pthread_t _thread;
+
+    int indexOf(RecordingBuffer* buf) {
+        return (int)(buf - _pool);
+    }
+
+    u32 takeAll();
+    void writeBatch(u32 list);
+    void keepBatch(u32 list);
+    void trimRing(u64 now);
+    int writeList(int fd, u32 list, bool recycle);
+    void writerLoop();
+
+    static void* threadEntry(void* writer) {
+        ((JfrWriter*)writer)->writerLoop();
+        return NULL;
+    }
+
+  public:
+    JfrWriter(int fd, int pool_size);
+    ~JfrWriter();
+
+    // Switches to memory mode; must be called before start().
+    // capacity limits the number of buffers, so that spare ones remain for signal handlers
+    void keepInMemory(int capacity, u64 max_bytes, u64 max_age);
+
+    bool start();
+    // Returns false if any buffer could not be written to the recording file
+    bool stop();
+
+    // While paused, submitted buffers stay queued until flush() or resume(),
+    // so that the caller can write to the file in between
+    void pause();
+    bool flush();
+    void resume();
+
+    // Writes retained buffers to fd, oldest first, without releasing them.
+    // Must be called while paused
+    bool writeRing(int fd);
+
+    RecordingBuffer* acquire();
+    void release(RecordingBuffer* buf);
+    void submit(RecordingBuffer* buf);
+
+    bool inMemory() {
+        return _ring_capacity > 0;
+    }
+
+    bool running() {
+        return _running;
+    }
+
+    void drop() {
+        atomicInc(_dropped);
+    }
+
+    u64 droppedEvents() {
+        return _dropped;
+    }
+};
+
+#endif // _JFRWRITER_H
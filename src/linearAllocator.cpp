@@ -18,7 +18,8 @@
 #include "os.h"
 
 
-LinearAllocator::LinearAllocator(size_t chunk_size) {
+LinearAllocator::LinearAllocator(size_t chunk_size, volatile u64* memory_counter) :
+    _free(NULL), _free_lock(), _used_memory(0), _memory_counter(memory_counter) {
     _chunk_size = chunk_size;
     _reserve = _tail = allocateChunk(NULL);
 }
@@ -39,6 +40,27 @@ void LinearAllocator::clear() {
     }
     _reserve = _tail;
     _tail->offs = sizeof(Chunk);
+
+    while (_free != NULL) {
+        Chunk* current = _free;
+        _free = _free->prev;
+        freeChunk(current);
+    }
+}
+
+// Unlike clear(), keeps all chunks for subsequent allocations.
+// Must not be called concurrently with alloc().
+void LinearAllocator::reset() {
+    if (_reserve->prev == _tail) {
+        recycleChunk(_reserve);
+    }
+    while (_tail->prev != NULL) {
+        Chunk* current = _tail;
+        _tail = _tail->prev;
+        recycleChunk(current);
+    }
+    _reserve = _tail;
+    _tail->offs = sizeof(Chunk);
 }
 
 void* LinearAllocator::alloc(size_t size) {
@@ -61,7 +83,20 @@ void* LinearAllocator::alloc(size_t size) {
 }
 
 Chunk* LinearAllocator::allocateChunk(Chunk* current) {
-    Chunk* chunk = (Chunk*)OS::safeAlloc(_chunk_size);
+    Chunk* chunk = NULL;
+
+    // Prefer a recycled chunk. Do not wait for the lock, since we may be inside a signal handler
+    if (_free != NULL && _free_lock.tryLock()) {
+        if ((chunk = _free) != NULL) {
+            _free = chunk->prev;
+        }
+        _free_lock.unlock();
+    }
+
+    if (chunk == NULL && (chunk = (Chunk*)OS::safeAlloc(_chunk_size)) != NULL) {
+        __sync_fetch_and_add(&_used_memory, _chunk_size);
+        if (_memory_counter != NULL) atomicInc(*_memory_counter, _chunk_size);
+    }
     if (chunk != NULL) {
         chunk->prev = current;
         chunk->offs = sizeof(Chunk);
@@ -71,6 +106,13 @@ Chunk* LinearAllocator::allocateChunk(Chunk* current) {
 
 void LinearAllocator::freeChunk(Chunk* current) {
     OS::safeFree(current, _chunk_size);
+    __sync_fetch_and_sub(&_used_memory, _chunk_size);
+    if (_memory_counter != NULL) atomicInc(*_memory_counter, -(u64)_chunk_size);
+}
+
+void LinearAllocator::recycleChunk(Chunk* current) {
+    current->prev = _free;
+    _free = current;
 }
 
 void LinearAllocator::reserveChunk(Chunk* current) {
@@ -18,6 +18,7 @@
 #define _LINEARALLOCATOR_H
 
 #include <stddef.h>
+#include "spinLock.h"
 
 
 struct Chunk {
@@ -32,19 +33,31 @@ class LinearAllocator {
     size_t _chunk_size;
     Chunk* _tail;
     Chunk* _reserve;
+    Chunk* _free;
+    SpinLock _free_lock;
+    volatile size_t _used_memory;
+    // Optional counter shared with other allocations of the owner
+    volatile u64* _memory_counter;
 
     Chunk* allocateChunk(Chunk* current);
     void freeChunk(Chunk* current);
+    void recycleChunk(Chunk* current);
     void reserveChunk(Chunk* current);
     Chunk* getNextChunk(Chunk* current);
 
   public:
-    LinearAllocator(size_t chunk_size);
+    LinearAllocator(size_t chunk_size, volatile u64* memory_counter = NULL);
     ~LinearAllocator();
 
     void clear();
+    void reset();
 
     void* alloc(size_t size);
+
+    // Total size of chunks held by the allocator, including recycled ones
+    size_t usedMemory() {
+        return _used_memory;
+    }
 };
 
 #endif // _LINEARALLOCATOR_H
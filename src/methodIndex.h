@@ -0,0 +1,109 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _METHODINDEX_H
+#define _METHODINDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "arch.h"
+#include "os.h"
+#include "vmEntry.h"
+
+
+// Maps method_id pointers to 32-bit indices; safe to use inside signal handler.
+// Index 0 stands for NULL; otherwise, index - 1 is the slot in the open addressing table.
+// The table is never resized, so that lookups may run concurrently with inserts.
+class MethodIndex {
+  private:
+    int _bits;
+    u32 _capacity;
+    u64* _keys;
+    volatile int _size;
+
+    u32 initialSlot(u64 key) {
+        return (u32)((key * 0xc6a4a7935bd1e995ULL) >> (64 - _bits));
+    }
+
+  public:
+    static const u32 NO_INDEX = 0xffffffff;
+
+    MethodIndex(int bits) : _bits(bits), _capacity(1 << bits), _size(0) {
+        _keys = (u64*)OS::safeAlloc(_capacity * sizeof(u64));
+    }
+
+    ~MethodIndex() {
+        if (_keys != NULL) {
+            OS::safeFree(_keys, _capacity * sizeof(u64));
+        }
+    }
+
+    bool valid() {
+        return _keys != NULL;
+    }
+
+    size_t usedMemory() {
+        return _capacity * sizeof(u64);
+    }
+
+    void clear() {
+        memset(_keys, 0, _capacity * sizeof(u64));
+        _size = 0;
+    }
+
+    // Returns NO_INDEX if the table is 3/4 full and the method is not there yet
+    u32 lookup(jmethodID method) {
+        if (method == NULL) {
+            return 0;
+        }
+
+        u64 key = (u64)(uintptr_t)method;
+        u32 slot = initialSlot(key);
+
+        while (true) {
+            u64 k = _keys[slot];
+            if (k == key) {
+                return slot + 1;
+            } else if (k == 0) {
+                if ((u32)_size >= _capacity * 3 / 4) {
+                    return NO_INDEX;
+                }
+                if (__sync_bool_compare_and_swap(&_keys[slot], 0, key)) {
+                    atomicInc(_size);
+                    return slot + 1;
+                }
+                continue;
+            }
+            slot = (slot + 1) & (_capacity - 1);
+        }
+    }
+
+    bool contains(jmethodID method) {
+        u64 key = (u64)(uintptr_t)method;
+        for (u32 slot = initialSlot(key); _keys[slot] != 0; slot = (slot + 1) & (_capacity - 1)) {
+            if (_keys[slot] == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    jmethodID method(u32 index) {
+        return index == 0 ? NULL : (jmethodID)(uintptr_t)_keys[index - 1];
+    }
+};
+
+#endif // _METHODINDEX_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "methodMap.h"
+
+
+const u32 INITIAL_CAPACITY = 4096;
+
+
+void MethodInfo::sortLineNumberTable() {
+    // Tables are short and almost always sorted already: insertion sort is linear then
+    for (int i = 1; i < _line_number_table_size; i++) {
+        jvmtiLineNumberEntry entry = _line_number_table[i];
+        int j = i - 1;
+        while (j >= 0 && _line_number_table[j].start_location > entry.start_location) {
+            _line_number_table[j + 1] = _line_number_table[j];
+            j--;
+        }
+        _line_number_table[j + 1] = entry;
+    }
+}
+
+MethodMap::MethodMap() : _capacity(INITIAL_CAPACITY), _size(0), _block_count(0), _null_method(NULL) {
+    _table = (Slot*)calloc(_capacity, sizeof(Slot));
+    _blocks = NULL;
+}
+
+MethodMap::~MethodMap() {
+    for (u32 i = 0; i < _block_count; i++) {
+        delete[] _blocks[i];
+    }
+    free(_blocks);
+    free(_table);
+}
+
+MethodInfo* MethodMap::newMethod() {
+    if ((_size & (METHOD_BLOCK_SIZE - 1)) == 0) {
+        _blocks = (MethodInfo**)realloc(_blocks, (_block_count + 1) * sizeof(MethodInfo*));
+        _blocks[_block_count++] = new MethodInfo[METHOD_BLOCK_SIZE];
+    }
+    return at(_size++);
+}
+
+MethodInfo* MethodMap::get(jmethodID method) {
+    if (method == NULL) {
+        if (_null_method == NULL) {
+            _null_method = newMethod();
+        }
+        return _null_method;
+    }
+
+    u32 mask = _capacity - 1;
+    for (u32 i = hash(method) & mask; ; i = (i + 1) & mask) {
+        Slot* slot = &_table[i];
+        if (slot->method == method) {
+            return at(slot->index);
+        } else if (slot->method == NULL) {
+            // Keep the load factor under 3/4
+            if ((_size + 1) * 4 > _capacity * 3) {
+                grow();
+                return get(method);
+            }
+            slot->method = method;
+            slot->index = _size;
+            return newMethod();
+        }
+    }
+}
+
+void MethodMap::grow() {
+    Slot* old_table = _table;
+    u32 old_capacity = _capacity;
+
+    _capacity = old_capacity * 2;
+    _table = (Slot*)calloc(_capacity, sizeof(Slot));
+
+    u32 mask = _capacity - 1;
+    for (u32 j = 0; j < old_capacity; j++) {
+        if (old_table[j].method != NULL) {
+            u32 i = hash(old_table[j].method) & mask;
+            while (_table[i].method != NULL) {
+                i = (i + 1) & mask;
+            }
+            _table[i] = old_table[j];
+        }
+    }
+
+    free(old_table);
+}
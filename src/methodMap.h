@@ -0,0 +1,125 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _METHODMAP_H
+#define _METHODMAP_H
+
+#include <stdint.h>
+#include <jvmti.h>
+#include "arch.h"
+
+
+enum FrameTypeId {
+    FRAME_INTERPRETED  = 0,
+    FRAME_JIT_COMPILED = 1,
+    FRAME_INLINED      = 2,
+    FRAME_NATIVE       = 3,
+    FRAME_CPP          = 4,
+    FRAME_KERNEL       = 5,
+    FRAME_C1_COMPILED  = 6,
+};
+
+
+class MethodInfo {
+  public:
+    MethodInfo() : _key(0) {
+    }
+
+    u32 _key;
+    u32 _class;
+    u32 _name;
+    u32 _sig;
+    jint _modifiers;
+    jint _line_number_table_size;
+    jvmtiLineNumberEntry* _line_number_table;
+    FrameTypeId _type;
+
+    // JVM TI does not promise any order of line number entries
+    void sortLineNumberTable();
+
+    // The table is sorted by start_location: find the last entry that starts at or before bci
+    jint getLineNumber(jint bci) {
+        if (_line_number_table_size == 0) {
+            return 0;
+        }
+
+        int low = 1;
+        int high = _line_number_table_size - 1;
+        while (low <= high) {
+            int mid = (unsigned int)(low + high) >> 1;
+            if (bci >= _line_number_table[mid].start_location) {
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        return _line_number_table[low - 1].line_number;
+    }
+};
+
+
+const int METHOD_BLOCK_BITS = 10;
+const int METHOD_BLOCK_SIZE = 1 << METHOD_BLOCK_BITS;
+
+// Open-addressing hash table from jmethodID to MethodInfo with linear probing.
+// MethodInfo records live in fixed-size blocks and never move, so pointers
+// to them stay valid when the table grows. Records are numbered in insertion order.
+// Not thread-safe: used only by the thread writing JFR constant pools.
+class MethodMap {
+  private:
+    struct Slot {
+        jmethodID method;
+        u32 index;
+    };
+
+    Slot* _table;
+    u32 _capacity;
+    u32 _size;
+    MethodInfo** _blocks;
+    u32 _block_count;
+    // Native frames may carry NULL method, which is the empty slot marker in the table
+    MethodInfo* _null_method;
+
+    static u32 hash(jmethodID method) {
+        u64 h = (u64)(uintptr_t)method * 0x9e3779b97f4a7c15ULL;
+        return (u32)(h >> 32);
+    }
+
+    MethodInfo* newMethod();
+    void grow();
+
+  public:
+    MethodMap();
+    ~MethodMap();
+
+    // Returns the existing record or a new one with _key == 0
+    MethodInfo* get(jmethodID method);
+
+    u32 size() {
+        return _size;
+    }
+
+    MethodInfo* at(u32 index) {
+        return &_blocks[index >> METHOD_BLOCK_BITS][index & (METHOD_BLOCK_SIZE - 1)];
+    }
+
+    long long usedMemory() {
+        return (long long)_capacity * sizeof(Slot) + (long long)_block_count * METHOD_BLOCK_SIZE * sizeof(MethodInfo);
+    }
+};
+
+#endif // _METHODMAP_H
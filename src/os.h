@@ -56,6 +56,8 @@ class OS {
     static u64 hton64(u64 x);
     static u64 ntoh64(u64 x);
 
+    static int getCpuCount();
+    static int currentCpu();
     static int getMaxThreadId();
     static int processId();
     static int threadId();
@@ -77,8 +79,11 @@ class OS {
     static bool getCpuDescription(char* buf, size_t size);
     static u64 getProcessCpuTime(u64* utime, u64* stime);
     static u64 getTotalCpuTime(u64* utime, u64* stime);
+    // CPU time of a thread of the current process in nanoseconds
+    static bool getThreadCpuTime(int thread_id, u64* utime, u64* stime);
 
-    static void copyFile(int src_fd, int dst_fd, off_t offset, size_t size);
+    // Appends size bytes of src_fd starting at offset to dst_fd; returns false if not all copied
+    static bool copyFile(int src_fd, int dst_fd, off_t offset, size_t size);
 };
 
 #endif // _OS_H
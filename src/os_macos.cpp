@@ -118,6 +118,16 @@ u64 OS::ntoh64(u64 x) {
     return OSSwapBigToHostInt64(x);
 }
 
+int OS::getCpuCount() {
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    return count > 0 ? (int)count : 1;
+}
+
+int OS::currentCpu() {
+    // No cheap way to get the current CPU on macOS
+    return -1;
+}
+
 int OS::getMaxThreadId() {
     return 0x7fffffff;
 }
@@ -256,12 +266,24 @@ u64 OS::getTotalCpuTime(u64* utime, u64* stime) {
     return user + system + idle;
 }
 
-void OS::copyFile(int src_fd, int dst_fd, off_t offset, size_t size) {
+bool OS::getThreadCpuTime(int thread_id, u64* utime, u64* stime) {
+    struct thread_basic_info info;
+    mach_msg_type_number_t size = sizeof(info);
+    if (thread_info((thread_act_t)thread_id, THREAD_BASIC_INFO, (thread_info_t)&info, &size) != 0) {
+        return false;
+    }
+    *utime = (u64)info.user_time.seconds * 1000000000 + (u64)info.user_time.microseconds * 1000;
+    *stime = (u64)info.system_time.seconds * 1000000000 + (u64)info.system_time.microseconds * 1000;
+    return true;
+}
+
+bool OS::copyFile(int src_fd, int dst_fd, off_t offset, size_t size) {
     char* buf = (char*)mmap(NULL, size + offset, PROT_READ, MAP_PRIVATE, src_fd, 0);
-    if (buf == NULL) {
-        return;
+    if (buf == MAP_FAILED) {
+        return false;
     }
 
+    size_t end = offset + size;
     while (size > 0) {
         ssize_t bytes = write(dst_fd, buf + offset, size < 262144 ? size : 262144);
         if (bytes <= 0) {
@@ -271,7 +293,8 @@ void OS::copyFile(int src_fd, int dst_fd, off_t offset, size_t size) {
         size -= (size_t)bytes;
     }
 
-    munmap(buf, offset);
+    munmap(buf, end);
+    return size == 0;
 }
 
 #endif // __APPLE__
@@ -17,12 +17,17 @@
 #ifndef _PERFEVENTS_H
 #define _PERFEVENTS_H
 
+#include <pthread.h>
 #include <signal.h>
 #include "engine.h"
+#include "event.h"
 
 
 class PerfEvent;
 class PerfEventType;
+class RingBuffer;
+struct PerfEventGroup;
+struct perf_event_attr;
 
 class PerfEvents : public Engine {
   private:
@@ -32,9 +37,43 @@ class PerfEvents : public Engine {
     static long _interval;
     static Ring _ring;
     static CStack _cstack;
+    static bool _cpu_events;
+    static int _group_count;
+    static PerfEventType _group_types[MAX_GROUP_EVENTS];
+
+    // Off-CPU mode: samples on context switches are weighted by the time until the thread runs again
+    static bool _offcpu;
+    static long _offcpu_threshold;
+
+    // Batch mode: samples are written to larger ring buffers and drained by a consumer thread
+    static int _ring_pages;
+    static int _epoll_fd;
+    static pthread_t _consumer_thread;
+    static volatile bool _consumer_running;
+    // Range of event indices to look through when draining all rings
+    static volatile int _drain_from;
+    static volatile int _drain_to;
 
     static void signalHandler(int signo, siginfo_t* siginfo, void* ucontext);
 
+    static void* consumerEntry(void* unused);
+    static void consumerLoop();
+    static void drainBuffer(PerfEvent* event);
+    static void recordBatchSample(RingBuffer& ring, PerfEvent* event, u64 switch_in_time);
+    static void closeEpoll();
+    Error startConsumer();
+
+    static int createEvent(int index, int pid, int cpu, unsigned long flags);
+    static int createForCpu(int cpu, int cgroup_fd);
+    static Error createForAllCpus();
+    static Error parseGroup(const char* group);
+    static void destroyEvent(int index);
+
+    static int openGroup(const struct perf_event_attr& leader, int pid, int cpu, int leader_fd,
+                         unsigned long flags, PerfEventGroup** result);
+    static void closeGroup(PerfEventGroup* group);
+    static u64 readGroup(int fd, ExecutionEvent* event);
+
   public:
     Error check(Arguments& args);
     Error start(Arguments& args);
@@ -46,9 +85,11 @@ class PerfEvents : public Engine {
     const char* units();
 
     static void resetBuffer(int tid);
+    static void drainAll();
 
     static bool supported();
     static const char* getEventName(int event_id);
+    static int counterIndex(const char* name);
 
     static int createForThread(int tid);
     static void destroyForThread(int tid);
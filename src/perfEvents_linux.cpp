@@ -17,6 +17,7 @@
 #ifdef __linux__
 
 #include <jvmti.h>
+#include <limits.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -25,6 +26,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -38,6 +40,7 @@
 #include "spinLock.h"
 #include "stackFrame.h"
 #include "symbols.h"
+#include "vmStructs.h"
 
 
 // Ancient fcntl.h does not define F_SETOWN_EX constants and structures
@@ -62,6 +65,12 @@ enum {
 
 static const unsigned long PERF_PAGE_SIZE = sysconf(_SC_PAGESIZE);
 
+// Batch mode: how often rings below the wakeup watermark are drained
+static const u64 DRAIN_ALL_INTERVAL = 100000000;  // 100 ms
+
+// Deeper kernel call chains are truncated in batch mode
+static const int MAX_BATCH_CALLCHAIN = 512;
+
 static int fetchInt(const char* file_name) {
     int fd = open(file_name, O_RDONLY);
     if (fd == -1) {
@@ -76,7 +85,8 @@ static int fetchInt(const char* file_name) {
 }
 
 // Get perf_event_attr.config numeric value of the given tracepoint name
-// by reading /sys/kernel/debug/tracing/events/<name>/id file
+// by reading /sys/kernel/debug/tracing/events/<name>/id file,
+// or the same file in tracefs mounted at /sys/kernel/tracing
 static int findTracepointId(const char* name) {
     char buf[256];
     if ((size_t)snprintf(buf, sizeof(buf), "/sys/kernel/debug/tracing/events/%s/id", name) >= sizeof(buf)) {
@@ -85,7 +95,12 @@ static int findTracepointId(const char* name) {
 
     *strchr(buf, ':') = '/';  // make path from event name
 
-    return fetchInt(buf);
+    int id = fetchInt(buf);
+    if (id <= 0) {
+        memmove(buf + 12, buf + 18, strlen(buf + 18) + 1);  // strip "debug/"
+        id = fetchInt(buf);
+    }
+    return id;
 }
 
 // Get perf_event_attr.type for the given event source
@@ -346,6 +361,13 @@ struct PerfEventType {
             }
         }
 
+        // Off-CPU time is sampled on sched_switch, or on the equivalent software event
+        // that fires at the same point of the scheduler when tracefs is not available
+        if (strcmp(name, EVENT_OFFCPU) == 0) {
+            int tracepoint_id = findTracepointId("sched:sched_switch");
+            return tracepoint_id > 0 ? getTracepoint(tracepoint_id) : forName("context-switches");
+        }
+
         // Hardware breakpoint
         if (strncmp(name, "mem:", 4) == 0) {
             return getBreakpoint(name + 4, HW_BREAKPOINT_RW, 1);
@@ -444,37 +466,91 @@ FunctionWithCounter PerfEventType::KNOWN_FUNCTIONS[] = {
 };
 
 
+static void setEventType(struct perf_event_attr& attr, const PerfEventType* event_type) {
+    attr.type = event_type->type;
+
+    if (attr.type == PERF_TYPE_BREAKPOINT) {
+        attr.bp_type = event_type->config;
+    } else {
+        attr.config = event_type->config;
+    }
+    attr.config1 = event_type->config1;
+    attr.config2 = event_type->config2;
+}
+
+// Opens the cgroup directory of the current process: perf_event controller in cgroup v1,
+// or the unified hierarchy in cgroup v2
+static int openCgroup() {
+    FILE* f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char path[PATH_MAX] = "";
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\n")] = 0;
+        char* controllers = strchr(line, ':');
+        char* cgroup = controllers != NULL ? strchr(controllers + 1, ':') : NULL;
+        if (cgroup == NULL) {
+            continue;
+        }
+        *controllers++ = 0;
+        *cgroup++ = 0;
+
+        if (strstr(controllers, "perf_event") != NULL) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup/perf_event%s", cgroup);
+            break;
+        } else if (*controllers == 0 && strncmp(line, "0", 2) == 0) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s", cgroup);
+        }
+    }
+    fclose(f);
+
+    return path[0] ? open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+}
+
+
 class RingBuffer {
   private:
     const char* _start;
     unsigned long _offset;
+    unsigned long _mask;
 
   public:
-    RingBuffer(struct perf_event_mmap_page* page) {
+    RingBuffer(struct perf_event_mmap_page* page, int pages) {
         _start = (const char*)page + PERF_PAGE_SIZE;
+        _mask = pages * PERF_PAGE_SIZE - 1;
     }
 
     struct perf_event_header* seek(u64 offset) {
-        _offset = (unsigned long)offset & (PERF_PAGE_SIZE - 1);
+        _offset = (unsigned long)offset & _mask;
         return (struct perf_event_header*)(_start + _offset);
     }
 
     u64 next() {
-        _offset = (_offset + sizeof(u64)) & (PERF_PAGE_SIZE - 1);
+        _offset = (_offset + sizeof(u64)) & _mask;
         return *(u64*)(_start + _offset);
     }
 
     u64 peek(unsigned long words) {
-        unsigned long peek_offset = (_offset + words * sizeof(u64)) & (PERF_PAGE_SIZE - 1);
+        unsigned long peek_offset = (_offset + words * sizeof(u64)) & _mask;
         return *(u64*)(_start + peek_offset);
     }
 };
 
 
+// Events counted together with the sampled event
+struct PerfEventGroup {
+    int fds[MAX_GROUP_EVENTS];
+    u64 last[MAX_GROUP_EVENTS];  // batch mode: samples carry running totals rather than deltas
+};
+
 class PerfEvent : public SpinLock {
   private:
     int _fd;
     struct perf_event_mmap_page* _page;
+    PerfEventGroup* _group;
 
     friend class PerfEvents;
 };
@@ -486,13 +562,53 @@ PerfEventType* PerfEvents::_event_type = NULL;
 long PerfEvents::_interval;
 Ring PerfEvents::_ring;
 CStack PerfEvents::_cstack;
+bool PerfEvents::_cpu_events = false;
+int PerfEvents::_group_count = 0;
+PerfEventType PerfEvents::_group_types[MAX_GROUP_EVENTS];
+bool PerfEvents::_offcpu = false;
+long PerfEvents::_offcpu_threshold = 0;
+int PerfEvents::_ring_pages = 1;
+int PerfEvents::_epoll_fd = -1;
+pthread_t PerfEvents::_consumer_thread;
+volatile bool PerfEvents::_consumer_running = false;
+volatile int PerfEvents::_drain_from = 0;
+volatile int PerfEvents::_drain_to = 0;
 
 int PerfEvents::createForThread(int tid) {
+    if (_cpu_events) {
+        return -1;
+    }
+
     if (tid >= _max_events) {
         Log::warn("tid[%d] > pid_max[%d]. Restart profiler after changing pid_max", tid, _max_events);
         return -1;
     }
 
+    return createEvent(tid, tid, -1, 0);
+}
+
+// Per-CPU events watch the whole cgroup of the process
+int PerfEvents::createForCpu(int cpu, int cgroup_fd) {
+    return createEvent(cpu, cgroup_fd, cpu, PERF_FLAG_PID_CGROUP);
+}
+
+// CPUs that can be hot-plugged have an online switch; the boot CPU usually does not
+static bool isCpuOnline(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return true;
+    }
+
+    char c = '1';
+    ssize_t r = read(fd, &c, 1);
+    (void)r;
+    close(fd);
+    return c != '0';
+}
+
+int PerfEvents::createEvent(int index, int pid, int cpu, unsigned long flags) {
     PerfEventType* event_type = _event_type;
     if (event_type == NULL) {
         return -1;
@@ -500,15 +616,7 @@ int PerfEvents::createForThread(int tid) {
 
     struct perf_event_attr attr = {0};
     attr.size = sizeof(attr);
-    attr.type = event_type->type;
-
-    if (attr.type == PERF_TYPE_BREAKPOINT) {
-        attr.bp_type = event_type->config;
-    } else {
-        attr.config = event_type->config;
-    }
-    attr.config1 = event_type->config1;
-    attr.config2 = event_type->config2;
+    setEventType(attr, event_type);
 
     // Hardware events may not always support zero skid
     if (attr.type == PERF_TYPE_SOFTWARE) {
@@ -518,9 +626,41 @@ int PerfEvents::createForThread(int tid) {
     attr.sample_period = _interval;
     attr.sample_type = PERF_SAMPLE_CALLCHAIN;
     attr.disabled = 1;
-    attr.wakeup_events = 1;
 
-    if (_ring == RING_USER) {
+    if (_group_count > 0) {
+        attr.read_format = PERF_FORMAT_GROUP;
+    }
+
+    if (_epoll_fd >= 0) {
+        // Wake up the consumer when the ring buffer is half full rather than on every sample
+        attr.sample_type |= PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_PERIOD;
+        if (_group_count > 0) {
+            attr.sample_type |= PERF_SAMPLE_READ;
+        }
+        attr.watermark = 1;
+        attr.wakeup_watermark = _ring_pages * PERF_PAGE_SIZE / 2;
+#ifdef PERF_ATTR_SIZE_VER5
+        // Timestamps in the same clock as OS::nanotime()
+        attr.use_clockid = 1;
+        attr.clockid = CLOCK_MONOTONIC;
+#endif
+    } else {
+        attr.wakeup_events = 1;
+    }
+
+    if (_offcpu) {
+        // Switch-in records mark the end of every off-CPU interval.
+        // Scheduler events fire in the kernel, so the ring restricts only the call chain
+#ifdef PERF_RECORD_MISC_SWITCH_OUT
+        attr.context_switch = 1;
+#endif
+        attr.sample_id_all = 1;
+        if (_ring == RING_USER) {
+            attr.exclude_callchain_kernel = 1;
+        } else if (_ring == RING_KERNEL) {
+            attr.exclude_callchain_user = 1;
+        }
+    } else if (_ring == RING_USER) {
         attr.exclude_kernel = 1;
     } else if (_ring == RING_KERNEL) {
         attr.exclude_user = 1;
@@ -537,57 +677,159 @@ int PerfEvents::createForThread(int tid) {
 #warning "Compiling without LBR support. Kernel headers 4.1+ required"
 #endif
 
-    int fd = syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0);
+    int fd = syscall(__NR_perf_event_open, &attr, pid, cpu, -1, flags);
     if (fd == -1) {
         int err = errno;
         Log::warn("perf_event_open failed: %s", strerror(errno));
         return err;
     }
 
-    if (!__sync_bool_compare_and_swap(&_events[tid]._fd, 0, fd)) {
+    PerfEventGroup* group = NULL;
+    if (_group_count > 0) {
+        int err = openGroup(attr, pid, cpu, fd, flags, &group);
+        if (err != 0) {
+            close(fd);
+            return err;
+        }
+    }
+
+    if (!__sync_bool_compare_and_swap(&_events[index]._fd, 0, fd)) {
         // Lost race. The event is created either from start() or from onThreadStart()
+        closeGroup(group);
         close(fd);
         return -1;
     }
 
-    void* page = mmap(NULL, 2 * PERF_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* page = mmap(NULL, (1 + _ring_pages) * PERF_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (page == MAP_FAILED) {
         Log::warn("perf_event mmap failed: %s", strerror(errno));
+        if (_epoll_fd >= 0) {
+            Log::warn("Try smaller batch size or 'sysctl kernel.perf_event_mlock_kb=<larger value>'");
+        }
         page = NULL;
     }
 
-    _events[tid].reset();
-    _events[tid]._page = (struct perf_event_mmap_page*)page;
+    _events[index].reset();
+    _events[index]._page = (struct perf_event_mmap_page*)page;
+    _events[index]._group = group;
+
+    if (_epoll_fd >= 0) {
+        // Thread IDs of a process are mostly close to each other, so the range stays small
+        int bound;
+        while ((bound = _drain_from) > index && !__sync_bool_compare_and_swap(&_drain_from, bound, index)) {}
+        while ((bound = _drain_to) <= index && !__sync_bool_compare_and_swap(&_drain_to, bound, index + 1)) {}
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = index;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+        ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        return 0;
+    }
 
     struct f_owner_ex ex;
     ex.type = F_OWNER_TID;
-    ex.pid = tid;
+    ex.pid = pid;
 
     fcntl(fd, F_SETFL, O_ASYNC);
     fcntl(fd, F_SETSIG, SIGPROF);
     fcntl(fd, F_SETOWN_EX, &ex);
 
-    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
     ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
 
     return 0;
 }
 
+// Group members inherit the target and the privilege level of the leader.
+// They do not sample on their own, but are read together with every sample of the leader
+int PerfEvents::openGroup(const struct perf_event_attr& leader, int pid, int cpu, int leader_fd,
+                          unsigned long flags, PerfEventGroup** result) {
+    PerfEventGroup* group = (PerfEventGroup*)calloc(1, sizeof(PerfEventGroup));
+
+    for (int i = 0; i < _group_count; i++) {
+        struct perf_event_attr attr = {0};
+        attr.size = sizeof(attr);
+        setEventType(attr, &_group_types[i]);
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.inherit = leader.inherit;
+        attr.exclude_kernel = leader.exclude_kernel;
+        attr.exclude_user = leader.exclude_user;
+#ifdef PERF_ATTR_SIZE_VER5
+        // The kernel requires all events of a group to use the same clock
+        attr.use_clockid = leader.use_clockid;
+        attr.clockid = leader.clockid;
+#endif
+
+        int fd = syscall(__NR_perf_event_open, &attr, pid, cpu, leader_fd, flags);
+        if (fd == -1) {
+            int err = errno;
+            Log::warn("perf_event_open failed for group event %s: %s", _group_types[i].name, strerror(err));
+            closeGroup(group);
+            return err;
+        }
+        group->fds[i] = fd;
+    }
+
+    *result = group;
+    return 0;
+}
+
+void PerfEvents::closeGroup(PerfEventGroup* group) {
+    if (group != NULL) {
+        for (int i = 0; i < _group_count; i++) {
+            if (group->fds[i] > 0) close(group->fds[i]);
+        }
+        free(group);
+    }
+}
+
+// Reads the counters of the group since the last reset; returns the value of the leader
+u64 PerfEvents::readGroup(int fd, ExecutionEvent* event) {
+    u64 values[2 + MAX_GROUP_EVENTS];
+    ssize_t bytes = read(fd, values, sizeof(values));
+    if (bytes < (ssize_t)(2 * sizeof(u64)) || values[0] != (u64)_group_count + 1) {
+        return 1;
+    }
+
+    event->_group_count = _group_count;
+    for (int i = 0; i < _group_count; i++) {
+        event->_group[i] = values[2 + i];
+    }
+    return values[1];
+}
+
 void PerfEvents::destroyForThread(int tid) {
-    if (tid >= _max_events) {
+    if (!_cpu_events) {
+        destroyEvent(tid);
+    }
+}
+
+void PerfEvents::destroyEvent(int index) {
+    if (index >= _max_events) {
         return;
     }
 
-    PerfEvent* event = &_events[tid];
+    PerfEvent* event = &_events[index];
     int fd = event->_fd;
     if (fd != 0 && __sync_bool_compare_and_swap(&event->_fd, fd, 0)) {
         ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
         close(fd);
     }
-    if (event->_page != NULL) {
+    if (event->_page != NULL || event->_group != NULL) {
         event->lock();
-        munmap(event->_page, 2 * PERF_PAGE_SIZE);
-        event->_page = NULL;
+        if (event->_page != NULL) {
+            if (_epoll_fd >= 0) {
+                // Samples collected after the last wakeup are still in the buffer
+                drainBuffer(event);
+            }
+            munmap(event->_page, (1 + _ring_pages) * PERF_PAGE_SIZE);
+            event->_page = NULL;
+        }
+        closeGroup(event->_group);
+        event->_group = NULL;
         event->unlock();
     }
 }
@@ -599,6 +841,7 @@ void PerfEvents::signalHandler(int signo, siginfo_t* siginfo, void* ucontext) {
     }
 
     if (_enabled) {
+        ExecutionEvent event;
         u64 counter;
         switch (_event_type->counter_arg) {
             case 1: counter = StackFrame(ucontext).arg0(); break;
@@ -606,23 +849,164 @@ void PerfEvents::signalHandler(int signo, siginfo_t* siginfo, void* ucontext) {
             case 3: counter = StackFrame(ucontext).arg2(); break;
             case 4: counter = StackFrame(ucontext).arg3(); break;
             default:
-                if (read(siginfo->si_fd, &counter, sizeof(counter)) != sizeof(counter)) {
+                if (_group_count > 0) {
+                    counter = readGroup(siginfo->si_fd, &event);
+                } else if (read(siginfo->si_fd, &counter, sizeof(counter)) != sizeof(counter)) {
                     counter = 1;
                 }
         }
 
-        ExecutionEvent event;
         Profiler::_instance.recordSample(ucontext, counter, 0, &event);
     } else {
         resetBuffer(OS::threadId());
     }
 
-    ioctl(siginfo->si_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(siginfo->si_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
     ioctl(siginfo->si_fd, PERF_EVENT_IOC_REFRESH, 1);
 }
 
+void* PerfEvents::consumerEntry(void* unused) {
+    consumerLoop();
+    return NULL;
+}
+
+void PerfEvents::consumerLoop() {
+    struct epoll_event ready[64];
+    u64 next_drain = OS::nanotime() + DRAIN_ALL_INTERVAL;
+
+    while (_consumer_running) {
+        // Time out periodically to notice the stop request
+        int n = epoll_wait(_epoll_fd, ready, 64, DRAIN_ALL_INTERVAL / 1000000);
+        for (int i = 0; i < n; i++) {
+            PerfEvent* event = &_events[ready[i].data.u32];
+            if (event->tryLock()) {
+                drainBuffer(event);
+                event->unlock();
+            }
+        }
+
+        u64 now = OS::nanotime();
+        if (now >= next_drain) {
+            drainAll();
+            next_drain = now + DRAIN_ALL_INTERVAL;
+        }
+    }
+}
+
+// Epoll reports a ring only when it is half full, so samples of threads that rarely run
+// would otherwise stay in the kernel until the thread exits or profiling stops
+void PerfEvents::drainAll() {
+    if (_epoll_fd < 0) {
+        return;
+    }
+
+    int to = _drain_to;
+    for (int i = _drain_from; i < to; i++) {
+        PerfEvent* event = &_events[i];
+        if (event->_page != NULL && event->tryLock()) {
+            drainBuffer(event);
+            event->unlock();
+        }
+    }
+}
+
+// Parses all samples accumulated in the ring buffer since the previous drain.
+// The caller must hold the event lock
+void PerfEvents::drainBuffer(PerfEvent* event) {
+    struct perf_event_mmap_page* page = event->_page;
+    if (page == NULL) {
+        return;
+    }
+
+    u64 tail = page->data_tail;
+    u64 head = page->data_head;
+    rmb();
+
+    RingBuffer ring(page, _ring_pages);
+
+    // In off-CPU mode, a switch-out sample stays in the buffer until the switch-in record arrives
+    u64 pending = head;
+
+    while (tail < head) {
+        struct perf_event_header* hdr = ring.seek(tail);
+        if (hdr->type == PERF_RECORD_SAMPLE && _enabled) {
+            if (_offcpu) {
+                pending = tail;
+            } else {
+                recordBatchSample(ring, event, 0);
+            }
+#ifdef PERF_RECORD_MISC_SWITCH_OUT
+        } else if (hdr->type == PERF_RECORD_SWITCH && pending != head && (hdr->misc & PERF_RECORD_MISC_SWITCH_OUT) == 0) {
+            // sample_id_all: pid/tid and time of the switch-in
+            ring.next();
+            u64 switch_in_time = ring.next();
+            ring.seek(pending);
+            recordBatchSample(ring, event, switch_in_time);
+            pending = head;
+#endif
+        }
+        tail += hdr->size;
+    }
+
+    // Finish reading records before the kernel may overwrite them
+    __sync_synchronize();
+    page->data_tail = pending;
+}
+
+// Parses PERF_RECORD_SAMPLE at the current position of the ring buffer.
+// Off-CPU samples are weighted by the time from the sample until switch_in_time
+void PerfEvents::recordBatchSample(RingBuffer& ring, PerfEvent* event, u64 switch_in_time) {
+    // PERF_SAMPLE_TID: pid in the lower half, tid in the upper half
+    u64 pid_tid = ring.next();
+    if ((int)(u32)pid_tid != OS::processId()) {
+        // Per-CPU events also see other processes of the same cgroup
+        return;
+    }
+    int tid = (int)(pid_tid >> 32);
+    ExecutionEvent sample;
+    u64 time = ring.next();
+#ifdef PERF_ATTR_SIZE_VER5
+    sample._time = time;
+#endif
+    u64 period = ring.next();
+
+    if (_offcpu) {
+        if (switch_in_time < time || switch_in_time - time < (u64)_offcpu_threshold) {
+            return;
+        }
+        period = switch_in_time - time;
+    }
+
+    PerfEventGroup* group = event->_group;
+    if (_group_count > 0) {
+        // PERF_SAMPLE_READ with PERF_FORMAT_GROUP: nr, then the leader and members
+        u64 nr = ring.next();
+        ring.next();
+        for (u64 i = 0; i + 1 < nr; i++) {
+            u64 value = ring.next();
+            if (group != NULL && i < (u64)_group_count) {
+                sample._group[i] = value - group->last[i];
+                group->last[i] = value;
+            }
+        }
+        sample._group_count = group != NULL ? _group_count : 0;
+    }
+
+    const void* callchain[MAX_BATCH_CALLCHAIN];
+    int depth = 0;
+    u64 nr = ring.next();
+    while (nr-- > 0) {
+        u64 ip = ring.next();
+        if (ip < PERF_CONTEXT_MAX && depth < MAX_BATCH_CALLCHAIN) {
+            callchain[depth++] = (const void*)ip;
+        }
+    }
+
+    Profiler::_instance.recordExternalSample(period, tid, depth, callchain, &sample);
+}
+
 const char* PerfEvents::units() {
-    if (_event_type == NULL || _event_type->name == EVENT_CPU) {
+    if (_event_type == NULL || _event_type->name == EVENT_CPU || _offcpu) {
         return "ns";
     } else if (_event_type->type == PERF_TYPE_SOFTWARE || _event_type->type == PERF_TYPE_HARDWARE || _event_type->type == PERF_TYPE_HW_CACHE) {
         const char* dash = strrchr(_event_type->name, '-');
@@ -640,21 +1024,15 @@ Error PerfEvents::check(Arguments& args) {
 
     struct perf_event_attr attr = {0};
     attr.size = sizeof(attr);
-    attr.type = event_type->type;
-
-    if (attr.type == PERF_TYPE_BREAKPOINT) {
-        attr.bp_type = event_type->config;
-    } else {
-        attr.config = event_type->config;
-    }
-    attr.config1 = event_type->config1;
-    attr.config2 = event_type->config2;
+    setEventType(attr, event_type);
 
     attr.sample_period = event_type->default_interval;
     attr.sample_type = PERF_SAMPLE_CALLCHAIN;
     attr.disabled = 1;
 
-    if (args._ring == RING_USER) {
+    if (strcmp(args._event, EVENT_OFFCPU) == 0) {
+        // Scheduler events are counted in the kernel regardless of the ring
+    } else if (args._ring == RING_USER) {
         attr.exclude_kernel = 1;
     } else if (args._ring == RING_KERNEL) {
         attr.exclude_user = 1;
@@ -682,11 +1060,36 @@ Error PerfEvents::check(Arguments& args) {
 }
 
 Error PerfEvents::start(Arguments& args) {
+    // Group event types are copied, since forName() may reuse the same descriptor.
+    // They are resolved first for the same reason
+    Error error = parseGroup(args._group);
+    if (error) {
+        return error;
+    }
+
     _event_type = PerfEventType::forName(args._event);
     if (_event_type == NULL) {
         return Error("Unsupported event type");
     }
 
+    if (_group_count > 0 && _event_type->counter_arg != 0) {
+        return Error("Event groups are not supported for function argument counters");
+    }
+
+    // A signal would wake up the thread being switched out, so off-CPU samples are always drained in batches
+    _offcpu = strcmp(args._event, EVENT_OFFCPU) == 0;
+    _offcpu_threshold = args._offcpu > 0 ? args._offcpu : 0;
+    if (_offcpu) {
+#ifndef PERF_RECORD_MISC_SWITCH_OUT
+        return Error("offcpu requires kernel headers 4.3+");
+#endif
+        if (_group_count > 0 || args._cpu_events) {
+            return Error("offcpu is not supported with event groups or cpuevents mode");
+        } else if (args._cstack == CSTACK_LBR || args._cstack == CSTACK_DWARF) {
+            return Error("offcpu is not supported with this cstack mode");
+        }
+    }
+
     if (args._interval < 0) {
         return Error("interval must be positive");
     }
@@ -701,14 +1104,52 @@ Error PerfEvents::start(Arguments& args) {
     }
     _cstack = args._cstack;
 
-    int max_events = OS::getMaxThreadId();
+    // Events that count function arguments, LBR and DWARF unwinding need the signal context
+    bool batch = args._perf_batch > 0 || args._cpu_events || _offcpu;
+    if (batch && (_event_type->counter_arg != 0 || _cstack == CSTACK_LBR || _cstack == CSTACK_DWARF)) {
+        if (args._cpu_events) {
+            return Error("cpuevents mode is not supported for this event or cstack mode");
+        }
+        Log::warn("Batch mode is not supported for this event or cstack mode; falling back to signals");
+        batch = false;
+    }
+
+    _ring_pages = 1;
+    if (batch) {
+        long ring_size = args._perf_batch > 0 ? args._perf_batch : DEFAULT_PERF_BATCH;
+        while (_ring_pages < 1024 && (unsigned long)_ring_pages * PERF_PAGE_SIZE < (unsigned long)ring_size) {
+            _ring_pages *= 2;
+        }
+        if ((_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            return Error("Unable to create epoll instance");
+        }
+        if (VMStructs::preserveFramePointer() == 0) {
+            Log::warn("Batch mode walks Java frames by frame pointers: run the JVM with -XX:+PreserveFramePointer");
+        }
+    }
+
+    _drain_from = INT_MAX;
+    _drain_to = 0;
+    _cpu_events = args._cpu_events;
+    int max_events = _cpu_events ? OS::getCpuCount() : OS::getMaxThreadId();
     if (max_events != _max_events) {
         free(_events);
         _events = (PerfEvent*)calloc(max_events, sizeof(PerfEvent));
         _max_events = max_events;
     }
 
-    OS::installSignalHandler(SIGPROF, signalHandler);
+    if (!batch) {
+        OS::installSignalHandler(SIGPROF, signalHandler);
+    }
+
+    if (_cpu_events) {
+        Error error = createForAllCpus();
+        if (error) {
+            closeEpoll();
+            return error;
+        }
+        return startConsumer();
+    }
 
     // Enable thread events before traversing currently running threads
     Profiler::_instance.switchThreadEvents(JVMTI_ENABLE);
@@ -726,18 +1167,120 @@ Error PerfEvents::start(Arguments& args) {
 
     if (!created) {
         Profiler::_instance.switchThreadEvents(JVMTI_DISABLE);
-        if (err == EACCES || err == EPERM) {
+        closeEpoll();
+        if ((err == EACCES || err == EPERM) && _offcpu) {
+            return Error("No access to scheduler events. Try 'sysctl kernel.perf_event_paranoid=1'");
+        } else if (err == EACCES || err == EPERM) {
             return Error("No access to perf events. Try --all-user option or 'sysctl kernel.perf_event_paranoid=1'");
         } else {
             return Error("Perf events unavailable");
         }
     }
+
+    return batch ? startConsumer() : Error::OK;
+}
+
+Error PerfEvents::parseGroup(const char* group) {
+    for (int i = 0; i < _group_count; i++) {
+        free((char*)_group_types[i].name);
+    }
+    _group_count = 0;
+    if (group == NULL) {
+        return Error::OK;
+    }
+
+    char* names = strdup(group);
+    char* saveptr;
+    for (char* name = strtok_r(names, "+", &saveptr); name != NULL; name = strtok_r(NULL, "+", &saveptr)) {
+        PerfEventType* event_type = _group_count < MAX_GROUP_EVENTS ? PerfEventType::forName(name) : NULL;
+        if (event_type == NULL) {
+            const char* msg = _group_count < MAX_GROUP_EVENTS ? "Unsupported group event" : "Too many events in a group";
+            free(names);
+            parseGroup(NULL);
+            return Error(msg);
+        }
+        _group_types[_group_count] = *event_type;
+        _group_types[_group_count++].name = strdup(name);
+    }
+
+    free(names);
+    return Error::OK;
+}
+
+// Index of the named counter in CallTraceSample: 0 is the sampled event, 1.. are group events
+int PerfEvents::counterIndex(const char* name) {
+    if (_event_type != NULL && strcmp(name, _event_type->name) == 0) {
+        return 0;
+    }
+    for (int i = 0; i < _group_count; i++) {
+        if (strcmp(name, _group_types[i].name) == 0) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+Error PerfEvents::createForAllCpus() {
+    int cgroup_fd = openCgroup();
+    if (cgroup_fd < 0) {
+        return Error("Cannot find perf_event cgroup of the process");
+    }
+
+    // Offline CPUs are skipped: the kernel rejects events bound to them with ENODEV
+    int err = 0;
+    bool created = false;
+    for (int cpu = 0; cpu < _max_events && err == 0; cpu++) {
+        if (isCpuOnline(cpu)) {
+            err = createForCpu(cpu, cgroup_fd);
+            if (err == ENODEV) {
+                err = 0;
+            } else if (err == 0) {
+                created = true;
+            }
+        }
+    }
+    close(cgroup_fd);
+
+    if (err != 0 || !created) {
+        for (int cpu = 0; cpu < _max_events; cpu++) {
+            destroyEvent(cpu);
+        }
+        if (err == EACCES || err == EPERM) {
+            return Error("No access to cgroup perf events. Try 'sysctl kernel.perf_event_paranoid=0' or profile without --cpu-events");
+        } else {
+            return Error("Perf events unavailable");
+        }
+    }
+    return Error::OK;
+}
+
+Error PerfEvents::startConsumer() {
+    _consumer_running = true;
+    if (pthread_create(&_consumer_thread, NULL, consumerEntry, NULL) != 0) {
+        _consumer_running = false;
+        stop();
+        return Error("Unable to create perf_events consumer thread");
+    }
     return Error::OK;
 }
 
 void PerfEvents::stop() {
+    if (_consumer_running) {
+        _consumer_running = false;
+        pthread_join(_consumer_thread, NULL);
+    }
+
     for (int i = 0; i < _max_events; i++) {
-        destroyForThread(i);
+        destroyEvent(i);
+    }
+
+    closeEpoll();
+}
+
+void PerfEvents::closeEpoll() {
+    if (_epoll_fd >= 0) {
+        close(_epoll_fd);
+        _epoll_fd = -1;
     }
 }
 
@@ -756,7 +1299,7 @@ int PerfEvents::getNativeTrace(void* ucontext, int tid, const void** callchain,
         u64 head = page->data_head;
         rmb();
 
-        RingBuffer ring(page);
+        RingBuffer ring(page, _ring_pages);
 
         while (tail < head) {
             struct perf_event_header* hdr = ring.seek(tail);
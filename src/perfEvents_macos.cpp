@@ -52,6 +52,9 @@ int PerfEvents::getNativeTrace(void* ucontext, int tid, const void** callchain,
 void PerfEvents::resetBuffer(int tid) {
 }
 
+void PerfEvents::drainAll() {
+}
+
 bool PerfEvents::supported() {
     return false;
 }
@@ -60,6 +63,10 @@ const char* PerfEvents::getEventName(int event_id) {
     return NULL;
 }
 
+int PerfEvents::counterIndex(const char* name) {
+    return -1;
+}
+
 int PerfEvents::createForThread(int tid) {
     return -1;
 }
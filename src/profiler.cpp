@@ -27,12 +27,14 @@
 #include "perfEvents.h"
 #include "allocTracer.h"
 #include "lockTracer.h"
+#include "safepointTracer.h"
 #include "wallClock.h"
 #include "instrument.h"
 #include "itimer.h"
 #include "flameGraph.h"
 #include "flightRecorder.h"
 #include "frameName.h"
+#include "gzipWriter.h"
 #include "log.h"
 #include "os.h"
 #include "stackFrame.h"
@@ -46,6 +48,7 @@ static Engine noop_engine;
 static PerfEvents perf_events;
 static AllocTracer alloc_tracer;
 static LockTracer lock_tracer;
+static SafepointTracer safepoint_tracer;
 static WallClock wall_clock;
 static ITimer itimer;
 static Instrument instrument;
@@ -89,15 +92,24 @@ static bool sortByCounter(const NamedMethodSample& a, const NamedMethodSample& b
 }
 
 
-void Profiler::addJavaMethod(const void* address, int length, jmethodID method) {
+void Profiler::addJavaMethod(const void* address, int length, jmethodID method, const void* compile_info) {
+    // Without VMStructs, compile level is unknown: count such methods as C2 compiled
+    NMethod* nm = NMethod::findBlob(address);
+    FrameTier tier = nm != NULL && nm->level() < 4 ? TIER_C1 : TIER_C2;
+
+    int inlined_count;
+    jmethodID* inlined = CompiledMethods::collectInlined(compile_info, method, &inlined_count);
+
     _jit_lock.lock();
     _java_methods.add(address, length, method, true);
+    _compiled_methods.add(method, address, tier, inlined, inlined_count);
     _jit_lock.unlock();
 }
 
 void Profiler::removeJavaMethod(const void* address, jmethodID method) {
     _jit_lock.lock();
     _java_methods.remove(address, method);
+    _compiled_methods.remove(method, address);
     _jit_lock.unlock();
 }
 
@@ -179,6 +191,38 @@ inline u32 Profiler::getLockIndex(int tid) {
     return lock_index % CONCURRENCY_LEVEL;
 }
 
+// Returns the index of the acquired lock, or -1 if too many concurrent signals are in progress
+int Profiler::lockSharedSlot(PaddedSpinLock* locks, int tid) {
+    u32 lock_index = getLockIndex(tid);
+    if (locks[lock_index].tryLock() ||
+        locks[lock_index = (lock_index + 1) % CONCURRENCY_LEVEL].tryLock() ||
+        locks[lock_index = (lock_index + 2) % CONCURRENCY_LEVEL].tryLock()) {
+        return lock_index;
+    }
+    return -1;
+}
+
+// A slot of the current CPU is busy only if another thread was preempted while recording a sample.
+// In this rare case, take any other free slot.
+int Profiler::lockPerCpuSlot(int tid) {
+    int cpu = OS::currentCpu();
+    u32 start = cpu >= 0 ? (u32)cpu : (u32)tid;
+    for (int i = 0; i < _concurrency_level; i++) {
+        u32 slot = (start + i) % _concurrency_level;
+        if (_locks[slot].tryLock()) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Applies pending trace counters of all slots. The caller must hold all slot locks
+void Profiler::flushTraceDeltas() {
+    for (int i = 0; i < _concurrency_level; i++) {
+        _call_trace_storage.flushDeltas(&_trace_deltas[i]);
+    }
+}
+
 void Profiler::updateSymbols(bool kernel_symbols) {
     Symbols::parseLibraries(_native_libs, _native_lib_count, MAX_NATIVE_LIBS, kernel_symbols);
 }
@@ -261,10 +305,88 @@ bool Profiler::inJavaCode(void* ucontext) {
     return _java_methods.contains(pc);
 }
 
+// Unwind the interrupted native stack using .eh_frame tables of the loaded libraries.
+// Frames without unwind information are assumed to have a conventional FP-based layout.
+int Profiler::walkDwarf(void* ucontext, const void** callchain, int max_depth) {
+    StackFrame frame(ucontext);
+    const void* pc = (const void*)frame.pc();
+    uintptr_t sp = frame.sp();
+    uintptr_t fp = frame.fp();
+    uintptr_t bottom = (uintptr_t)&sp + 0x100000;
+
+    int depth = 0;
+    const void* const valid_pc = (const void*)0x1000;
+
+    // Walk until the bottom of the stack or until the first Java frame
+    while (depth < max_depth && pc >= valid_pc) {
+        if (_java_methods.contains(pc) || _runtime_stubs.contains(pc)) {
+            break;
+        }
+
+        callchain[depth++] = pc;
+
+        // A return address may point past the end of the caller, so look up the call instruction
+        const void* lookup_pc = depth == 1 ? pc : (const char*)pc - 1;
+        NativeCodeCache* lib = findNativeLibrary(lookup_pc);
+        FrameDesc* f = lib != NULL ? lib->findFrameDesc(lookup_pc) : NULL;
+
+        uintptr_t cfa;
+        int fp_off;
+        if (f == NULL || f->cfa_reg() == DW_REG_INVALID) {
+            cfa = fp + 2 * DW_STACK_SLOT;
+            fp_off = -2 * DW_STACK_SLOT;
+        } else {
+            cfa = (f->cfa_reg() == DW_REG_SP ? sp : fp) + f->cfa_off();
+            fp_off = f->fp_off;
+        }
+
+        // Check if the caller's frame is below on the current stack
+        if (cfa <= sp || cfa >= sp + 0x40000 || cfa >= bottom) {
+            break;
+        }
+
+        // CFA must be word aligned
+        if ((cfa & (sizeof(uintptr_t) - 1)) != 0) {
+            break;
+        }
+
+        if (fp_off != DW_SAME_FP) {
+            if (cfa + fp_off < sp) {
+                break;
+            }
+            fp = *(uintptr_t*)(cfa + fp_off);
+        }
+        pc = ((const void**)cfa)[-1];
+        sp = cfa;
+    }
+
+    return depth;
+}
+
 int Profiler::getNativeTrace(Engine* engine, void* ucontext, ASGCT_CallFrame* frames, int tid) {
     const void* native_callchain[MAX_NATIVE_FRAMES];
-    int native_frames = engine->getNativeTrace(ucontext, tid, native_callchain, MAX_NATIVE_FRAMES,
+    int native_frames;
+
+    if (_cstack == CSTACK_DWARF && ucontext != NULL) {
+        // Keep kernel frames reported by perf_events, then unwind the user stack starting at the interrupted pc
+        int kernel_frames = 0;
+        if (engine == &perf_events) {
+            native_frames = engine->getNativeTrace(ucontext, tid, native_callchain, MAX_NATIVE_FRAMES,
+                                                   &_java_methods, &_runtime_stubs);
+            const void* pc = (const void*)StackFrame(ucontext).pc();
+            while (kernel_frames < native_frames && native_callchain[kernel_frames] != pc) {
+                kernel_frames++;
+            }
+            if (kernel_frames == native_frames) {
+                kernel_frames = 0;
+            }
+        }
+        native_frames = kernel_frames + walkDwarf(ucontext, native_callchain + kernel_frames,
+                                                  MAX_NATIVE_FRAMES - kernel_frames);
+    } else {
+        native_frames = engine->getNativeTrace(ucontext, tid, native_callchain, MAX_NATIVE_FRAMES,
                                                &_java_methods, &_runtime_stubs);
+    }
 
     int depth = 0;
     jmethodID prev_method = NULL;
@@ -284,7 +406,14 @@ int Profiler::getNativeTrace(Engine* engine, void* ucontext, ASGCT_CallFrame* fr
     return depth;
 }
 
-int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max_depth) {
+// Each safe mode recovery attempt is timed separately
+void Profiler::retryJavaTrace(ASGCT_CallTrace* trace, int max_depth, void* ucontext, int tid) {
+    u64 start = _metrics.start();
+    VM::_asyncGetCallTrace(trace, max_depth, ucontext);
+    _metrics.record(tid, STAGE_JAVA_RECOVERY, start);
+}
+
+int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max_depth, int tid) {
     VMThread* vm_thread = VMThread::current();
     if (vm_thread == NULL) {
         return 0;
@@ -300,7 +429,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
         int state = vm_thread->state();
         if ((state == 8 || state == 9) && !inJavaCode(ucontext)) {
             // Thread is in Java state, but does not have a valid Java frame on top of the stack
-            atomicInc(_failures[-ticks_unknown_Java]);
+            atomicInc(_counters.stripe(tid).failures[-ticks_unknown_Java]);
             frames->bci = BCI_ERROR;
             frames->method_id = (jmethodID)asgctError(ticks_unknown_Java);
             return 1;
@@ -329,7 +458,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
         if (!(_safe_mode & MOVE_SP)) {
             for (int extra_stack_slots = 1; extra_stack_slots <= 2; extra_stack_slots++) {
                 top_frame.sp() = sp + extra_stack_slots * sizeof(uintptr_t);
-                VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                retryJavaTrace(&trace, max_depth, ucontext, tid);
                 top_frame.sp() = sp;
 
                 if (trace.num_frames > 0) {
@@ -356,7 +485,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
             // otherwise AsyncGetCallTrace may crash
             if (!(_safe_mode & POP_FRAME) && top_frame.pop(is_entry_frame)) {
                 if (getAddressType((instruction_t*)top_frame.pc()) != ADDR_UNKNOWN) {
-                    VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                    retryJavaTrace(&trace, max_depth, ucontext, tid);
                 }
                 top_frame.restore(pc, sp, fp);
 
@@ -372,7 +501,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
                 trace.frames = frames;
                 for (int extra_stack_slots = 3; extra_stack_slots <= 6; extra_stack_slots = (extra_stack_slots - 1) << 1) {
                     top_frame.sp() = sp + extra_stack_slots * sizeof(uintptr_t);
-                    VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                    retryJavaTrace(&trace, max_depth, ucontext, tid);
                     top_frame.sp() = sp;
 
                     if (trace.num_frames > 0) {
@@ -389,7 +518,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
                     if (getAddressType((instruction_t*)top_frame.stackAt(slot)) != ADDR_UNKNOWN) {
                         top_frame.pc() = top_frame.stackAt(slot);
                         top_frame.sp() = sp + (slot + 1) * sizeof(uintptr_t);
-                        VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                        retryJavaTrace(&trace, max_depth, ucontext, tid);
                         top_frame.restore(pc, sp, fp);
 
                         if (trace.num_frames > 0) {
@@ -419,7 +548,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
                         pc = ((uintptr_t*)sp)[-1];
                     }
                 }
-                VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                retryJavaTrace(&trace, max_depth, ucontext, tid);
             }
 
             sp = saved_sp;
@@ -438,7 +567,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
 
                 sp = saved_sp + stub->frameSize() * sizeof(uintptr_t);
                 pc = ((uintptr_t*)sp)[-1];
-                VM::_asyncGetCallTrace(&trace, max_depth, ucontext);
+                retryJavaTrace(&trace, max_depth, ucontext, tid);
 
                 sp = saved_sp;
                 pc = saved_pc;
@@ -461,7 +590,7 @@ int Profiler::getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max
         return 0;
     }
 
-    atomicInc(_failures[-trace.num_frames]);
+    atomicInc(_counters.stripe(tid).failures[-trace.num_frames]);
     trace.frames->bci = BCI_ERROR;
     trace.frames->method_id = (jmethodID)err_string;
     return trace.frames - frames + 1;
@@ -490,6 +619,50 @@ int Profiler::getJavaTraceJvmti(jvmtiFrameInfo* jvmti_frames, ASGCT_CallFrame* f
     return 0;
 }
 
+// Marks Java frames with their compilation tier. Frames executing in the compiled blob
+// that contains the interrupted pc are classified exactly: the blob's method is compiled,
+// and the frames above it are inlined. Deeper frames are classified by the code currently
+// installed for the method and whether its caller's code inlines it.
+void Profiler::annotateJavaFrames(ASGCT_CallFrame* frames, int num_frames, const void* pc) {
+    if (num_frames <= 0) {
+        return;
+    }
+
+    _jit_lock.lockShared();
+
+    int first = 0;
+    jmethodID blob_method = pc != NULL && _java_methods.contains(pc) ? _java_methods.find(pc) : NULL;
+    if (blob_method != NULL) {
+        for (int i = 0; i < num_frames && frames[i].bci >= 0; i++) {
+            if (frames[i].method_id == blob_method) {
+                const CompiledMethod* cm = _compiled_methods.find(blob_method);
+                FrameTier tier = cm != NULL && cm->tier != TIER_INTERPRETED ? cm->tier : TIER_C2;
+                for (int j = 0; j < i; j++) {
+                    frames[j].bci = encodeFrameTier(TIER_INLINED, frames[j].bci);
+                }
+                frames[i].bci = encodeFrameTier(tier, frames[i].bci);
+                first = i + 1;
+                break;
+            }
+        }
+    }
+
+    const CompiledMethod* callee = first < num_frames ? _compiled_methods.find(frames[first].method_id) : NULL;
+    for (int i = first; i < num_frames; i++) {
+        const CompiledMethod* caller = i + 1 < num_frames ? _compiled_methods.find(frames[i + 1].method_id) : NULL;
+        if (frames[i].bci >= 0) {
+            FrameTier tier = callee != NULL ? callee->tier : TIER_INTERPRETED;
+            if (caller != NULL && caller->tier != TIER_INTERPRETED && CompiledMethods::inlines(caller, frames[i].method_id)) {
+                tier = TIER_INLINED;
+            }
+            frames[i].bci = encodeFrameTier(tier, frames[i].bci);
+        }
+        callee = caller;
+    }
+
+    _jit_lock.unlockShared();
+}
+
 inline int Profiler::makeEventFrame(ASGCT_CallFrame* frames, jint event_type, uintptr_t id) {
     frames[0].bci = event_type;
     frames[0].method_id = (jmethodID)id;
@@ -562,16 +735,15 @@ AddressType Profiler::getAddressType(instruction_t* pc) {
 }
 
 void Profiler::recordSample(void* ucontext, u64 counter, jint event_type, Event* event) {
-    atomicInc(_total_samples);
-
+    u64 sample_start = _metrics.start();
     int tid = OS::threadId();
-    u32 lock_index = getLockIndex(tid);
-    if (!_locks[lock_index].tryLock() &&
-        !_locks[lock_index = (lock_index + 1) % CONCURRENCY_LEVEL].tryLock() &&
-        !_locks[lock_index = (lock_index + 2) % CONCURRENCY_LEVEL].tryLock())
-    {
+    SampleCounters& counters = _counters.stripe(tid);
+    atomicInc(counters.total_samples);
+
+    int lock_index = _per_cpu ? lockPerCpuSlot(tid) : lockSharedSlot(_locks, tid);
+    if (lock_index < 0) {
         // Too many concurrent signals already
-        atomicInc(_failures[-ticks_skipped]);
+        atomicInc(counters.failures[-ticks_skipped]);
 
         if (event_type == 0 && _engine == &perf_events) {
             // Need to reset PerfEvents ring buffer, even though we discard the collected trace
@@ -580,6 +752,12 @@ void Profiler::recordSample(void* ucontext, u64 counter, jint event_type, Event*
         return;
     }
 
+    int shadow_index = -1;
+    if (_per_cpu_stats && (shadow_index = lockSharedSlot(_shadow_locks, tid)) < 0) {
+        // This sample would have been skipped with the shared lock pool
+        atomicInc(counters.recovered_samples);
+    }
+
     ASGCT_CallFrame* frames = _calltrace_buffer[lock_index]->_asgct_frames;
 
     int num_frames = 0;
@@ -588,19 +766,31 @@ void Profiler::recordSample(void* ucontext, u64 counter, jint event_type, Event*
     }
 
     // Use engine stack walker for execution samples, or basic stack walker for other events
+    u64 start = _metrics.start();
     if (event_type == 0 && _cstack != CSTACK_NO) {
         num_frames += getNativeTrace(_engine, ucontext, frames + num_frames, tid);
+        _metrics.record(tid, STAGE_NATIVE_TRACE, start);
     } else if (event_type != 0 && _cstack > CSTACK_NO) {
         num_frames += getNativeTrace(&noop_engine, ucontext, frames + num_frames, tid);
+        _metrics.record(tid, STAGE_NATIVE_TRACE, start);
     }
 
-    int first_java_frame = num_frames;
+    start = _metrics.start();
+    int java_start = num_frames;
     if (event_type != 0 && VMStructs::_get_stack_trace != NULL) {
         // Events like object allocation happen at known places where it is safe to call JVM TI
         jvmtiFrameInfo* jvmti_frames = _calltrace_buffer[lock_index]->_jvmti_frames;
         num_frames += getJavaTraceJvmti(jvmti_frames + num_frames, frames + num_frames, _max_stack_depth);
+        _metrics.record(tid, STAGE_JVMTI_TRACE, start);
     } else {
-        num_frames += getJavaTraceAsync(ucontext, frames + num_frames, _max_stack_depth);
+        num_frames += getJavaTraceAsync(ucontext, frames + num_frames, _max_stack_depth, tid);
+        _metrics.record(tid, STAGE_JAVA_TRACE, start);
+    }
+
+    // The interrupted pc tells the exact tier of the top frames only for execution samples
+    if (_annotate_tiers) {
+        annotateJavaFrames(frames + java_start, num_frames - java_start,
+                           event_type == 0 && ucontext != NULL ? (const void*)StackFrame(ucontext).pc() : NULL);
     }
 
     if (num_frames == 0) {
@@ -611,17 +801,108 @@ void Profiler::recordSample(void* ucontext, u64 counter, jint event_type, Event*
         num_frames--;
     }
 
-    // TODO: Zero out top bci to reduce the number of stack traces
-    // if (first_java_frame < num_frames && frames[first_java_frame].bci > 0) {
-    //     frames[first_java_frame].bci = 0;
-    // }
+    if (_trace_normalizer.enabled()) {
+        num_frames = _trace_normalizer.normalize(num_frames, frames);
+    }
+
+    if (_add_thread_frame) {
+        num_frames += makeEventFrame(frames + num_frames, BCI_THREAD_ID, tid);
+    }
+
+    start = _metrics.start();
+    const u64* group = event_type == 0 && ((ExecutionEvent*)event)->_group_count > 0 ? ((ExecutionEvent*)event)->_group : NULL;
+    u32 call_trace_id = _call_trace_storage.put(num_frames, frames, counter, &_trace_deltas[lock_index], group);
+    _metrics.record(tid, STAGE_STORAGE_PUT, start);
+
+    if (_jfr.active()) {
+        start = _metrics.start();
+        _jfr.recordEvent(lock_index, tid, call_trace_id, event_type, event, counter);
+        _metrics.record(tid, STAGE_JFR_EVENT, start);
+    }
+
+    if (shadow_index >= 0) _shadow_locks[shadow_index].unlock();
+    _locks[lock_index].unlock();
+
+    _metrics.record(tid, STAGE_SAMPLE, sample_start);
+}
+
+// Records an execution sample of another thread, whose call chain has already been collected
+// by the kernel. Java frames are recognized by the addresses of compiled methods;
+// without inlining information, each compiled frame stands for its outermost method.
+void Profiler::recordExternalSample(u64 counter, int tid, int num_ips, const void** ips, ExecutionEvent* event) {
+    u64 sample_start = _metrics.start();
+    SampleCounters& counters = _counters.stripe(tid);
+    atomicInc(counters.total_samples);
+
+    int lock_index = _per_cpu ? lockPerCpuSlot(tid) : lockSharedSlot(_locks, tid);
+    if (lock_index < 0) {
+        atomicInc(counters.failures[-ticks_skipped]);
+        return;
+    }
+
+    ASGCT_CallFrame* frames = _calltrace_buffer[lock_index]->_asgct_frames;
+    const int max_frames = _max_stack_depth + MAX_NATIVE_FRAMES;
+
+    u64 start = _metrics.start();
+    int num_frames = 0;
+    for (int i = 0; i < num_ips && num_frames < max_frames; i++) {
+        ASGCT_CallFrame* frame = &frames[num_frames];
+        if (fillTopFrame(ips[i], frame)) {
+            if (frame->bci == BCI_NATIVE_FRAME && _cstack == CSTACK_NO) {
+                continue;
+            } else if (frame->bci == 0 && _annotate_tiers) {
+                _jit_lock.lockShared();
+                const CompiledMethod* cm = _compiled_methods.find(frame->method_id);
+                frame->bci = encodeFrameTier(cm != NULL && cm->tier != TIER_INTERPRETED ? cm->tier : TIER_C2, 0);
+                _jit_lock.unlockShared();
+            }
+            num_frames++;
+        } else if (_cstack != CSTACK_NO) {
+            frame->bci = BCI_NATIVE_FRAME;
+            frame->method_id = (jmethodID)findNativeMethod(ips[i]);
+            num_frames++;
+        }
+    }
+    _metrics.record(tid, STAGE_NATIVE_TRACE, start);
+
+    if (num_frames == 0) {
+        num_frames += makeEventFrame(frames + num_frames, BCI_ERROR, (uintptr_t)"no_Java_frame");
+    }
+
+    if (_trace_normalizer.enabled()) {
+        num_frames = _trace_normalizer.normalize(num_frames, frames);
+    }
 
     if (_add_thread_frame) {
         num_frames += makeEventFrame(frames + num_frames, BCI_THREAD_ID, tid);
     }
 
-    u32 call_trace_id = _call_trace_storage.put(num_frames, frames, counter);
-    _jfr.recordEvent(lock_index, tid, call_trace_id, event_type, event, counter);
+    start = _metrics.start();
+    const u64* group = event->_group_count > 0 ? event->_group : NULL;
+    u32 call_trace_id = _call_trace_storage.put(num_frames, frames, counter, &_trace_deltas[lock_index], group);
+    _metrics.record(tid, STAGE_STORAGE_PUT, start);
+
+    if (_jfr.active()) {
+        start = _metrics.start();
+        _jfr.recordEvent(lock_index, tid, call_trace_id, 0, event, counter);
+        _metrics.record(tid, STAGE_JFR_EVENT, start);
+    }
+
+    _locks[lock_index].unlock();
+
+    _metrics.record(tid, STAGE_SAMPLE, sample_start);
+}
+
+void Profiler::recordPause(PauseType type, PauseEvent* event) {
+    int tid = OS::threadId();
+    int lock_index = _per_cpu ? lockPerCpuSlot(tid) : lockSharedSlot(_locks, tid);
+    if (lock_index < 0) {
+        return;
+    }
+
+    if (_jfr.active()) {
+        _jfr.recordPause(lock_index, tid, type, event);
+    }
 
     _locks[lock_index].unlock();
 }
@@ -849,8 +1130,11 @@ bool Profiler::excludeTrace(FrameName* fn, CallTrace* trace) {
         return false;
     }
 
+    std::vector<ASGCT_CallFrame> buf;
+    ASGCT_CallFrame* frames = _call_trace_storage.getFrames(trace, buf);
+
     for (int i = 0; i < trace->num_frames; i++) {
-        const char* frame_name = fn->name(trace->frames[i], true);
+        const char* frame_name = fn->name(frames[i], true);
         if (checkExclude && fn->exclude(frame_name)) {
             return true;
         }
@@ -917,13 +1201,17 @@ Error Profiler::start(Arguments& args, bool reset) {
 
     if (reset || _start_time == 0) {
         // Reset counters
-        _total_samples = 0;
-        memset(_failures, 0, sizeof(_failures));
+        _counters.clear();
+        _dumped_samples = 0;
+        _metrics.clear();
 
         // Reset dicrionaries and bitmaps
         _class_map.clear();
         _thread_filter.clear();
         _call_trace_storage.clear();
+        for (int i = 0; i < MAX_CONCURRENCY_LEVEL; i++) {
+            _trace_deltas[i].clear();
+        }
 
         // Reset thread names and IDs
         MutexLocker ml(_thread_names_lock);
@@ -934,15 +1222,24 @@ Error Profiler::start(Arguments& args, bool reset) {
     // (Re-)allocate calltrace buffers
     if (_max_stack_depth != args._jstackdepth) {
         _max_stack_depth = args._jstackdepth;
-        size_t buffer_size = (_max_stack_depth + MAX_NATIVE_FRAMES + RESERVED_FRAMES) * sizeof(CallTraceBuffer);
-
-        for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
+        for (int i = 0; i < MAX_CONCURRENCY_LEVEL; i++) {
             free(_calltrace_buffer[i]);
-            _calltrace_buffer[i] = (CallTraceBuffer*)malloc(buffer_size);
-            if (_calltrace_buffer[i] == NULL) {
-                _max_stack_depth = 0;
-                return Error("Not enough memory to allocate stack trace buffers (try smaller jstackdepth)");
-            }
+            _calltrace_buffer[i] = NULL;
+        }
+    }
+
+    _per_cpu = args._percpu;
+    _per_cpu_stats = args._percpu && args._percpu_stats;
+    _metrics.setEnabled(args._timing);
+    _concurrency_level = _per_cpu ? OS::getCpuCount() : CONCURRENCY_LEVEL;
+    if (_concurrency_level > MAX_CONCURRENCY_LEVEL) {
+        _concurrency_level = MAX_CONCURRENCY_LEVEL;
+    }
+
+    size_t buffer_size = (_max_stack_depth + MAX_NATIVE_FRAMES + RESERVED_FRAMES) * sizeof(CallTraceBuffer);
+    for (int i = 0; i < _concurrency_level; i++) {
+        if (_calltrace_buffer[i] == NULL && (_calltrace_buffer[i] = (CallTraceBuffer*)malloc(buffer_size)) == NULL) {
+            return Error("Not enough memory to allocate stack trace buffers (try smaller jstackdepth)");
         }
     }
 
@@ -954,14 +1251,35 @@ Error Profiler::start(Arguments& args, bool reset) {
         _safe_mode |= GC_TRACES | LAST_JAVA_PC;
     }
 
+    // Below the minimum, the empty storage alone exceeds the limit
+    if (args._memlimit > 0 && (u64)args._memlimit < CallTraceStorage::minMemoryLimit()) {
+        return Error("memlimit is too small: the empty call trace storage needs about 12 MB");
+    }
+    if (!_call_trace_storage.setTraceStore(args._trace_store)) {
+        return Error("Not enough memory to allocate method index");
+    }
+    _call_trace_storage.setMemoryLimit(args._memlimit);
+
+    error = _trace_normalizer.init(args._normalize);
+    if (error) {
+        return error;
+    }
     _add_thread_frame = args._threads && args._output != OUTPUT_JFR;
     _update_thread_names = args._threads || args._output == OUTPUT_JFR;
+    // Tier bits split otherwise identical stacks, so record them only when the output shows them
+    _annotate_tiers = args._output == OUTPUT_FLAMEGRAPH || args._output == OUTPUT_TREE ||
+                      args._output == OUTPUT_JFR || (args._style & STYLE_ANNOTATE);
     _thread_filter.init(args._filter);
 
     _engine = selectEngine(args._event);
     _cstack = args._cstack;
     if (_cstack == CSTACK_LBR && _engine != &perf_events) {
         return Error("Branch stack is supported only with PMU events");
+    } else if (_cstack == CSTACK_DWARF && !DWARF_SUPPORTED) {
+        return Error("DWARF unwinding is not supported on this architecture");
+    }
+    if (_cstack == CSTACK_DWARF) {
+        Symbols::parseUnwindTables(_native_libs, _native_lib_count);
     }
 
     error = installTraps(args._begin, args._end);
@@ -995,8 +1313,20 @@ Error Profiler::start(Arguments& args, bool reset) {
         }
     }
 
+    // Safepoint events are optional: the recording goes on without them
+    _safepoint_tracing = false;
+    if (args._safepoints > 0 && _jfr.active()) {
+        Error safepoint_error = safepoint_tracer.start(args);
+        if (safepoint_error) {
+            Log::warn("%s", safepoint_error.message());
+        } else {
+            _safepoint_tracing = true;
+        }
+    }
+
     // Thread events might be already enabled by PerfEvents::start
     switchThreadEvents(JVMTI_ENABLE);
+    switchGCEvents(_jfr.active());
     switchNativeMethodTraps(true);
 
     _state = RUNNING;
@@ -1011,9 +1341,10 @@ error2:
 
 error1:
     uninstallTraps();
-    for (int i = 0; i < CONCURRENCY_LEVEL; i++) _locks[i].lock();
+    for (int i = 0; i < _concurrency_level; i++) _locks[i].lock();
+    flushTraceDeltas();
     _jfr.stop();
-    for (int i = 0; i < CONCURRENCY_LEVEL; i++) _locks[i].unlock();
+    for (int i = 0; i < _concurrency_level; i++) _locks[i].unlock();
     return error;
 }
 
@@ -1025,6 +1356,7 @@ Error Profiler::stop() {
 
     uninstallTraps();
 
+    if (_safepoint_tracing) safepoint_tracer.stop();
     if (_event_mask & EM_LOCK) lock_tracer.stop();
     if (_event_mask & EM_ALLOC) alloc_tracer.stop();
 
@@ -1032,13 +1364,15 @@ Error Profiler::stop() {
 
     switchNativeMethodTraps(false);
     switchThreadEvents(JVMTI_DISABLE);
+    switchGCEvents(false);
     updateJavaThreadNames();
     updateNativeThreadNames();
 
     // Acquire all spinlocks to avoid race with remaining signals
-    for (int i = 0; i < CONCURRENCY_LEVEL; i++) _locks[i].lock();
+    for (int i = 0; i < _concurrency_level; i++) _locks[i].lock();
+    flushTraceDeltas();
     _jfr.stop();
-    for (int i = 0; i < CONCURRENCY_LEVEL; i++) _locks[i].unlock();
+    for (int i = 0; i < _concurrency_level; i++) _locks[i].unlock();
 
     _state = IDLE;
     return Error::OK;
@@ -1059,6 +1393,37 @@ Error Profiler::check(Arguments& args) {
     return _engine->check(args);
 }
 
+void Profiler::switchGCEvents(bool enable) {
+    if (_gc_events != enable) {
+        jvmtiEventMode mode = enable ? JVMTI_ENABLE : JVMTI_DISABLE;
+        jvmtiEnv* jvmti = VM::jvmti();
+        _gc_start = 0;
+        jvmti->SetEventNotificationMode(mode, JVMTI_EVENT_GARBAGE_COLLECTION_START, NULL);
+        jvmti->SetEventNotificationMode(mode, JVMTI_EVENT_GARBAGE_COLLECTION_FINISH, NULL);
+        _gc_events = enable;
+    }
+}
+
+// Called in the VM thread during a stop-the-world pause, so JNI and most of JVM TI are not allowed
+void Profiler::onGarbageCollectionStart() {
+    _gc_start = OS::nanotime();
+}
+
+void Profiler::onGarbageCollectionFinish() {
+    if (_gc_start == 0) {
+        // GC events were enabled in the middle of a pause
+        return;
+    }
+
+    PauseEvent event;
+    event._id = _gc_id++;
+    event._start_time = _gc_start;
+    event._end_time = OS::nanotime();
+    event._sync_time = event._start_time;
+    recordPause(PAUSE_GC, &event);
+    _gc_start = 0;
+}
+
 void Profiler::switchThreadEvents(jvmtiEventMode mode) {
     if (_thread_events_state != mode) {
         jvmtiEnv* jvmti = VM::jvmti();
@@ -1068,7 +1433,65 @@ void Profiler::switchThreadEvents(jvmtiEventMode mode) {
     }
 }
 
-void Profiler::dump(std::ostream& out, Arguments& args) {
+Error Profiler::dump(std::ostream& out, Arguments& args) {
+    MutexLocker ml(_state_lock);
+    if (_engine == NULL || _state == TERMINATED) {
+        return Error::OK;
+    }
+
+    if (_state == IDLE) {
+        _counters.snapshot(_dump_counters, false);
+        dumpOutput(out, args);
+        return Error::OK;
+    }
+
+    if (args._output == OUTPUT_JFR) {
+        if (!_jfr.inMemory()) {
+            return Error("JFR output can be dumped only when profiling is stopped");
+        }
+        updateJavaThreadNames();
+        updateNativeThreadNames();
+        return _jfr.dump(args);
+    }
+
+    // Recorded JFR events refer to call trace IDs of the current epoch,
+    // which would be reused by the next one
+    if (_jfr.active()) {
+        return Error("Cannot dump while JFR recording is active; stop profiling first");
+    }
+
+    // Pick up samples still waiting in perf_events rings, so that they belong to this dump
+    if (_engine == &perf_events) {
+        PerfEvents::drainAll();
+    }
+
+    // Switch sampling to a fresh epoch and drain the old one while the profiler keeps running
+    if (!_call_trace_storage.detachEpoch()) {
+        return Error("Not enough memory to dump profile while running");
+    }
+    // Sample counters restart together with the epoch, so that totals match the dumped traces
+    _counters.snapshot(_dump_counters, true);
+    _dumped_samples += _dump_counters.total_samples;
+
+    // Wait for signal handlers that might still be writing to the detached epoch,
+    // and apply pending counters of its traces
+    for (int i = 0; i < _concurrency_level; i++) {
+        _locks[i].lock();
+        _call_trace_storage.flushDeltas(&_trace_deltas[i]);
+        _locks[i].unlock();
+    }
+
+    if (_update_thread_names) {
+        updateJavaThreadNames();
+        updateNativeThreadNames();
+    }
+
+    dumpOutput(out, args);
+    _call_trace_storage.releaseEpoch();
+    return Error::OK;
+}
+
+void Profiler::dumpOutput(std::ostream& out, Arguments& args) {
     switch (args._output) {
         case OUTPUT_COLLAPSED:
             dumpCollapsed(out, args);
@@ -1093,72 +1516,132 @@ void Profiler::dump(std::ostream& out, Arguments& args) {
  * <frame>;<frame>;...;<topmost frame> <count>
  */
 void Profiler::dumpCollapsed(std::ostream& out, Arguments& args) {
-    MutexLocker ml(_state_lock);
-    if (_state != IDLE || _engine == NULL) return;
-
     FrameName fn(args, args._style, _thread_names_lock, _thread_names);
 
     std::vector<CallTraceSample*> samples;
     _call_trace_storage.collectSamples(samples);
+    std::vector<ASGCT_CallFrame> buf;
 
     for (std::vector<CallTraceSample*>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
         CallTrace* trace = (*it)->trace;
         if (excludeTrace(&fn, trace)) continue;
 
+        ASGCT_CallFrame* frames = _call_trace_storage.getFrames(trace, buf);
         for (int j = trace->num_frames - 1; j >= 0; j--) {
-            const char* frame_name = fn.name(trace->frames[j]);
+            const char* frame_name = fn.name(frames[j]);
             out << frame_name << (j == 0 ? ' ' : ';');
         }
         out << (args._counter == COUNTER_SAMPLES ? (*it)->samples : (*it)->counter) << "\n";
     }
 }
 
-void Profiler::dumpFlameGraph(std::ostream& out, Arguments& args, bool tree) {
-    MutexLocker ml(_state_lock);
-    if (_state != IDLE || _engine == NULL) return;
+// Parses [N*]A/B, where A and B name the sampled perf event or one of its group events
+bool Profiler::parseRatio(const char* ratio, int* num, int* den, double* scale) {
+    if (_engine != &perf_events) {
+        return false;
+    }
+
+    char buf[256];
+    strncpy(buf, ratio, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+
+    char* expr = buf;
+    char* star = strchr(expr, '*');
+    if (star != NULL) {
+        *star = 0;
+        *scale = atof(expr);
+        expr = star + 1;
+    }
+
+    char* slash = strchr(expr, '/');
+    if (slash == NULL) {
+        return false;
+    }
+    *slash = 0;
 
+    *num = PerfEvents::counterIndex(expr);
+    *den = PerfEvents::counterIndex(slash + 1);
+    return *num >= 0 && *den >= 0 && *scale > 0;
+}
+
+void Profiler::dumpFlameGraph(std::ostream& out, Arguments& args, bool tree) {
     FlameGraph flamegraph(args._title, args._counter, args._minwidth, args._reverse);
-    FrameName fn(args, args._style, _thread_names_lock, _thread_names);
+    // Frame type suffixes choose the colors of frames
+    FrameName fn(args, args._style | STYLE_ANNOTATE, _thread_names_lock, _thread_names);
+
+    // Indices of the ratio counters: 0 is the sampled event, then the group events
+    int ratio_num = -1;
+    int ratio_den = -1;
+    if (args._ratio != NULL && !tree) {
+        double scale = 1;
+        if (!parseRatio(args._ratio, &ratio_num, &ratio_den, &scale)) {
+            Log::warn("ratio counters must be among the sampled event and the group events");
+        } else {
+            flamegraph.setRatio(args._ratio, scale);
+        }
+    }
 
     std::vector<CallTraceSample*> samples;
     _call_trace_storage.collectSamples(samples);
+    std::vector<ASGCT_CallFrame> buf;
+
+    // Flame graph nodes that correspond to frame trie nodes, so that frames
+    // of a shared prefix are resolved only once
+    std::map<FrameNode*, Trie*> node_map;
+    std::vector<FrameNode*> path;
 
     for (std::vector<CallTraceSample*>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
         CallTrace* trace = (*it)->trace;
         if (excludeTrace(&fn, trace)) continue;
 
         u64 samples = (args._counter == COUNTER_SAMPLES ? (*it)->samples : (*it)->counter);
+        u64 num = ratio_num < 0 ? 0 : ratio_num == 0 ? (*it)->counter : (*it)->group[ratio_num - 1];
+        u64 den = ratio_den < 0 ? 0 : ratio_den == 0 ? (*it)->counter : (*it)->group[ratio_den - 1];
         int num_frames = trace->num_frames;
 
         Trie* f = flamegraph.root();
         if (args._reverse) {
+            ASGCT_CallFrame* frames = _call_trace_storage.getFrames(trace, buf);
             if (_add_thread_frame) {
                 // Thread frames always come first
                 num_frames--;
-                const char* frame_name = fn.name(trace->frames[num_frames]);
-                f = f->addChild(frame_name, samples);
+                const char* frame_name = fn.name(frames[num_frames]);
+                f = f->addChild(frame_name, samples, num, den);
             }
 
             for (int j = 0; j < num_frames; j++) {
-                const char* frame_name = fn.name(trace->frames[j]);
-                f = f->addChild(frame_name, samples);
+                const char* frame_name = fn.name(frames[j]);
+                f = f->addChild(frame_name, samples, num, den);
+            }
+        } else if (trace->leaf != NULL) {
+            path.clear();
+            for (FrameNode* node = trace->leaf; node != NULL; node = node->parent) {
+                path.push_back(node);
+            }
+
+            for (int j = num_frames - 1; j >= 0; j--) {
+                Trie*& child = node_map[path[j]];
+                if (child == NULL) {
+                    const char* frame_name = fn.name(path[j]->frame);
+                    f = child = f->addChild(frame_name, samples, num, den);
+                } else {
+                    f = f->addChild(child, samples, num, den);
+                }
             }
         } else {
+            ASGCT_CallFrame* frames = _call_trace_storage.getFrames(trace, buf);
             for (int j = num_frames - 1; j >= 0; j--) {
-                const char* frame_name = fn.name(trace->frames[j]);
-                f = f->addChild(frame_name, samples);
+                const char* frame_name = fn.name(frames[j]);
+                f = f->addChild(frame_name, samples, num, den);
             }
         }
-        f->addLeaf(samples);
+        f->addLeaf(samples, num, den);
     }
 
     flamegraph.dump(out, tree);
 }
 
 void Profiler::dumpText(std::ostream& out, Arguments& args) {
-    MutexLocker ml(_state_lock);
-    if (_state != IDLE || _engine == NULL) return;
-
     FrameName fn(args, args._style | STYLE_DOTTED, _thread_names_lock, _thread_names);
     char buf[1024] = {0};
 
@@ -1178,20 +1661,32 @@ void Profiler::dumpText(std::ostream& out, Arguments& args) {
     }
 
     // Print summary
+    u64 total_samples = _dump_counters.total_samples;
     snprintf(buf, sizeof(buf) - 1,
             "--- Execution profile ---\n"
             "Total samples       : %lld\n",
-            _total_samples);
+            total_samples);
     out << buf;
 
-    double spercent = 100.0 / _total_samples;
+    double spercent = 100.0 / total_samples;
     for (int i = 1; i < ASGCT_FAILURE_TYPES; i++) {
         const char* err_string = asgctError(-i);
-        if (err_string != NULL && _failures[i] > 0) {
-            snprintf(buf, sizeof(buf), "%-20s: %lld (%.2f%%)\n", err_string, _failures[i], _failures[i] * spercent);
+        u64 failures = _dump_counters.failures[i];
+        if (err_string != NULL && failures > 0) {
+            snprintf(buf, sizeof(buf), "%-20s: %lld (%.2f%%)\n", err_string, failures, failures * spercent);
             out << buf;
         }
     }
+    u64 truncated_samples = _call_trace_storage.truncatedSamples();
+    if (truncated_samples > 0) {
+        snprintf(buf, sizeof(buf), "%-20s: %lld (%.2f%%)\n", "storage_truncated", truncated_samples, truncated_samples * spercent);
+        out << buf;
+    }
+    u64 recovered_samples = _dump_counters.recovered_samples;
+    if (recovered_samples > 0) {
+        snprintf(buf, sizeof(buf), "%-20s: %lld (%.2f%%)\n", "percpu_recovered", recovered_samples, recovered_samples * spercent);
+        out << buf;
+    }
     out << std::endl;
 
     double cpercent = 100.0 / total_counter;
@@ -1200,6 +1695,7 @@ void Profiler::dumpText(std::ostream& out, Arguments& args) {
     // Print top call stacks
     if (args._dump_traces > 0) {
         std::sort(samples.begin(), samples.end());
+        std::vector<ASGCT_CallFrame> frame_buf;
 
         int max_count = args._dump_traces;
         for (std::vector<CallTraceSample>::const_iterator it = samples.begin(); it != samples.end() && --max_count >= 0; ++it) {
@@ -1209,8 +1705,9 @@ void Profiler::dumpText(std::ostream& out, Arguments& args) {
             out << buf;
 
             CallTrace* trace = it->trace;
+            ASGCT_CallFrame* frames = _call_trace_storage.getFrames(trace, frame_buf);
             for (int j = 0; j < trace->num_frames; j++) {
-                const char* frame_name = fn.name(trace->frames[j]);
+                const char* frame_name = fn.name(frames[j]);
                 snprintf(buf, sizeof(buf) - 1, "  [%2d] %s\n", j, frame_name);
                 out << buf;
             }
@@ -1222,7 +1719,9 @@ void Profiler::dumpText(std::ostream& out, Arguments& args) {
     if (args._dump_flat > 0) {
         std::map<std::string, MethodSample> histogram;
         for (std::vector<CallTraceSample>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
-            const char* frame_name = fn.name(it->trace->frames[0]);
+            CallTrace* trace = it->trace;
+            ASGCT_CallFrame top_frame = _call_trace_storage.getTopFrame(trace);
+            const char* frame_name = fn.name(top_frame);
             histogram[frame_name].add(it->samples, it->counter);
         }
 
@@ -1242,6 +1741,45 @@ void Profiler::dumpText(std::ostream& out, Arguments& args) {
     }
 }
 
+void Profiler::dumpMetrics(std::ostream& out) {
+    out << "--- Profiler metrics ---" << std::endl;
+    _metrics.dump(out);
+
+    long long native_libs = 0;
+    int native_lib_count = _native_lib_count;
+    for (int i = 0; i < native_lib_count; i++) {
+        native_libs += _native_libs[i]->usedMemory();
+    }
+
+    u64 jfr_dropped = _jfr.droppedEvents();
+    if (jfr_dropped > 0) {
+        out << "JFR events dropped: " << jfr_dropped << std::endl;
+    }
+
+    struct {
+        const char* name;
+        long long bytes;
+    } memory[] = {
+        {"trace_allocator", (long long)_call_trace_storage.allocatorMemory()},
+        {"trace_tables", (long long)_call_trace_storage.tableMemory()},
+        {"method_index", (long long)_call_trace_storage.indexMemory()},
+        {"class_map", _class_map.usedMemory()},
+        {"symbol_map", _symbol_map.usedMemory()},
+        {"java_methods", _java_methods.usedMemory()},
+        {"compiled_methods", _compiled_methods.usedMemory()},
+        {"runtime_stubs", _runtime_stubs.usedMemory()},
+        {"native_libs", native_libs},
+    };
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%-16s %12s\n", "memory", "bytes");
+    out << buf;
+    for (size_t i = 0; i < sizeof(memory) / sizeof(memory[0]); i++) {
+        snprintf(buf, sizeof(buf), "%-16s %12lld\n", memory[i].name, memory[i].bytes);
+        out << buf;
+    }
+}
+
 Error Profiler::runInternal(Arguments& args, std::ostream& out) {
     switch (args._action) {
         case ACTION_START:
@@ -1255,12 +1793,16 @@ Error Profiler::runInternal(Arguments& args, std::ostream& out) {
         }
         case ACTION_STOP: {
             Error error = stop();
-            if (error) {
+            if (args._output != OUTPUT_NONE) {
+                return dump(out, args);
+            } else if (error) {
                 return error;
             }
             out << "Profiling stopped after " << uptime() << " seconds. No dump options specified" << std::endl;
             break;
         }
+        case ACTION_DUMP:
+            return dump(out, args);
         case ACTION_CHECK: {
             Error error = check(args);
             if (error) {
@@ -1276,8 +1818,21 @@ Error Profiler::runInternal(Arguments& args, std::ostream& out) {
             } else {
                 out << "Profiler is not active" << std::endl;
             }
+
+            char buf[128];
+            u64 limit = _call_trace_storage.memoryLimit();
+            if (limit > 0) {
+                snprintf(buf, sizeof(buf), "Call trace storage: %.1f MB of %.1f MB limit",
+                         _call_trace_storage.usedMemory() / 1048576.0, limit / 1048576.0);
+            } else {
+                snprintf(buf, sizeof(buf), "Call trace storage: %.1f MB", _call_trace_storage.usedMemory() / 1048576.0);
+            }
+            out << buf << std::endl;
             break;
         }
+        case ACTION_METRICS:
+            dumpMetrics(out);
+            break;
         case ACTION_LIST: {
             out << "Basic events:" << std::endl;
             out << "  " << EVENT_CPU << std::endl;
@@ -1297,6 +1852,7 @@ Error Profiler::runInternal(Arguments& args, std::ostream& out) {
                     if (event_name == NULL) break;
                     out << "  " << event_name << std::endl;
                 }
+                out << "  " << EVENT_OFFCPU << std::endl;
             }
             break;
         }
@@ -1307,10 +1863,6 @@ Error Profiler::runInternal(Arguments& args, std::ostream& out) {
         case ACTION_FULL_VERSION:
             out << FULL_VERSION_STRING;
             break;
-        case ACTION_DUMP:
-            stop();
-            dump(out, args);
-            break;
         default:
             break;
     }
@@ -1320,6 +1872,14 @@ Error Profiler::runInternal(Arguments& args, std::ostream& out) {
 Error Profiler::run(Arguments& args) {
     if (!args.hasOutputFile()) {
         return runInternal(args, std::cout);
+    } else if (args._compress == COMPRESS_GZIP) {
+        GzipOutputStream out(args._file);
+        if (!out.is_open()) {
+            return Error(GzipWriter::available() ? "Could not open output file" : "zlib is not available");
+        }
+        Error error = runInternal(args, out);
+        out.close();
+        return error;
     } else {
         std::ofstream out(args._file, std::ios::out | std::ios::trunc);
         if (!out.is_open()) {
@@ -1336,7 +1896,7 @@ void Profiler::shutdown(Arguments& args) {
 
     // The last chance to dump profile before VM terminates
     if (_state == RUNNING) {
-        args._action = ACTION_DUMP;
+        args._action = ACTION_STOP;
         Error error = args._output == OUTPUT_NONE ? stop() : run(args);
         if (error) {
             Log::error(error.message());
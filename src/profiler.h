@@ -24,13 +24,17 @@
 #include "arguments.h"
 #include "callTraceStorage.h"
 #include "codeCache.h"
+#include "compiledMethods.h"
 #include "dictionary.h"
 #include "engine.h"
 #include "event.h"
 #include "flightRecorder.h"
 #include "mutex.h"
+#include "sampleCounters.h"
 #include "spinLock.h"
+#include "stageMetrics.h"
 #include "threadFilter.h"
+#include "traceNormalizer.h"
 #include "trap.h"
 #include "vmEntry.h"
 
@@ -43,6 +47,7 @@ const int MAX_NATIVE_FRAMES = 128;
 const int RESERVED_FRAMES   = 4;
 const int MAX_NATIVE_LIBS   = 2048;
 const int CONCURRENCY_LEVEL = 16;
+const int MAX_CONCURRENCY_LEVEL = 1024;
 
 
 enum AddressType {
@@ -81,26 +86,45 @@ class Profiler {
     Dictionary _symbol_map;
     ThreadFilter _thread_filter;
     CallTraceStorage _call_trace_storage;
+    TraceNormalizer _trace_normalizer;
     FlightRecorder _jfr;
     Engine* _engine;
     int _event_mask;
     time_t _start_time;
 
-    u64 _total_samples;
-    u64 _failures[ASGCT_FAILURE_TYPES];
-
-    SpinLock _locks[CONCURRENCY_LEVEL];
-    CallTraceBuffer* _calltrace_buffer[CONCURRENCY_LEVEL];
+    StripedSampleCounters _counters;
+    SampleCounters _dump_counters;
+    // Samples already taken out of _counters by running dumps
+    u64 _dumped_samples;
+    StageMetrics _metrics;
+
+    // In per-CPU mode, there is one slot per CPU instead of a small pool shared by all threads.
+    // Each slot owns a call trace buffer, pending trace counters and a JFR recording buffer.
+    PaddedSpinLock _locks[MAX_CONCURRENCY_LEVEL];
+    CallTraceBuffer* _calltrace_buffer[MAX_CONCURRENCY_LEVEL];
+    CallTraceDeltas _trace_deltas[MAX_CONCURRENCY_LEVEL];
+    int _concurrency_level;
+    bool _per_cpu;
+    // Diagnostic mode: replays the shared lock pool to count samples saved by the per-CPU mode
+    bool _per_cpu_stats;
+    PaddedSpinLock _shadow_locks[CONCURRENCY_LEVEL];
     int _max_stack_depth;
     int _safe_mode;
     CStack _cstack;
     bool _add_thread_frame;
     bool _update_thread_names;
+    bool _annotate_tiers;
     volatile bool _thread_events_state;
+    // JVM TI reports GC pauses only in JFR mode
+    bool _gc_events;
+    bool _safepoint_tracing;
+    u64 _gc_start;
+    u32 _gc_id;
 
     SpinLock _jit_lock;
     SpinLock _stubs_lock;
     CodeCache _java_methods;
+    CompiledMethods _compiled_methods;
     NativeCodeCache _runtime_stubs;
     NativeCodeCache* _native_libs[MAX_NATIVE_LIBS];
     volatile int _native_lib_count;
@@ -124,30 +148,44 @@ class Profiler {
     Error installTraps(const char* begin, const char* end);
     void uninstallTraps();
 
-    void addJavaMethod(const void* address, int length, jmethodID method);
+    void addJavaMethod(const void* address, int length, jmethodID method, const void* compile_info);
     void removeJavaMethod(const void* address, jmethodID method);
     void addRuntimeStub(const void* address, int length, const char* name);
 
     void onThreadStart(jvmtiEnv* jvmti, JNIEnv* jni, jthread thread);
     void onThreadEnd(jvmtiEnv* jvmti, JNIEnv* jni, jthread thread);
+    void onGarbageCollectionStart();
+    void onGarbageCollectionFinish();
 
     const char* asgctError(int code);
     const char* units();
     u32 getLockIndex(int tid);
+    int lockSharedSlot(PaddedSpinLock* locks, int tid);
+    int lockPerCpuSlot(int tid);
     bool inJavaCode(void* ucontext);
     int getNativeTrace(Engine* engine, void* ucontext, ASGCT_CallFrame* frames, int tid);
-    int getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max_depth);
+    int walkDwarf(void* ucontext, const void** callchain, int max_depth);
+    int getJavaTraceAsync(void* ucontext, ASGCT_CallFrame* frames, int max_depth, int tid);
+    void retryJavaTrace(ASGCT_CallTrace* trace, int max_depth, void* ucontext, int tid);
     int getJavaTraceJvmti(jvmtiFrameInfo* jvmti_frames, ASGCT_CallFrame* frames, int max_depth);
+    void annotateJavaFrames(ASGCT_CallFrame* frames, int num_frames, const void* pc);
     int makeEventFrame(ASGCT_CallFrame* frames, jint event_type, uintptr_t id);
     bool fillTopFrame(const void* pc, ASGCT_CallFrame* frame);
     AddressType getAddressType(instruction_t* pc);
     void setThreadInfo(int tid, const char* name, jlong java_thread_id);
     void updateThreadName(jvmtiEnv* jvmti, JNIEnv* jni, jthread thread);
+    void flushTraceDeltas();
     void updateJavaThreadNames();
     void updateNativeThreadNames();
     bool excludeTrace(FrameName* fn, CallTrace* trace);
     void mangle(const char* name, char* buf, size_t size);
     Engine* selectEngine(const char* event_name);
+    void dumpOutput(std::ostream& out, Arguments& args);
+    void dumpCollapsed(std::ostream& out, Arguments& args);
+    bool parseRatio(const char* ratio, int* num, int* den, double* scale);
+    void dumpFlameGraph(std::ostream& out, Arguments& args, bool tree);
+    void dumpText(std::ostream& out, Arguments& args);
+    void dumpMetrics(std::ostream& out);
     Error checkJvmCapabilities();
 
   public:
@@ -159,11 +197,19 @@ class Profiler {
         _end_trap(),
         _thread_filter(),
         _call_trace_storage(),
+        _trace_normalizer(),
         _jfr(),
         _start_time(0),
+        _concurrency_level(CONCURRENCY_LEVEL),
+        _per_cpu(false),
+        _per_cpu_stats(false),
         _max_stack_depth(0),
         _safe_mode(0),
         _thread_events_state(JVMTI_DISABLE),
+        _gc_events(false),
+        _safepoint_tracing(false),
+        _gc_start(0),
+        _gc_id(0),
         _jit_lock(),
         _stubs_lock(),
         _java_methods(),
@@ -171,16 +217,18 @@ class Profiler {
         _native_lib_count(0),
         _original_NativeLibrary_load(NULL) {
 
-        for (int i = 0; i < CONCURRENCY_LEVEL; i++) {
+        for (int i = 0; i < MAX_CONCURRENCY_LEVEL; i++) {
             _calltrace_buffer[i] = NULL;
         }
     }
 
-    u64 total_samples() { return _total_samples; }
+    u64 total_samples() { return _dumped_samples + _counters.totalSamples(); }
+    int concurrency_level() { return _concurrency_level; }
     time_t uptime()     { return time(NULL) - _start_time; }
 
     Dictionary* classMap() { return &_class_map; }
     ThreadFilter* threadFilter() { return &_thread_filter; }
+    TraceNormalizer* traceNormalizer() { return &_trace_normalizer; }
 
     Error run(Arguments& args);
     Error runInternal(Arguments& args, std::ostream& out);
@@ -189,11 +237,11 @@ class Profiler {
     Error start(Arguments& args, bool reset);
     Error stop();
     void switchThreadEvents(jvmtiEventMode mode);
-    void dump(std::ostream& out, Arguments& args);
-    void dumpCollapsed(std::ostream& out, Arguments& args);
-    void dumpFlameGraph(std::ostream& out, Arguments& args, bool tree);
-    void dumpText(std::ostream& out, Arguments& args);
+    void switchGCEvents(bool enable);
+    Error dump(std::ostream& out, Arguments& args);
     void recordSample(void* ucontext, u64 counter, jint event_type, Event* event);
+    void recordExternalSample(u64 counter, int tid, int num_ips, const void** ips, ExecutionEvent* event);
+    void recordPause(PauseType type, PauseEvent* event);
 
     void updateSymbols(bool kernel_symbols);
     const void* resolveSymbol(const char* name);
@@ -208,7 +256,7 @@ class Profiler {
                                            jint code_size, const void* code_addr,
                                            jint map_length, const jvmtiAddrLocationMap* map,
                                            const void* compile_info) {
-        _instance.addJavaMethod(code_addr, code_size, method);
+        _instance.addJavaMethod(code_addr, code_size, method, compile_info);
     }
 
     static void JNICALL CompiledMethodUnload(jvmtiEnv* jvmti, jmethodID method,
@@ -229,6 +277,14 @@ class Profiler {
         _instance.onThreadEnd(jvmti, jni, thread);
     }
 
+    static void JNICALL GarbageCollectionStart(jvmtiEnv* jvmti) {
+        _instance.onGarbageCollectionStart();
+    }
+
+    static void JNICALL GarbageCollectionFinish(jvmtiEnv* jvmti) {
+        _instance.onGarbageCollectionFinish();
+    }
+
     friend class Recording;
 };
 
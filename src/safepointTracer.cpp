@@ -0,0 +1,79 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <time.h>
+#include "safepointTracer.h"
+#include "profiler.h"
+#include "vmStructs.h"
+
+
+Error SafepointTracer::start(Arguments& args) {
+    if (!SafepointSynchronize::available()) {
+        return Error("Safepoint state is not available in this JVM");
+    }
+
+    _interval = args._safepoints;
+    _running = true;
+
+    if (pthread_create(&_thread, NULL, threadEntry, this) != 0) {
+        return Error("Unable to create safepoint tracer thread");
+    }
+
+    return Error::OK;
+}
+
+void SafepointTracer::stop() {
+    _running = false;
+    pthread_join(_thread, NULL);
+}
+
+void SafepointTracer::pollLoop() {
+    struct timespec timeout;
+    timeout.tv_sec = _interval / 1000000000;
+    timeout.tv_nsec = _interval % 1000000000;
+
+    PauseEvent event;
+    event._id = 0;
+    int last_state = SafepointSynchronize::NOT_SYNCHRONIZED;
+
+    while (_running) {
+        int state = SafepointSynchronize::state();
+        if (state != last_state) {
+            u64 now = OS::nanotime();
+            if (last_state == SafepointSynchronize::NOT_SYNCHRONIZED) {
+                event._id++;
+                event._start_time = now;
+                event._sync_time = 0;
+            }
+
+            if (state == SafepointSynchronize::SYNCHRONIZED) {
+                event._sync_time = now;
+            } else if (state == SafepointSynchronize::NOT_SYNCHRONIZED) {
+                // If synchronization happened between two polls, it is attributed to the end
+                if (event._sync_time == 0) {
+                    event._sync_time = now;
+                }
+                event._end_time = now;
+                Profiler::_instance.recordPause(PAUSE_SAFEPOINT, &event);
+            }
+
+            last_state = state;
+        }
+
+        nanosleep(&timeout, NULL);
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SAFEPOINTTRACER_H
+#define _SAFEPOINTTRACER_H
+
+#include <pthread.h>
+#include "engine.h"
+
+
+// HotSpot has no callback for safepoints, so a background thread polls
+// SafepointSynchronize::_state and records a JFR event for every safepoint it observes.
+// Safepoints shorter than the polling interval may be missed.
+class SafepointTracer : public Engine {
+  private:
+    long _interval;
+    volatile bool _running;
+    pthread_t _thread;
+
+    void pollLoop();
+
+    static void* threadEntry(void* safepoint_tracer) {
+        ((SafepointTracer*)safepoint_tracer)->pollLoop();
+        return NULL;
+    }
+
+  public:
+    Error start(Arguments& args);
+    void stop();
+};
+
+#endif // _SAFEPOINTTRACER_H
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SAMPLEAGGREGATOR_H
+#define _SAMPLEAGGREGATOR_H
+
+#include "arch.h"
+
+
+const int AGGREGATOR_CAPACITY = 1024;
+
+struct AggregatedSample {
+    u32 tid;
+    u32 call_trace_id;
+    u32 thread_state;
+    u32 count;
+};
+
+// Counts execution samples by (thread, call trace, thread state) within a time slice.
+// Each instance belongs to one sample slot of the Profiler, so it is only accessed
+// under the slot lock. Open addressing with linear probing; count == 0 marks a free cell.
+class SampleAggregator {
+  private:
+    AggregatedSample _table[AGGREGATOR_CAPACITY];
+    int _size;
+    u64 _slice_start;
+
+    static u32 hash(u32 tid, u32 call_trace_id, u32 thread_state) {
+        u32 h = (call_trace_id * 0x9e3779b1) ^ (tid * 0x85ebca6b) ^ thread_state;
+        return h ^ (h >> 15);
+    }
+
+  public:
+    SampleAggregator() : _size(0), _slice_start(0) {
+        clear();
+    }
+
+    int size() {
+        return _size;
+    }
+
+    u64 sliceStart() {
+        return _slice_start;
+    }
+
+    void startSlice(u64 start) {
+        _slice_start = start;
+    }
+
+    // Returns false if a new key does not fit; the caller should flush and retry.
+    // The table is never filled over 3/4 to keep probe sequences short
+    bool add(u32 tid, u32 call_trace_id, u32 thread_state) {
+        u32 mask = AGGREGATOR_CAPACITY - 1;
+        for (u32 i = hash(tid, call_trace_id, thread_state) & mask; ; i = (i + 1) & mask) {
+            AggregatedSample* s = &_table[i];
+            if (s->count == 0) {
+                if (_size >= AGGREGATOR_CAPACITY * 3 / 4) {
+                    return false;
+                }
+                s->tid = tid;
+                s->call_trace_id = call_trace_id;
+                s->thread_state = thread_state;
+                s->count = 1;
+                _size++;
+                return true;
+            } else if (s->call_trace_id == call_trace_id && s->tid == tid && s->thread_state == thread_state) {
+                s->count++;
+                return true;
+            }
+        }
+    }
+
+    AggregatedSample* at(int index) {
+        return &_table[index];
+    }
+
+    void clear() {
+        for (int i = 0; i < AGGREGATOR_CAPACITY; i++) {
+            _table[i].count = 0;
+        }
+        _size = 0;
+    }
+};
+
+#endif // _SAMPLEAGGREGATOR_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SAMPLECOUNTERS_H
+#define _SAMPLECOUNTERS_H
+
+#include <string.h>
+#include "arch.h"
+#include "vmEntry.h"
+
+
+const int COUNTER_STRIPES = 64;
+
+// Global sample statistics are split into cache line padded stripes selected by thread ID,
+// so that signal handlers running on different CPUs rarely update the same cache line.
+// Updates are still atomic, but almost never contended.
+struct alignas(CACHE_LINE_SIZE) SampleCounters {
+    u64 total_samples;
+    u64 recovered_samples;
+    u64 failures[ASGCT_FAILURE_TYPES];
+};
+
+class StripedSampleCounters {
+  private:
+    SampleCounters _stripes[COUNTER_STRIPES];
+
+  public:
+    SampleCounters& stripe(int tid) {
+        return _stripes[(u32)tid % COUNTER_STRIPES];
+    }
+
+    void clear() {
+        memset(_stripes, 0, sizeof(_stripes));
+    }
+
+    u64 totalSamples() {
+        u64 sum = 0;
+        for (int i = 0; i < COUNTER_STRIPES; i++) sum += _stripes[i].total_samples;
+        return sum;
+    }
+
+    // Sums up all stripes. With reset, the counted values are atomically taken out,
+    // so that the next snapshot covers only the samples recorded after this one
+    void snapshot(SampleCounters& total, bool reset) {
+        memset(&total, 0, sizeof(total));
+        for (int i = 0; i < COUNTER_STRIPES; i++) {
+            SampleCounters& s = _stripes[i];
+            total.total_samples += take(s.total_samples, reset);
+            total.recovered_samples += take(s.recovered_samples, reset);
+            for (int j = 0; j < ASGCT_FAILURE_TYPES; j++) {
+                total.failures[j] += take(s.failures[j], reset);
+            }
+        }
+    }
+
+  private:
+    static u64 take(u64& counter, bool reset) {
+        return reset ? __sync_lock_test_and_set(&counter, 0) : counter;
+    }
+};
+
+#endif // _SAMPLECOUNTERS_H
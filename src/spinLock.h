@@ -63,4 +63,10 @@ class SpinLock {
     }
 };
 
+
+// SpinLock that occupies the whole cache line, so that neighbouring locks
+// in an array do not suffer from false sharing
+class alignas(CACHE_LINE_SIZE) PaddedSpinLock : public SpinLock {
+};
+
 #endif // _SPINLOCK_H
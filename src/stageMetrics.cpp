@@ -0,0 +1,94 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include "stageMetrics.h"
+#include "os.h"
+
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+    "sample",
+    "native_trace",
+    "java_trace",
+    "java_recovery",
+    "jvmti_trace",
+    "storage_put",
+    "jfr_event"
+};
+
+
+void StageMetrics::clear() {
+    memset(_stripes, 0, sizeof(_stripes));
+    _start_ticks = ticks();
+    _start_nanos = OS::nanotime();
+}
+
+void StageMetrics::merge(int stage, StageHistogram& result) {
+    memset(&result, 0, sizeof(result));
+    for (int i = 0; i < METRICS_STRIPES; i++) {
+        StageHistogram& h = _stripes[i].stages[stage];
+        result.count += h.count;
+        result.total_ticks += h.total_ticks;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            result.buckets[b] += h.buckets[b];
+        }
+    }
+}
+
+// Histograms keep only powers of two, so the result is rounded up to 2^(N+1) ticks,
+// where N is the bucket containing the requested fraction of all durations
+u64 StageMetrics::percentile(const StageHistogram& h, double fraction) {
+    u64 threshold = (u64)(h.count * fraction);
+    u64 sum = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        sum += h.buckets[b];
+        if (sum > threshold) {
+            return 2ULL << b;
+        }
+    }
+    return 2ULL << (METRICS_BUCKETS - 1);
+}
+
+void StageMetrics::dump(std::ostream& out) {
+    // Calibrate ticks against the monotonic clock over the whole measurement period
+    u64 elapsed_ticks = ticks() - _start_ticks;
+    u64 elapsed_nanos = OS::nanotime() - _start_nanos;
+    double ns_per_tick = elapsed_ticks > 0 && elapsed_nanos > 0 ? (double)elapsed_nanos / elapsed_ticks : 1.0;
+
+    char buf[256];
+    if (!_enabled) {
+        out << "Stage latencies are recorded only when profiling is started with 'timing'" << std::endl;
+        return;
+    }
+
+    snprintf(buf, sizeof(buf), "%-16s %12s %10s %10s %10s %10s\n",
+             "stage", "count", "avg ns", "p50 ns", "p90 ns", "p99 ns");
+    out << buf;
+
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        StageHistogram h;
+        merge(stage, h);
+        if (h.count == 0) continue;
+
+        snprintf(buf, sizeof(buf), "%-16s %12lld %10.0f %10.0f %10.0f %10.0f\n",
+                 STAGE_NAMES[stage], h.count,
+                 h.total_ticks * ns_per_tick / h.count,
+                 percentile(h, 0.50) * ns_per_tick,
+                 percentile(h, 0.90) * ns_per_tick,
+                 percentile(h, 0.99) * ns_per_tick);
+        out << buf;
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STAGEMETRICS_H
+#define _STAGEMETRICS_H
+
+#include <ostream>
+#include <string.h>
+#include "arch.h"
+#include "sampleCounters.h"
+
+#if defined(__arm__) || defined(__thumb__)
+#include <time.h>
+#endif
+
+
+enum MetricsStage {
+    STAGE_SAMPLE,
+    STAGE_NATIVE_TRACE,
+    STAGE_JAVA_TRACE,
+    STAGE_JAVA_RECOVERY,
+    STAGE_JVMTI_TRACE,
+    STAGE_STORAGE_PUT,
+    STAGE_JFR_EVENT,
+    STAGE_COUNT
+};
+
+const int METRICS_STRIPES = COUNTER_STRIPES;
+const int METRICS_BUCKETS = 32;
+
+// Cheap monotonic timestamp in CPU-specific units. Converted to nanoseconds only when reporting
+static inline u64 ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    u32 lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+#elif defined(__aarch64__)
+    u64 result;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(result));
+    return result;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Bucket N counts durations in [2^N, 2^(N+1)) ticks
+struct StageHistogram {
+    u64 count;
+    u64 total_ticks;
+    u64 buckets[METRICS_BUCKETS];
+};
+
+struct alignas(CACHE_LINE_SIZE) MetricsStripe {
+    StageHistogram stages[STAGE_COUNT];
+};
+
+// Latency of the signal handler stages, recorded on every sample while enabled.
+// Like sample counters, histograms are striped by thread ID to avoid contention.
+class StageMetrics {
+  private:
+    MetricsStripe _stripes[METRICS_STRIPES];
+    bool _enabled;
+    u64 _start_ticks;
+    u64 _start_nanos;
+
+    void merge(int stage, StageHistogram& result);
+
+  public:
+    StageMetrics() : _enabled(false) {
+        clear();
+    }
+
+    void clear();
+
+    void setEnabled(bool enabled) {
+        _enabled = enabled;
+    }
+
+    bool enabled() {
+        return _enabled;
+    }
+
+    // Start timestamp of a stage, or 0 when timing is disabled
+    u64 start() {
+        return _enabled ? ticks() : 0;
+    }
+
+    void record(int tid, MetricsStage stage, u64 start_ticks) {
+        if (!_enabled) return;
+
+        u64 elapsed = ticks() - start_ticks;
+        int bucket = 63 - __builtin_clzll(elapsed | 1);
+        if (bucket >= METRICS_BUCKETS) bucket = METRICS_BUCKETS - 1;
+
+        StageHistogram& h = _stripes[(u32)tid % METRICS_STRIPES].stages[stage];
+        atomicInc(h.count);
+        atomicInc(h.total_ticks, elapsed);
+        atomicInc(h.buckets[bucket]);
+    }
+
+    void dump(std::ostream& out);
+
+    // Upper bound of the bucket that holds the given fraction of durations, in ticks
+    static u64 percentile(const StageHistogram& h, double fraction);
+};
+
+#endif // _STAGEMETRICS_H
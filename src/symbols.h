@@ -27,10 +27,12 @@ class Symbols {
     static Mutex _parse_lock;
     static std::set<const void*> _parsed_libraries;
     static bool _have_kernel_symbols;
+    static bool _have_unwind_tables;
 
   public:
     static void parseKernelSymbols(NativeCodeCache* cc);
     static void parseLibraries(NativeCodeCache** array, volatile int& count, int size, bool kernel_symbols);
+    static void parseUnwindTables(NativeCodeCache** array, int count);
 
     static bool haveKernelSymbols() {
         return _have_kernel_symbols;
@@ -32,6 +32,7 @@
 #include <string>
 #include "symbols.h"
 #include "arch.h"
+#include "dwarf.h"
 #include "log.h"
 
 
@@ -142,10 +143,12 @@ class ElfParser {
     bool loadSymbolsUsingDebugLink();
     void loadSymbolTable(ElfSection* symtab);
     void addRelocationSymbols(ElfSection* reltab, const char* plt);
+    void loadUnwindTable();
 
   public:
     static bool parseFile(NativeCodeCache* cc, const char* base, const char* file_name, bool use_debug);
     static void parseMem(NativeCodeCache* cc, const char* base);
+    static void parseUnwindTable(NativeCodeCache* cc, const char* base, const char* file_name);
 };
 
 
@@ -189,6 +192,25 @@ void ElfParser::parseMem(NativeCodeCache* cc, const char* base) {
     elf.loadSymbols(false);
 }
 
+void ElfParser::parseUnwindTable(NativeCodeCache* cc, const char* base, const char* file_name) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+
+    size_t length = (size_t)lseek64(fd, 0, SEEK_END);
+    void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (addr != MAP_FAILED) {
+        ElfParser elf(cc, base, addr, file_name);
+        if (elf.valid_header()) {
+            elf.loadUnwindTable();
+        }
+        munmap(addr, length);
+    }
+}
+
 void ElfParser::loadSymbols(bool use_debug) {
     if (!valid_header()) {
         return;
@@ -335,10 +357,38 @@ void ElfParser::addRelocationSymbols(ElfSection* reltab, const char* plt) {
     }
 }
 
+// Build a compact unwind table from Call Frame Information for DWARF stack walking
+void ElfParser::loadUnwindTable() {
+    bool debug_frame = false;
+    ElfSection* section = findSection(SHT_PROGBITS, ".eh_frame");
+#ifdef SHT_X86_64_UNWIND
+    if (section == NULL) {
+        section = findSection(SHT_X86_64_UNWIND, ".eh_frame");
+    }
+#endif
+    if (section == NULL) {
+        section = findSection(SHT_PROGBITS, ".debug_frame");
+        debug_frame = true;
+    }
+    if (section == NULL || section->sh_size == 0) {
+        return;
+    }
+
+    DwarfParser dwarf(at(section), section->sh_size, section->sh_addr, debug_frame);
+    if (dwarf.count() > 0) {
+        FrameDesc* table = (FrameDesc*)realloc(dwarf.table(), dwarf.count() * sizeof(FrameDesc));
+        // Addresses in a non-PIE executable are absolute
+        _cc->setDwarfTable(_header->e_type == ET_EXEC ? NULL : _base, table, dwarf.count());
+    } else {
+        free(dwarf.table());
+    }
+}
+
 
 Mutex Symbols::_parse_lock;
 std::set<const void*> Symbols::_parsed_libraries;
 bool Symbols::_have_kernel_symbols = false;
+bool Symbols::_have_unwind_tables = false;
 
 void Symbols::parseKernelSymbols(NativeCodeCache* cc) {
     std::ifstream maps("/proc/kallsyms");
@@ -389,6 +439,9 @@ void Symbols::parseLibraries(NativeCodeCache** array, volatile int& count, int s
 
             if (map.inode() != 0) {
                 ElfParser::parseFile(cc, image_base - map.offs(), map.file(), true);
+                if (_have_unwind_tables) {
+                    ElfParser::parseUnwindTable(cc, image_base - map.offs(), map.file());
+                }
             } else if (strcmp(map.file(), "[vdso]") == 0) {
                 ElfParser::parseMem(cc, image_base);
             }
@@ -400,4 +453,31 @@ void Symbols::parseLibraries(NativeCodeCache** array, volatile int& count, int s
     }
 }
 
+// Unwind tables take noticeable time and memory to build, and only cstack=dwarf needs them.
+// Build them for the libraries parsed so far; parseLibraries takes care of the ones loaded later.
+void Symbols::parseUnwindTables(NativeCodeCache** array, int count) {
+    MutexLocker ml(_parse_lock);
+
+    if (!DWARF_SUPPORTED || _have_unwind_tables) {
+        return;
+    }
+    _have_unwind_tables = true;
+
+    std::ifstream maps("/proc/self/maps");
+    std::string str;
+
+    while (std::getline(maps, str)) {
+        MemoryMapDesc map(str.c_str());
+        if (map.isExecutable() && map.file() != NULL && map.file()[0] != 0 && map.inode() != 0) {
+            const char* image_base = map.addr();
+            for (int i = 0; i < count; i++) {
+                if (array[i]->contains(image_base) && strcmp(array[i]->name(), map.file()) == 0) {
+                    ElfParser::parseUnwindTable(array[i], image_base - map.offs(), map.file());
+                    break;
+                }
+            }
+        }
+    }
+}
+
 #endif // __linux__
@@ -131,6 +131,7 @@ class MachOParser {
 Mutex Symbols::_parse_lock;
 std::set<const void*> Symbols::_parsed_libraries;
 bool Symbols::_have_kernel_symbols = false;
+bool Symbols::_have_unwind_tables = false;
 
 void Symbols::parseKernelSymbols(NativeCodeCache* cc) {
 }
@@ -156,4 +157,7 @@ void Symbols::parseLibraries(NativeCodeCache** array, volatile int& count, int s
     }
 }
 
+void Symbols::parseUnwindTables(NativeCodeCache** array, int count) {
+}
+
 #endif // __APPLE__
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "compiledMethods.h"
+#include "traceNormalizer.h"
+
+
+static const int GENERATED_METHODS_BITS = 16;
+
+// Name fragments of classes that only forward calls to the real target
+static const char* const GENERATED_CLASS_PATTERNS[] = {
+    "$$Lambda",
+    "/$Proxy",
+    "LambdaForm$",
+    "/GeneratedMethodAccessor",
+    "/GeneratedConstructorAccessor",
+    "/GeneratedSerializationConstructorAccessor",
+    "CGLIB$$",
+    "$ByteBuddy$",
+    NULL
+};
+
+// A run of recursive calls is marked with the power of two not exceeding its length
+static const char* const RECURSION_NAMES[] = {
+    "recursion x2+",
+    "recursion x4+",
+    "recursion x8+",
+    "recursion x16+",
+    "recursion x32+",
+    "recursion x64+",
+    "recursion x128+",
+    "recursion x256+",
+    "recursion x512+",
+    "recursion x1024+"
+};
+
+static const int RECURSION_BUCKETS = sizeof(RECURSION_NAMES) / sizeof(RECURSION_NAMES[0]);
+
+
+static inline bool isJavaFrame(const ASGCT_CallFrame& frame) {
+    return frame.bci > BCI_NATIVE_FRAME;
+}
+
+Error TraceNormalizer::init(int stages) {
+    if ((stages & NORMALIZE_LAMBDA) && _generated_methods == NULL) {
+        MethodIndex* generated_methods = new MethodIndex(GENERATED_METHODS_BITS);
+        if (!generated_methods->valid()) {
+            delete generated_methods;
+            return Error("Not enough memory to track generated methods");
+        }
+
+        // Publish the set first, so that classes prepared during the scan are not missed.
+        // Once enabled, tracking continues until the end of the process
+        _generated_methods = generated_methods;
+
+        jvmtiEnv* jvmti = VM::jvmti();
+        jint class_count;
+        jclass* classes;
+        if (jvmti->GetLoadedClasses(&class_count, &classes) == 0) {
+            for (int i = 0; i < class_count; i++) {
+                jint method_count;
+                jmethodID* methods;
+                if (jvmti->GetClassMethods(classes[i], &method_count, &methods) == 0) {
+                    addGeneratedMethods(jvmti, classes[i], method_count, methods);
+                    jvmti->Deallocate((unsigned char*)methods);
+                }
+            }
+            jvmti->Deallocate((unsigned char*)classes);
+        }
+    }
+
+    _stages = stages;
+    return Error::OK;
+}
+
+void TraceNormalizer::onClassPrepare(jvmtiEnv* jvmti, jclass klass, jint method_count, jmethodID* methods) {
+    if (_generated_methods != NULL) {
+        addGeneratedMethods(jvmti, klass, method_count, methods);
+    }
+}
+
+void TraceNormalizer::addGeneratedMethods(jvmtiEnv* jvmti, jclass klass, jint method_count, jmethodID* methods) {
+    char* signature;
+    if (jvmti->GetClassSignature(klass, &signature, NULL) != 0) {
+        return;
+    }
+
+    if (isGeneratedClass(signature)) {
+        for (int i = 0; i < method_count; i++) {
+            _generated_methods->lookup(methods[i]);
+        }
+    }
+    jvmti->Deallocate((unsigned char*)signature);
+}
+
+bool TraceNormalizer::isGeneratedClass(const char* signature) {
+    for (const char* const* pattern = GENERATED_CLASS_PATTERNS; *pattern != NULL; pattern++) {
+        if (strstr(signature, *pattern) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ASGCT_CallFrame TraceNormalizer::recursionFrame(int count) {
+    int bucket = 0;
+    while (count >= 4 && bucket < RECURSION_BUCKETS - 1) {
+        count >>= 1;
+        bucket++;
+    }
+
+    ASGCT_CallFrame frame;
+    frame.bci = BCI_ERROR;
+    frame.method_id = (jmethodID)RECURSION_NAMES[bucket];
+    return frame;
+}
+
+// Replaces a run of frames of the same method with one frame of this method
+// called from a marker frame. Runs are bucketed by length, otherwise
+// every recursion depth would still produce a distinct trace.
+int TraceNormalizer::collapseRecursion(int num_frames, ASGCT_CallFrame* frames) {
+    int out = 0;
+    for (int i = 0; i < num_frames; ) {
+        ASGCT_CallFrame frame = frames[i];
+        int run = 1;
+        if (isJavaFrame(frame) || frame.bci == BCI_NATIVE_FRAME) {
+            while (i + run < num_frames && frames[i + run].method_id == frame.method_id && frames[i + run].bci >= BCI_NATIVE_FRAME) {
+                run++;
+            }
+        }
+
+        // out <= i, so the frames yet to be read are never overwritten
+        if (run > 1) {
+            frames[out++] = recursionFrame(run);
+        }
+        frames[out++] = frame;
+        i += run;
+    }
+    return out;
+}
+
+// Called inside signal handler
+int TraceNormalizer::normalize(int num_frames, ASGCT_CallFrame* frames) {
+    MethodIndex* generated_methods = (_stages & NORMALIZE_LAMBDA) ? _generated_methods : NULL;
+    bool erase_bci = (_stages & NORMALIZE_BCI) != 0;
+
+    int out = 0;
+    for (int i = 0; i < num_frames; i++) {
+        ASGCT_CallFrame frame = frames[i];
+        if (isJavaFrame(frame)) {
+            if (generated_methods != NULL && generated_methods->contains(frame.method_id)) {
+                continue;
+            }
+            if (erase_bci && frameBci(frame.bci) > 0) {
+                // Keep the compilation tier of the frame
+                frame.bci = encodeFrameTier(frameTier(frame.bci), 0);
+            }
+        }
+        frames[out++] = frame;
+    }
+
+    if (_stages & NORMALIZE_RECURSION) {
+        out = collapseRecursion(out, frames);
+    }
+    return out;
+}
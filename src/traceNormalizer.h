@@ -0,0 +1,52 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TRACENORMALIZER_H
+#define _TRACENORMALIZER_H
+
+#include "arguments.h"
+#include "methodIndex.h"
+#include "vmEntry.h"
+
+
+// Rewrites stack traces before they are stored to reduce the number of distinct traces
+class TraceNormalizer {
+  private:
+    int _stages;
+    // Methods of generated lambda, proxy and accessor classes, allocated on first use
+    MethodIndex* volatile _generated_methods;
+
+    static bool isGeneratedClass(const char* signature);
+    static ASGCT_CallFrame recursionFrame(int count);
+
+    void addGeneratedMethods(jvmtiEnv* jvmti, jclass klass, jint method_count, jmethodID* methods);
+    int collapseRecursion(int num_frames, ASGCT_CallFrame* frames);
+
+  public:
+    TraceNormalizer() : _stages(0), _generated_methods(NULL) {
+    }
+
+    Error init(int stages);
+    void onClassPrepare(jvmtiEnv* jvmti, jclass klass, jint method_count, jmethodID* methods);
+
+    bool enabled() {
+        return _stages != 0;
+    }
+
+    int normalize(int num_frames, ASGCT_CallFrame* frames);
+};
+
+#endif // _TRACENORMALIZER_H
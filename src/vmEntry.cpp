@@ -94,6 +94,7 @@ bool VM::init(JavaVM* vm, bool attach) {
     capabilities.can_generate_compiled_method_load_events = 1;
     capabilities.can_generate_monitor_events = 1;
     capabilities.can_tag_objects = 1;
+    capabilities.can_generate_garbage_collection_events = 1;
     _jvmti->AddCapabilities(&capabilities);
 
     jvmtiEventCallbacks callbacks = {0};
@@ -109,6 +110,8 @@ bool VM::init(JavaVM* vm, bool attach) {
     callbacks.ThreadEnd = Profiler::ThreadEnd;
     callbacks.MonitorContendedEnter = LockTracer::MonitorContendedEnter;
     callbacks.MonitorContendedEntered = LockTracer::MonitorContendedEntered;
+    callbacks.GarbageCollectionStart = Profiler::GarbageCollectionStart;
+    callbacks.GarbageCollectionFinish = Profiler::GarbageCollectionFinish;
     _jvmti->SetEventCallbacks(&callbacks, sizeof(callbacks));
 
     _jvmti->SetEventNotificationMode(JVMTI_ENABLE, JVMTI_EVENT_VM_INIT, NULL);
@@ -178,6 +181,7 @@ void VM::loadMethodIDs(jvmtiEnv* jvmti, JNIEnv* jni, jclass klass) {
     jint method_count;
     jmethodID* methods;
     if (jvmti->GetClassMethods(klass, &method_count, &methods) == 0) {
+        Profiler::_instance.traceNormalizer()->onClassPrepare(jvmti, klass, method_count, methods);
         jvmti->Deallocate((unsigned char*)methods);
     }
 }
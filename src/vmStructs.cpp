@@ -41,8 +41,11 @@ int VMStructs::_osthread_id_offset = -1;
 int VMStructs::_anchor_sp_offset = -1;
 int VMStructs::_anchor_pc_offset = -1;
 int VMStructs::_frame_size_offset = -1;
+int VMStructs::_comp_level_offset = -1;
 int VMStructs::_is_gc_active_offset = -1;
 char* VMStructs::_collected_heap_addr = NULL;
+volatile int* VMStructs::_safepoint_state_addr = NULL;
+const bool* VMStructs::_preserve_frame_pointer_addr = NULL;
 
 jfieldID VMStructs::_eetop;
 jfieldID VMStructs::_tid;
@@ -142,6 +145,10 @@ void VMStructs::initOffsets() {
             if (strcmp(field, "_frame_size") == 0) {
                 _frame_size_offset = *(int*)(entry + offset_offset);
             }
+        } else if (strcmp(type, "nmethod") == 0 || strcmp(type, "CompiledMethod") == 0) {
+            if (strcmp(field, "_comp_level") == 0) {
+                _comp_level_offset = *(int*)(entry + offset_offset);
+            }
         } else if (strcmp(type, "Universe") == 0) {
             if (strcmp(field, "_collectedHeap") == 0) {
                 _collected_heap_addr = **(char***)(entry + address_offset);
@@ -150,6 +157,10 @@ void VMStructs::initOffsets() {
             if (strcmp(field, "_is_gc_active") == 0) {
                 _is_gc_active_offset = *(int*)(entry + offset_offset);
             }
+        } else if (strcmp(type, "SafepointSynchronize") == 0) {
+            if (strcmp(field, "_state") == 0) {
+                _safepoint_state_addr = *(volatile int**)(entry + address_offset);
+            }
         } else if (strcmp(type, "PermGen") == 0) {
             _has_perm_gen = true;
         }
@@ -175,6 +186,9 @@ void VMStructs::initJvmFunctions() {
         _unsafe_park = (UnsafeParkFunc)_libjvm->findSymbol("_ZL11Unsafe_ParkP7JNIEnv_P8_jobjecthl");
     }
 
+    // JVM flags are extern "C" globals
+    _preserve_frame_pointer_addr = (const bool*)_libjvm->findSymbol("PreserveFramePointer");
+
     if (_frame_size_offset >= 0) {
         _find_blob = (FindBlobFunc)_libjvm->findSymbol("_ZN9CodeCache16find_blob_unsafeEPv");
         if (_find_blob == NULL) {
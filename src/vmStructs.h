@@ -44,8 +44,11 @@ class VMStructs {
     static int _anchor_sp_offset;
     static int _anchor_pc_offset;
     static int _frame_size_offset;
+    static int _comp_level_offset;
     static int _is_gc_active_offset;
     static char* _collected_heap_addr;
+    static volatile int* _safepoint_state_addr;
+    static const bool* _preserve_frame_pointer_addr;
 
     static jfieldID _eetop;
     static jfieldID _tid;
@@ -89,6 +92,11 @@ class VMStructs {
         return _has_thread_bridge;
     }
 
+    // -XX:+PreserveFramePointer: 1 if set, 0 if not, -1 if the flag cannot be found
+    static int preserveFramePointer() {
+        return _preserve_frame_pointer_addr != NULL ? (*_preserve_frame_pointer_addr ? 1 : 0) : -1;
+    }
+
     typedef jvmtiError (*GetStackTraceFunc)(void* self, void* thread,
                                             jint start_depth, jint max_frame_count,
                                             jvmtiFrameInfo* frame_buffer, jint* count_ptr);
@@ -238,6 +246,18 @@ class RuntimeStub : VMStructs {
     }
 };
 
+class NMethod : VMStructs {
+  public:
+    static NMethod* findBlob(const void* pc) {
+        return _find_blob != NULL && _comp_level_offset >= 0 ? (NMethod*)_find_blob(pc) : NULL;
+    }
+
+    // 1-3 for C1, 4 for C2
+    int level() {
+        return *(int*) at(_comp_level_offset);
+    }
+};
+
 class CollectedHeap : VMStructs {
   public:
     static bool isGCActive() {
@@ -246,4 +266,21 @@ class CollectedHeap : VMStructs {
     }
 };
 
+class SafepointSynchronize : VMStructs {
+  public:
+    enum SynchronizeState {
+        NOT_SYNCHRONIZED = 0,
+        SYNCHRONIZING    = 1,
+        SYNCHRONIZED     = 2
+    };
+
+    static bool available() {
+        return _safepoint_state_addr != NULL;
+    }
+
+    static int state() {
+        return *_safepoint_state_addr;
+    }
+};
+
 #endif // _VMSTRUCTS_H
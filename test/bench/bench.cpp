@@ -0,0 +1,72 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+
+// JVM-free micro-benchmarks of the profiler data structures.
+// Usage: bench [name...]  runs the given benchmarks or all of them.
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+    {"calltrace",    benchCallTraceStorage},
+    {"calltrace-mt", benchCallTraceStorageContended},
+    {"counters",     benchSampleCounters},
+    {"metrics",      benchStageMetrics},
+    {"dictionary",   benchDictionary},
+    {"allocator",    benchLinearAllocator},
+    {"codecache",    benchCodeCache},
+    {"nativecache",  benchNativeCodeCache},
+    {"threadfilter", benchThreadFilter},
+    {"jfrbuffer",    benchJfrBuffer},
+    {"jfrmethods",   benchMethodMap},
+    {"copyfile",     benchCopyFile},
+    {"dwarf",        benchDwarf},
+};
+
+static const int BENCHMARK_COUNT = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+static void run(const Benchmark& b) {
+    printf("=== %s ===\n", b.name);
+    b.run();
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        for (int i = 0; i < BENCHMARK_COUNT; i++) {
+            run(BENCHMARKS[i]);
+        }
+        return 0;
+    }
+
+    for (int arg = 1; arg < argc; arg++) {
+        int i = 0;
+        while (i < BENCHMARK_COUNT && strcmp(BENCHMARKS[i].name, argv[arg]) != 0) i++;
+        if (i == BENCHMARK_COUNT) {
+            fprintf(stderr, "Unknown benchmark: %s\n", argv[arg]);
+            return 1;
+        }
+        run(BENCHMARKS[i]);
+    }
+    return 0;
+}
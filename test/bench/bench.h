@@ -0,0 +1,50 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <time.h>
+#include "arch.h"
+
+
+static inline u64 nanotime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Calls op(thread, iteration) from a growing number of threads at once, the way
+// concurrent signal handlers hit shared structures, and prints ops/sec and p99 latency.
+// Single operations are too short to time, so latency is averaged over small batches.
+typedef void (*BenchOp)(int thread, u32 iteration);
+void runContended(BenchOp op, u32 ops_per_thread);
+
+void benchCallTraceStorage();
+void benchCallTraceStorageContended();
+void benchSampleCounters();
+void benchStageMetrics();
+void benchDictionary();
+void benchLinearAllocator();
+void benchCodeCache();
+void benchNativeCodeCache();
+void benchThreadFilter();
+void benchJfrBuffer();
+void benchMethodMap();
+void benchCopyFile();
+void benchDwarf();
+
+#endif // _BENCH_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "callTraceStorage.h"
+
+
+// Measures CallTraceStorage::put() throughput without a JVM.
+// Each configuration first inserts all distinct traces, then repeatedly puts
+// the same traces again, which is the common case while profiling.
+// Like a stack walker, every put() starts with filling the frame buffer.
+
+static const int DEPTHS[] = {16, 128, 1024, 2048};
+static const int DEPTH_COUNT = sizeof(DEPTHS) / sizeof(DEPTHS[0]);
+static const int TRACE_COUNTS[] = {256, 4096, 65536};
+static const int TRACE_COUNT_COUNT = sizeof(TRACE_COUNTS) / sizeof(TRACE_COUNTS[0]);
+static const int MAX_DEPTH = 2048;
+static const size_t MAX_STORAGE_SIZE = 512 * 1024 * 1024;
+static const u64 FRAMES_PER_RUN = 256 * 1024 * 1024;
+
+static ASGCT_CallFrame stack[MAX_DEPTH];
+static ASGCT_CallFrame frames[MAX_DEPTH];
+
+static void makeTrace(int depth, int id) {
+    for (int i = 0; i < depth; i++) {
+        frames[i] = stack[i];
+    }
+    frames[0].bci = id % 100;
+    frames[0].method_id = (jmethodID)(uintptr_t)(0x100000 + id * 8);
+}
+
+static double benchPut(int depth, int trace_count, TraceStore mode, double* memory_mb) {
+    CallTraceStorage* storage = new CallTraceStorage();
+    storage->setTraceStore(mode);
+
+    for (int id = 0; id < trace_count; id++) {
+        makeTrace(depth, id);
+        storage->put(depth, frames, 1);
+    }
+    *memory_mb = storage->usedMemory() / 1048576.0;
+
+    u64 ops = FRAMES_PER_RUN / depth;
+    u64 start = nanotime();
+    for (u64 i = 0; i < ops; i++) {
+        makeTrace(depth, (int)(i % trace_count));
+        storage->put(depth, frames, 1);
+    }
+    u64 elapsed = nanotime() - start;
+
+    delete storage;
+    return (double)elapsed / ops;
+}
+
+void benchCallTraceStorage() {
+    srand(1);
+    for (int i = 0; i < MAX_DEPTH; i++) {
+        stack[i].bci = rand() % 1000;
+        stack[i].method_id = (jmethodID)(uintptr_t)(rand() * 8ULL);
+    }
+
+    bool hw_hash = CallTraceStorage::setHardwareHash(true);
+    printf("Hardware CRC32C hash: %s\n", hw_hash ? "supported" : "not supported");
+    printf("put() time in ns; the trie and compact trace stores use the default hash\n\n");
+    printf("%6s %8s %10s %10s %10s %10s %10s %10s %10s\n",
+           "depth", "traces", "murmur", "crc32c", "trie", "compact", "flat MB", "trie MB", "compact MB");
+
+    for (int d = 0; d < DEPTH_COUNT; d++) {
+        for (int t = 0; t < TRACE_COUNT_COUNT; t++) {
+            int depth = DEPTHS[d];
+            int trace_count = TRACE_COUNTS[t];
+            if ((size_t)depth * trace_count * sizeof(ASGCT_CallFrame) > MAX_STORAGE_SIZE) {
+                continue;
+            }
+
+            double flat_mb, trie_mb, compact_mb;
+            CallTraceStorage::setHardwareHash(false);
+            double murmur = benchPut(depth, trace_count, TRACE_STORE_FLAT, &flat_mb);
+
+            double crc = murmur;
+            if (hw_hash) {
+                CallTraceStorage::setHardwareHash(true);
+                crc = benchPut(depth, trace_count, TRACE_STORE_FLAT, &flat_mb);
+            }
+
+            double trie = benchPut(depth, trace_count, TRACE_STORE_TRIE, &trie_mb);
+            double compact = benchPut(depth, trace_count, TRACE_STORE_COMPACT, &compact_mb);
+
+            printf("%6d %8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", depth, trace_count,
+                   murmur, crc, trie, compact, flat_mb, trie_mb, compact_mb);
+        }
+    }
+}
+
+
+// Concurrent put() of known traces into one shared storage, each thread filling
+// its own frame buffer like a signal handler does with its slot buffer.
+
+static const int CONTENDED_DEPTH = 64;
+static const int CONTENDED_TRACES = 4096;
+static const int MAX_SLOTS = 64;
+
+static CallTraceStorage* shared_storage;
+static ASGCT_CallFrame slot_frames[MAX_SLOTS][CONTENDED_DEPTH];
+
+static void putOp(int thread, u32 iteration) {
+    ASGCT_CallFrame* buf = slot_frames[thread % MAX_SLOTS];
+    int id = (iteration * 31 + thread * 1021) % CONTENDED_TRACES;
+    for (int i = 0; i < CONTENDED_DEPTH; i++) {
+        buf[i] = stack[i];
+    }
+    buf[0].bci = id % 100;
+    buf[0].method_id = (jmethodID)(uintptr_t)(0x100000 + id * 8);
+    shared_storage->put(CONTENDED_DEPTH, buf, 1);
+}
+
+void benchCallTraceStorageContended() {
+    srand(1);
+    for (int i = 0; i < CONTENDED_DEPTH; i++) {
+        stack[i].bci = rand() % 1000;
+        stack[i].method_id = (jmethodID)(uintptr_t)(rand() * 8ULL);
+    }
+
+    shared_storage = new CallTraceStorage();
+    for (int id = 0; id < CONTENDED_TRACES; id++) {
+        putOp(0, id);
+    }
+
+    printf("put() of %d known traces, depth %d\n\n", CONTENDED_TRACES, CONTENDED_DEPTH);
+    runContended(putOp, 1024 * 1024);
+    delete shared_storage;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "codeCache.h"
+
+
+// CodeCache::find() over compiled Java methods and NativeCodeCache::binarySearch()
+// over library symbols, both called from the signal handler to resolve native frames.
+
+static const int JAVA_METHODS = 2000;
+static const int NATIVE_SYMBOLS = 50000;
+static const int CODE_SIZE = 256;
+static const uintptr_t CODE_BASE = 0x10000000;
+
+static CodeCache* java_methods;
+static NativeCodeCache* native_lib;
+
+static const void* address(int index, u32 iteration) {
+    return (const void*)(CODE_BASE + (uintptr_t)index * CODE_SIZE + iteration % CODE_SIZE);
+}
+
+static void findOp(int thread, u32 iteration) {
+    java_methods->find(address((iteration * 31 + thread) % JAVA_METHODS, iteration));
+}
+
+static void binarySearchOp(int thread, u32 iteration) {
+    native_lib->binarySearch(address((iteration * 31 + thread) % NATIVE_SYMBOLS, iteration));
+}
+
+void benchCodeCache() {
+    java_methods = new CodeCache();
+    for (int i = 0; i < JAVA_METHODS; i++) {
+        java_methods->add(address(i, 0), CODE_SIZE, (jmethodID)(uintptr_t)(0x1000 + i * 8), true);
+    }
+
+    printf("find() among %d compiled methods\n\n", JAVA_METHODS);
+    runContended(findOp, 64 * 1024);
+    delete java_methods;
+}
+
+void benchNativeCodeCache() {
+    native_lib = new NativeCodeCache("libbench.so");
+    char name[32];
+    for (int i = 0; i < NATIVE_SYMBOLS; i++) {
+        snprintf(name, sizeof(name), "native_function_%d", i);
+        native_lib->add(address(i, 0), CODE_SIZE, name);
+    }
+    native_lib->sort();
+
+    printf("binarySearch() among %d symbols\n\n", NATIVE_SYMBOLS);
+    runContended(binarySearchOp, 2 * 1024 * 1024);
+    delete native_lib;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include "bench.h"
+
+
+static const int MAX_THREADS = 64;
+static const u32 BATCH_SIZE = 64;
+
+struct ContendedThread {
+    int index;
+    BenchOp op;
+    u32 batches;
+    pthread_barrier_t* barrier;
+    std::vector<double> batch_ns;
+};
+
+static void* contendedThread(void* arg) {
+    ContendedThread* t = (ContendedThread*)arg;
+    BenchOp op = t->op;
+    t->batch_ns.reserve(t->batches);
+
+    pthread_barrier_wait(t->barrier);
+
+    u32 iteration = 0;
+    for (u32 b = 0; b < t->batches; b++) {
+        u64 start = nanotime();
+        for (u32 i = 0; i < BATCH_SIZE; i++) {
+            op(t->index, iteration++);
+        }
+        t->batch_ns.push_back((double)(nanotime() - start) / BATCH_SIZE);
+    }
+    return NULL;
+}
+
+void runContended(BenchOp op, u32 ops_per_thread) {
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = std::min(std::max(cpus, 1), MAX_THREADS);
+    u32 batches = std::max(ops_per_thread / BATCH_SIZE, 1U);
+
+    printf("%8s %12s %10s %10s\n", "threads", "Mops/sec", "avg ns", "p99 ns");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, threads + 1);
+
+        ContendedThread state[MAX_THREADS];
+        pthread_t tids[MAX_THREADS];
+        for (int i = 0; i < threads; i++) {
+            state[i].index = i;
+            state[i].op = op;
+            state[i].batches = batches;
+            state[i].barrier = &barrier;
+            pthread_create(&tids[i], NULL, contendedThread, &state[i]);
+        }
+
+        pthread_barrier_wait(&barrier);
+        u64 start = nanotime();
+
+        std::vector<double> all;
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+            all.insert(all.end(), state[i].batch_ns.begin(), state[i].batch_ns.end());
+        }
+        u64 elapsed = nanotime() - start;
+        pthread_barrier_destroy(&barrier);
+
+        double sum = 0;
+        for (size_t i = 0; i < all.size(); i++) sum += all[i];
+        std::sort(all.begin(), all.end());
+
+        double total_ops = (double)threads * batches * BATCH_SIZE;
+        printf("%8d %12.2f %10.1f %10.1f\n", threads, total_ops * 1000.0 / elapsed,
+               sum / all.size(), all[all.size() * 99 / 100]);
+
+        if (threads == max_threads) break;
+    }
+}
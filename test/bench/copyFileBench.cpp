@@ -0,0 +1,124 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "bench.h"
+#include "os.h"
+
+
+// Appending a finished recording to another JFR file, as done for jfr=combine.
+// Compares OS::copyFile() with a sendfile() loop and a plain read/write loop.
+
+static const size_t FILE_SIZE = 256 * 1024 * 1024;
+static const int RUNS = 3;
+
+typedef bool (*CopyFunc)(int src_fd, int dst_fd, off_t offset, size_t size);
+
+#ifdef __linux__
+static bool copySendfile(int src_fd, int dst_fd, off_t offset, size_t size) {
+    while (size > 0) {
+        ssize_t bytes = sendfile(dst_fd, src_fd, &offset, size);
+        if (bytes <= 0) {
+            break;
+        }
+        size -= (size_t)bytes;
+    }
+    return size == 0;
+}
+#endif
+
+static bool copyReadWrite(int src_fd, int dst_fd, off_t offset, size_t size) {
+    static char buf[65536];
+    while (size > 0) {
+        ssize_t bytes = pread(src_fd, buf, size < sizeof(buf) ? size : sizeof(buf), offset);
+        if (bytes <= 0 || write(dst_fd, buf, bytes) != bytes) {
+            break;
+        }
+        offset += bytes;
+        size -= (size_t)bytes;
+    }
+    return size == 0;
+}
+
+static void measure(const char* name, CopyFunc copy, int src_fd, const char* dst_name) {
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        int dst_fd = open(dst_name, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (dst_fd < 0) {
+            printf("%-16s cannot create %s\n", name, dst_name);
+            return;
+        }
+        // Like the JDK recording the profiler chunk is appended to
+        ssize_t result = write(dst_fd, "FLR", 3);
+        (void)result;
+
+        u64 start = nanotime();
+        bool ok = copy(src_fd, dst_fd, 0, FILE_SIZE);
+        u64 elapsed = nanotime() - start;
+        close(dst_fd);
+
+        if (!ok) {
+            printf("%-16s failed\n", name);
+            return;
+        }
+        double mbps = FILE_SIZE / 1048576.0 / (elapsed / 1e9);
+        if (mbps > best) best = mbps;
+    }
+    printf("%-16s %10.0f MB/s\n", name, best);
+}
+
+void benchCopyFile() {
+    const char* tmp = getenv("TMPDIR");
+    char src_name[256], dst_name[256];
+    snprintf(src_name, sizeof(src_name), "%s/async-profiler-bench-src.%d", tmp != NULL ? tmp : "/tmp", getpid());
+    snprintf(dst_name, sizeof(dst_name), "%s/async-profiler-bench-dst.%d", tmp != NULL ? tmp : "/tmp", getpid());
+
+    int src_fd = open(src_name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (src_fd < 0) {
+        printf("Cannot create %s\n", src_name);
+        return;
+    }
+
+    char* chunk = (char*)malloc(1024 * 1024);
+    for (size_t i = 0; i < 1024 * 1024; i++) {
+        chunk[i] = (char)(i * 31 + (i >> 12));
+    }
+    for (size_t written = 0; written < FILE_SIZE; written += 1024 * 1024) {
+        if (write(src_fd, chunk, 1024 * 1024) != 1024 * 1024) {
+            printf("Cannot write %s\n", src_name);
+            break;
+        }
+    }
+    free(chunk);
+
+    printf("Append %d MB file, best of %d runs\n\n", (int)(FILE_SIZE >> 20), RUNS);
+    measure("OS::copyFile", OS::copyFile, src_fd, dst_name);
+#ifdef __linux__
+    measure("sendfile", copySendfile, src_fd, dst_name);
+#endif
+    measure("read/write", copyReadWrite, src_fd, dst_name);
+
+    close(src_fd);
+    unlink(src_name);
+    unlink(dst_name);
+}
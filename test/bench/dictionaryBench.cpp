@@ -0,0 +1,44 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "dictionary.h"
+
+
+// Dictionary::lookup() of already known class and method names,
+// as done for every frame when resolving call traces.
+
+static const int KEYS = 4096;
+static const u32 OPS_PER_THREAD = 2 * 1024 * 1024;
+
+static Dictionary* dictionary;
+static char keys[KEYS][64];
+
+static void lookupOp(int thread, u32 iteration) {
+    dictionary->lookup(keys[(iteration * 7 + thread * 131) % KEYS]);
+}
+
+void benchDictionary() {
+    dictionary = new Dictionary();
+    for (int i = 0; i < KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "Lcom/example/package%d/GeneratedClass%d;", i % 37, i);
+        dictionary->lookup(keys[i]);
+    }
+
+    printf("lookup() of %d existing keys\n\n", KEYS);
+    runContended(lookupOp, OPS_PER_THREAD);
+    delete dictionary;
+}
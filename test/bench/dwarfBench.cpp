@@ -0,0 +1,214 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <link.h>
+#endif
+#include "bench.h"
+#include "dwarf.h"
+
+
+// Builds the unwind table of libc, as done on the first cstack=dwarf start,
+// and checks every row of it against `readelf --debug-dump=frames-interp`.
+
+#if defined(__linux__) && DWARF_SUPPORTED
+
+static const int MAX_REPORTED_MISMATCHES = 10;
+
+#ifdef __x86_64__
+static const char* const FP_NAME = "rbp";
+static const char* const SP_NAME = "rsp";
+#else
+static const char* const FP_NAME = "ebp";
+static const char* const SP_NAME = "esp";
+#endif
+
+static FrameDesc* table;
+static int table_length;
+static int mismatches;
+
+static const FrameDesc* findFrameDesc(u32 loc) {
+    int low = 0;
+    int high = table_length - 1;
+    while (low <= high) {
+        int mid = (unsigned int)(low + high) >> 1;
+        if (table[mid].loc <= loc) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return high >= 0 ? &table[high] : NULL;
+}
+
+static const ElfW(Shdr)* findEhFrame(const ElfW(Ehdr)* ehdr) {
+    const ElfW(Shdr)* sections = (const ElfW(Shdr)*)((const char*)ehdr + ehdr->e_shoff);
+    const char* strtab = (const char*)ehdr + sections[ehdr->e_shstrndx].sh_offset;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (sections[i].sh_type != SHT_NOBITS && strcmp(strtab + sections[i].sh_name, ".eh_frame") == 0) {
+            return &sections[i];
+        }
+    }
+    return NULL;
+}
+
+// Converts a readelf rule like "rsp+16", "c-16", "u" or "exp" to the FrameDesc encoding
+static int expectedCfa(const char* rule) {
+    int reg = strncmp(rule, SP_NAME, 3) == 0 ? DW_REG_SP : strncmp(rule, FP_NAME, 3) == 0 ? DW_REG_FP : DW_REG_INVALID;
+    if (reg == DW_REG_INVALID || (rule[3] != '+' && rule[3] != '-')) {
+        return DW_REG_INVALID;
+    }
+    return (int)((u32)atoi(rule + 3) << 8) | reg;
+}
+
+static int expectedFpOff(const char* rule) {
+    return rule != NULL && rule[0] == 'c' ? atoi(rule + 1) : DW_SAME_FP;
+}
+
+static void checkRow(u32 loc, int cfa, int fp_off) {
+    const FrameDesc* fd = findFrameDesc(loc);
+    int actual_cfa = fd != NULL ? fd->cfa : DW_REG_INVALID;
+    int actual_fp_off = fd != NULL ? fd->fp_off : DW_SAME_FP;
+
+    // FP location does not matter when CFA is not computable
+    if (actual_cfa != cfa || (cfa != DW_REG_INVALID && actual_fp_off != fp_off)) {
+        if (++mismatches <= MAX_REPORTED_MISMATCHES) {
+            fprintf(stderr, "Mismatch at %x: cfa=%d:%d fp_off=%d, readelf cfa=%d:%d fp_off=%d\n", loc,
+                    actual_cfa & 0xff, actual_cfa >> 8, actual_fp_off, cfa & 0xff, cfa >> 8, fp_off);
+        }
+    }
+}
+
+// Walks FDEs printed by readelf. An FDE without rows keeps the initial rule of the CIE
+static int compareWithReadelf(const char* file_name) {
+    char cmd[PATH_MAX + 64];
+    snprintf(cmd, sizeof(cmd), "readelf --debug-dump=frames-interp '%s' 2>/dev/null", file_name);
+    FILE* f = popen(cmd, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[1024];
+    char* columns[32];
+    int fp_column = -1;
+    int ra_column = -1;
+    int rows = 0;
+    bool in_fde = false;
+    bool has_rows = false;
+    u32 fde_start = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        int n = 0;
+        for (char* s = strtok(line, " \n"); s != NULL && n < 32; s = strtok(NULL, " \n")) {
+            // Register rules like "r10 (r10)" take one column
+            if (s[0] != '(' || n == 0) columns[n++] = s;
+        }
+
+        if (n == 0 || (n >= 4 && strcmp(columns[3], "FDE") == 0)) {
+            if (in_fde && !has_rows) {
+                checkRow(fde_start, (int)((u32)DW_STACK_SLOT << 8) | DW_REG_SP, DW_SAME_FP);
+                rows++;
+            }
+            const char* pc = n >= 6 ? strstr(columns[5], "pc=") : NULL;
+            in_fde = pc != NULL;
+            has_rows = false;
+            fde_start = in_fde ? (u32)strtoull(pc + 3, NULL, 16) : 0;
+        } else if (in_fde && strcmp(columns[0], "LOC") == 0) {
+            has_rows = true;
+            fp_column = -1;
+            ra_column = -1;
+            for (int i = 0; i < n; i++) {
+                if (strcmp(columns[i], FP_NAME) == 0) fp_column = i;
+                if (strcmp(columns[i], "ra") == 0) ra_column = i;
+            }
+        } else if (in_fde && ra_column > 0 && n > ra_column) {
+            u32 loc = (u32)strtoull(columns[0], NULL, 16);
+            // Undefined return address marks the outermost frame
+            int cfa = strcmp(columns[ra_column], "u") == 0 ? DW_REG_INVALID : expectedCfa(columns[1]);
+            checkRow(loc, cfa, expectedFpOff(fp_column > 0 ? columns[fp_column] : NULL));
+            rows++;
+        }
+    }
+
+    return pclose(f) == 0 ? rows : -1;
+}
+
+void benchDwarf() {
+    Dl_info info;
+    if (dladdr((const void*)printf, &info) == 0 || info.dli_fname == NULL) {
+        printf("Could not locate libc\n");
+        return;
+    }
+    const char* file_name = info.dli_fname;
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        printf("Could not open %s\n", file_name);
+        return;
+    }
+    size_t length = (size_t)lseek(fd, 0, SEEK_END);
+    void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        printf("Could not map %s\n", file_name);
+        return;
+    }
+
+    const ElfW(Shdr)* section = findEhFrame((const ElfW(Ehdr)*)addr);
+    if (section == NULL) {
+        printf("No .eh_frame in %s\n", file_name);
+        munmap(addr, length);
+        return;
+    }
+
+    u64 start = nanotime();
+    DwarfParser dwarf((const char*)addr + section->sh_offset, section->sh_size, section->sh_addr, false);
+    u64 elapsed = nanotime() - start;
+
+    table = dwarf.table();
+    table_length = dwarf.count();
+    printf("%s: %d rules, %.1f KB, built in %.2f ms\n", file_name, table_length,
+           table_length * sizeof(FrameDesc) / 1024.0, elapsed / 1e6);
+
+    int rows = compareWithReadelf(file_name);
+    free(table);
+    munmap(addr, length);
+
+    if (rows < 0) {
+        printf("readelf is not available, skipping the check\n");
+    } else if (mismatches > 0) {
+        fprintf(stderr, "%d of %d readelf rows do not match\n", mismatches, rows);
+        exit(1);
+    } else {
+        printf("%d readelf rows matched\n", rows);
+    }
+}
+
+#else
+
+void benchDwarf() {
+    printf("DWARF unwinding is not supported on this platform\n");
+}
+
+#endif
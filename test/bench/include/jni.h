@@ -0,0 +1,67 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Minimal declarations for building the profiler data structures without a JDK
+
+#ifndef _BENCH_JNI_H
+#define _BENCH_JNI_H
+
+#include <stdint.h>
+
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+#define JNI_VERSION_1_6 0x00010006
+
+typedef int jint;
+typedef long jlong;
+typedef signed char jbyte;
+typedef unsigned char jboolean;
+
+typedef struct _jobject* jobject;
+typedef jobject jclass;
+typedef jobject jstring;
+typedef jobject jthread;
+typedef struct _jmethodID* jmethodID;
+
+struct JNIEnv_ {
+};
+typedef JNIEnv_ JNIEnv;
+
+typedef struct {
+    jint version;
+    char* name;
+    jobject group;
+} JavaVMAttachArgs;
+
+struct JavaVM_ {
+    jint GetEnv(void** penv, jint) {
+        *penv = NULL;
+        return -1;
+    }
+
+    jint AttachCurrentThreadAsDaemon(void** penv, void*) {
+        *penv = NULL;
+        return -1;
+    }
+
+    jint DetachCurrentThread() {
+        return 0;
+    }
+};
+typedef JavaVM_ JavaVM;
+
+#endif // _BENCH_JNI_H
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Minimal declarations for building the profiler data structures without a JDK
+
+#ifndef _BENCH_JVMTI_H
+#define _BENCH_JVMTI_H
+
+#include "jni.h"
+
+typedef enum {
+    JVMTI_ERROR_NONE = 0
+} jvmtiError;
+
+typedef enum {
+    JVMTI_ENABLE = 1,
+    JVMTI_DISABLE = 0
+} jvmtiEventMode;
+
+typedef struct {
+    jclass klass;
+    jint class_byte_count;
+    const unsigned char* class_bytes;
+} jvmtiClassDefinition;
+
+typedef jlong jlocation;
+
+typedef struct {
+    jmethodID method;
+    jlocation location;
+} jvmtiFrameInfo;
+
+typedef struct {
+    jlocation start_location;
+    jint line_number;
+} jvmtiLineNumberEntry;
+
+struct _jvmtiEnv {
+};
+typedef _jvmtiEnv jvmtiEnv;
+
+#endif // _BENCH_JVMTI_H
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "jfrBuffer.h"
+
+
+// Varint encoding of JFR event fields. Each thread writes to its own buffer,
+// like signal handlers do with per-slot recording buffers.
+
+static const int MAX_BUFFERS = 64;
+static const u32 OPS_PER_THREAD = 4 * 1024 * 1024;
+
+static RecordingBuffer* buffers;
+
+static void putVar32Op(int thread, u32 iteration) {
+    Buffer* buf = &buffers[thread % MAX_BUFFERS];
+    if (buf->offset() > RECORDING_BUFFER_LIMIT) buf->reset();
+    // Mostly small values like IDs and counts, sometimes large ones
+    buf->putVar32((iteration & 7) == 0 ? iteration * 2654435761U : iteration & 0x3fff);
+}
+
+static void putVar64Op(int thread, u32 iteration) {
+    Buffer* buf = &buffers[thread % MAX_BUFFERS];
+    if (buf->offset() > RECORDING_BUFFER_LIMIT) buf->reset();
+    // Timestamps and durations
+    buf->putVar64(0x100000000ULL * (iteration & 0xff) + iteration);
+}
+
+void benchJfrBuffer() {
+    buffers = new RecordingBuffer[MAX_BUFFERS];
+
+    printf("putVar32()\n\n");
+    runContended(putVar32Op, OPS_PER_THREAD);
+
+    printf("\nputVar64()\n\n");
+    runContended(putVar64Op, OPS_PER_THREAD);
+
+    delete[] buffers;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "linearAllocator.h"
+
+
+// LinearAllocator::alloc() of call trace sized objects from one shared allocator,
+// which is what concurrent signal handlers do when new traces are stored.
+
+static const size_t CHUNK_SIZE = 8 * 1024 * 1024;
+static const u32 OPS_PER_THREAD = 256 * 1024;
+
+static LinearAllocator* allocator;
+
+static void allocOp(int, u32 iteration) {
+    allocator->alloc(16 + (iteration % 16) * 16);
+}
+
+void benchLinearAllocator() {
+    printf("alloc() of 16-256 bytes, %d MB chunks\n\n", (int)(CHUNK_SIZE >> 20));
+
+    allocator = new LinearAllocator(CHUNK_SIZE);
+    runContended(allocOp, OPS_PER_THREAD);
+    delete allocator;
+}
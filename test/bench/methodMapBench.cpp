@@ -0,0 +1,144 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <stdio.h>
+#include "bench.h"
+#include "jfrBuffer.h"
+#include "methodMap.h"
+
+
+// Writing the stack trace section of a JFR constant pool: every frame of every trace
+// resolves its method and maps bci to a line number. Compares the former std::map with
+// linear line table scan against MethodMap with binary search, for a growing trace count.
+
+static const int METHODS = 50000;
+static const int FRAMES_PER_TRACE = 100;
+static const int LINE_ENTRIES = 64;
+static const int TRACE_COUNTS[] = {10000, 50000, 200000};
+
+static jvmtiLineNumberEntry* line_tables;
+
+static jmethodID methodId(int i) {
+    // Spread like real jmethodIDs: pointers to 8-byte slots in JNI handle blocks
+    return (jmethodID)(0x7f0000100000ULL + (u64)i * 8 * 13);
+}
+
+static void fillMethod(MethodInfo* mi, int i) {
+    mi->_class = i / 16;
+    mi->_name = i;
+    mi->_sig = i % 97;
+    mi->_modifiers = 1;
+    mi->_line_number_table_size = LINE_ENTRIES;
+    mi->_line_number_table = line_tables + (size_t)i * LINE_ENTRIES;
+    mi->_type = FRAME_INTERPRETED;
+}
+
+static jint linearLineNumber(MethodInfo* mi, jint bci) {
+    int i = 1;
+    while (i < mi->_line_number_table_size && bci >= mi->_line_number_table[i].start_location) {
+        i++;
+    }
+    return mi->_line_number_table[i - 1].line_number;
+}
+
+// Frames come from a fixed pseudo-random sequence, the same for both variants
+struct FrameSource {
+    u32 state;
+
+    FrameSource() : state(12345) {
+    }
+
+    u32 next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+static void writeFrame(Buffer* buf, MethodInfo* mi, jint line, jint bci) {
+    if (buf->offset() > RECORDING_BUFFER_LIMIT) buf->reset();
+    buf->putVar32(mi->_key);
+    buf->putVar32(line);
+    buf->putVar32(bci);
+    buf->putVar32(mi->_type);
+}
+
+static double runStdMap(int traces) {
+    std::map<jmethodID, MethodInfo> map;
+    RecordingBuffer buf;
+    FrameSource src;
+
+    u64 start = nanotime();
+    for (int t = 0; t < traces; t++) {
+        for (int f = 0; f < FRAMES_PER_TRACE; f++) {
+            u32 r = src.next();
+            int method = r % METHODS;
+            jint bci = (r >> 16) % (LINE_ENTRIES * 8);
+            MethodInfo* mi = &map[methodId(method)];
+            if (mi->_key == 0) {
+                mi->_key = map.size();
+                fillMethod(mi, method);
+            }
+            writeFrame(&buf, mi, linearLineNumber(mi, bci), bci);
+        }
+    }
+    return (nanotime() - start) / 1e6;
+}
+
+static double runMethodMap(int traces) {
+    MethodMap map;
+    RecordingBuffer buf;
+    FrameSource src;
+
+    u64 start = nanotime();
+    for (int t = 0; t < traces; t++) {
+        for (int f = 0; f < FRAMES_PER_TRACE; f++) {
+            u32 r = src.next();
+            int method = r % METHODS;
+            jint bci = (r >> 16) % (LINE_ENTRIES * 8);
+            MethodInfo* mi = map.get(methodId(method));
+            if (mi->_key == 0) {
+                mi->_key = map.size();
+                fillMethod(mi, method);
+            }
+            writeFrame(&buf, mi, mi->getLineNumber(bci), bci);
+        }
+    }
+    return (nanotime() - start) / 1e6;
+}
+
+void benchMethodMap() {
+    line_tables = new jvmtiLineNumberEntry[(size_t)METHODS * LINE_ENTRIES];
+    for (int i = 0; i < METHODS; i++) {
+        for (int j = 0; j < LINE_ENTRIES; j++) {
+            line_tables[(size_t)i * LINE_ENTRIES + j].start_location = j * 8;
+            line_tables[(size_t)i * LINE_ENTRIES + j].line_number = 100 + j;
+        }
+    }
+
+    printf("%d methods, %d frames per trace, %d line table entries\n\n",
+           METHODS, FRAMES_PER_TRACE, LINE_ENTRIES);
+    printf("%10s %14s %14s %8s\n", "traces", "std::map ms", "MethodMap ms", "speedup");
+    for (size_t i = 0; i < sizeof(TRACE_COUNTS) / sizeof(TRACE_COUNTS[0]); i++) {
+        double before = runStdMap(TRACE_COUNTS[i]);
+        double after = runMethodMap(TRACE_COUNTS[i]);
+        printf("%10d %14.1f %14.1f %7.1fx\n", TRACE_COUNTS[i], before, after, before / after);
+    }
+
+    delete[] line_tables;
+}
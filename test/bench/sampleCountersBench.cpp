@@ -0,0 +1,128 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include "bench.h"
+#include "callTraceStorage.h"
+#include "os.h"
+#include "sampleCounters.h"
+
+
+// Emulates the counter updates done by every signal handler: the total sample count
+// and the counters of a hot call trace. Compares a single global counter with atomic
+// trace updates against striped counters with per-slot trace deltas.
+// Latency is measured over batches of samples and reported per sample.
+
+static const int MAX_THREADS = 64;
+static const int HOT_TRACES = 4;
+static const int TRACE_DEPTH = 32;
+static const int BATCH_SIZE = 64;
+static const int BATCHES = 20000;
+
+static volatile u64 global_total_samples;
+static StripedSampleCounters striped_counters;
+static CallTraceDeltas trace_deltas[MAX_THREADS];
+
+static CallTraceStorage* storage;
+static ASGCT_CallFrame traces[HOT_TRACES][TRACE_DEPTH];
+static pthread_barrier_t barrier;
+
+struct ThreadResult {
+    int index;
+    bool striped;
+    std::vector<double> batch_ns;
+};
+
+static void* benchThread(void* arg) {
+    ThreadResult* result = (ThreadResult*)arg;
+    int tid = OS::threadId();
+    CallTraceDeltas* deltas = result->striped ? &trace_deltas[result->index] : NULL;
+    result->batch_ns.reserve(BATCHES);
+
+    pthread_barrier_wait(&barrier);
+
+    for (int b = 0; b < BATCHES; b++) {
+        u64 start = nanotime();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            if (result->striped) {
+                atomicInc(striped_counters.stripe(tid).total_samples);
+            } else {
+                atomicInc(global_total_samples);
+            }
+            storage->put(TRACE_DEPTH, traces[i % HOT_TRACES], 1000, deltas);
+        }
+        result->batch_ns.push_back((double)(nanotime() - start) / BATCH_SIZE);
+    }
+
+    if (deltas != NULL) {
+        storage->flushDeltas(deltas);
+    }
+    return NULL;
+}
+
+static void runThreads(int thread_count, bool striped, double* mean, double* p99) {
+    storage = new CallTraceStorage();
+    pthread_barrier_init(&barrier, NULL, thread_count);
+
+    ThreadResult results[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < thread_count; i++) {
+        results[i].index = i;
+        results[i].striped = striped;
+        pthread_create(&threads[i], NULL, benchThread, &results[i]);
+    }
+
+    std::vector<double> all;
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+        all.insert(all.end(), results[i].batch_ns.begin(), results[i].batch_ns.end());
+    }
+
+    double sum = 0;
+    for (size_t i = 0; i < all.size(); i++) sum += all[i];
+    std::sort(all.begin(), all.end());
+    *mean = sum / all.size();
+    *p99 = all[all.size() * 99 / 100];
+
+    pthread_barrier_destroy(&barrier);
+    delete storage;
+}
+
+void benchSampleCounters() {
+    for (int t = 0; t < HOT_TRACES; t++) {
+        for (int i = 0; i < TRACE_DEPTH; i++) {
+            traces[t][i].bci = i;
+            traces[t][i].method_id = (jmethodID)(uintptr_t)(0x1000 + (t * TRACE_DEPTH + i) * 8);
+        }
+    }
+
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = std::min(std::max(cpus, 1), MAX_THREADS);
+    printf("Per-sample counter update latency in ns, %d CPUs\n\n", cpus);
+    printf("%8s %12s %12s %12s %12s\n", "threads", "atomic avg", "atomic p99", "striped avg", "striped p99");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        double atomic_mean, atomic_p99, striped_mean, striped_p99;
+        runThreads(threads, false, &atomic_mean, &atomic_p99);
+        runThreads(threads, true, &striped_mean, &striped_p99);
+        printf("%8d %12.1f %12.1f %12.1f %12.1f\n", threads, atomic_mean, atomic_p99, striped_mean, striped_p99);
+        if (threads == max_threads) break;
+    }
+}
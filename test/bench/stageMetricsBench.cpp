@@ -0,0 +1,85 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "stageMetrics.h"
+
+
+// Checks that percentiles are reported as bucket upper bounds, then measures
+// the per-sample cost of stage timing as done by Profiler::recordSample().
+
+static StageMetrics metrics;
+
+static void checkPercentile(const StageHistogram& h, double fraction, u64 expected) {
+    u64 actual = StageMetrics::percentile(h, fraction);
+    if (actual != expected) {
+        fprintf(stderr, "percentile(%.2f) = %llu, expected %llu\n",
+                fraction, (unsigned long long)actual, (unsigned long long)expected);
+        exit(1);
+    }
+}
+
+static void checkPercentiles() {
+    StageHistogram h;
+    memset(&h, 0, sizeof(h));
+    checkPercentile(h, 0.5, 2ULL << (METRICS_BUCKETS - 1));
+
+    // 50 durations in [8, 16), 40 in [32, 64) and 10 in [1024, 2048) ticks
+    h.count = 100;
+    h.buckets[3] = 50;
+    h.buckets[5] = 40;
+    h.buckets[10] = 10;
+    checkPercentile(h, 0.0, 16);
+    checkPercentile(h, 0.49, 16);
+    checkPercentile(h, 0.50, 64);
+    checkPercentile(h, 0.90, 2048);
+    checkPercentile(h, 0.99, 2048);
+    printf("percentile() check passed\n");
+}
+
+// Same sequence of timed stages as a sample with native and Java stack walking
+__attribute__((noinline))
+static void sampleOp(int thread, u32) {
+    u64 sample_start = metrics.start();
+    u64 start = metrics.start();
+    metrics.record(thread, STAGE_NATIVE_TRACE, start);
+    start = metrics.start();
+    metrics.record(thread, STAGE_JAVA_TRACE, start);
+    start = metrics.start();
+    metrics.record(thread, STAGE_STORAGE_PUT, start);
+    metrics.record(thread, STAGE_SAMPLE, sample_start);
+}
+
+void benchStageMetrics() {
+    checkPercentiles();
+
+    const u32 ops = 4 * 1024 * 1024;
+    for (int enabled = 0; enabled <= 1; enabled++) {
+        metrics.clear();
+        metrics.setEnabled(enabled != 0);
+
+        u64 start = nanotime();
+        for (u32 i = 0; i < ops; i++) {
+            sampleOp(0, i);
+        }
+        printf("\nTiming %s: %.1f ns per sample, single thread\n",
+               enabled ? "enabled" : "disabled", (double)(nanotime() - start) / ops);
+        runContended(sampleOp, ops / 16);
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2021 Andrei Pangin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include "bench.h"
+#include "threadFilter.h"
+
+
+// ThreadFilter::accept() checked on every sample when profiling selected threads.
+// Every thread occasionally adds and removes its own ID, as thread start/end events do.
+
+static const int FIRST_TID = 1000;
+static const int TID_RANGE = 100000;
+static const u32 OPS_PER_THREAD = 4 * 1024 * 1024;
+
+static ThreadFilter* filter;
+
+static void acceptOp(int thread, u32 iteration) {
+    if ((iteration & 0xfff) == 0) {
+        filter->remove(FIRST_TID + thread);
+        filter->add(FIRST_TID + thread);
+    }
+    filter->accept(FIRST_TID + (iteration * 7919 + thread) % TID_RANGE);
+}
+
+void benchThreadFilter() {
+    filter = new ThreadFilter();
+    filter->init("1000-5000,20000-21000");
+
+    printf("accept() of thread IDs in a %d wide range\n\n", TID_RANGE);
+    runContended(acceptOp, OPS_PER_THREAD);
+    delete filter;
+}
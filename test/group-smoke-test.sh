@@ -0,0 +1,56 @@
+#!/bin/bash
+
+set -e  # exit on any failure
+set -x  # print all executed lines
+
+if [ -z "${JAVA_HOME}" ]; then
+  echo "JAVA_HOME is not set"
+  exit 1
+fi
+
+(
+  cd $(dirname $0)
+
+  if [ "Target.class" -ot "Target.java" ]; then
+     ${JAVA_HOME}/bin/javac Target.java
+  fi
+
+  # Batch mode resolves Java frames by frame pointers
+  ${JAVA_HOME}/bin/java -XX:+PreserveFramePointer Target &
+
+  JAVAPID=$!
+  trap "kill $JAVAPID" EXIT
+
+  sleep 1     # allow the Java runtime to initialize
+
+  # Software events only, so that the test runs on VMs without a PMU
+  GROUP="-e cpu-clock --group page-faults+context-switches"
+
+  function assert_string() {
+    if ! grep -q "$1" $2; then
+      exit 1
+    fi
+  }
+
+  for MODE in "" "--batch 64k"; do
+    FILENAME=/tmp/java-group.html
+    ../profiler.sh -f $FILENAME -d 3 $GROUP --ratio "context-switches/cpu-clock" $MODE $JAVAPID
+
+    # Frames carry the ratio as the last argument of f(), and some of them must be non-zero
+    assert_string "const ratioName = 'context-switches/cpu-clock'" $FILENAME
+    grep -oE "',[0-9.e+-]+\)$" $FILENAME | grep -q "[1-9]"
+
+    FILENAME=/tmp/java-group.jfr
+    ../profiler.sh -f $FILENAME -d 3 $GROUP $MODE $JAVAPID
+
+    assert_string "profiler.PerfCounters" $FILENAME
+
+    # The jfr tool is part of JDK 11+
+    if [ -x "${JAVA_HOME}/bin/jfr" ]; then
+      EVENTS=$(${JAVA_HOME}/bin/jfr print --events profiler.PerfCounters $FILENAME | tr -d ' \n')
+      # The sampled counter and at least one of the group counters are non-zero
+      echo "$EVENTS" | grep -qE "counters=\[[1-9][0-9]*,"
+      echo "$EVENTS" | grep -qE "counters=\[[0-9]+,([0-9]+,)*[0-9]*[1-9]"
+    fi
+  done
+)